@@ -0,0 +1,69 @@
+/*
+ *
+ * NAME: evhandl_analyze.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Offline analysis of a raw log file. The file is memory mapped and
+ *  split into one chunk per thread. As frames carry no sync pattern,
+ *  each thread guesses the first frame boundary of its chunk by finding
+ *  a chain of plausible frame headers, and parses frames until passing
+ *  the end of its chunk. A guess is confirmed when the previous chunk
+ *  ended exactly where the next one started, otherwise that chunk is
+ *  parsed again from the right position. The result is therefore the
+ *  same as when parsing the whole file from the start.
+ */
+
+#ifndef EVHANDL_ANALYZE_H
+#define EVHANDL_ANALYZE_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "evhandl_frame.h"
+
+// Max number of threads used by the analysis
+const uint32_t  MAX_ANALYZE_THREADS = 64;
+
+struct FrameCount {
+  uint64_t  frames;
+  uint64_t  bytes;   // Including the frame headers
+};
+
+struct AnalyzeResult {
+  uint64_t                 fileSize;
+  uint32_t                 threads;
+  uint32_t                 reparsedChunks;  // Boundary guessed wrong
+  FrameCount               total;
+  std::map<int, FrameCount> channels;
+  std::vector<FrameCount>  events;          // Indexed by Event ID
+  // Control frames per (CMN, result). The result is the second data
+  // word, -1 for control frames with only one data word, e.g. the
+  // connect request.
+  std::map<std::pair<int, int>, uint64_t> controlMessages;
+  uint64_t                 invalidOffset;   // First invalid header, or
+                                            // fileSize if none
+  uint64_t                 truncatedBytes;  // Last frame cut short
+};
+
+// Analyze a raw log file using up to the given number of threads.
+// Frames stating more than max_data_length octets of data are invalid,
+// the analysis stops at the first invalid frame. Returns false with
+// errno set if the file can not be read.
+bool analyze_file(const std::string& name, int max_data_length,
+                  uint32_t threads, AnalyzeResult& result);
+
+#endif // EVHANDL_ANALYZE_H
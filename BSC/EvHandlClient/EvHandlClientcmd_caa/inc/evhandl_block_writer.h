@@ -0,0 +1,167 @@
+/*
+ *
+ * NAME: evhandl_block_writer.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Decouples the socket receive loop from the disk. The receive thread
+ *  copies frames into fixed size blocks which are handed to a dedicated
+ *  writer thread through a bounded lock-free queue. The total amount of
+ *  block memory decides how long a disk stall can be absorbed before
+ *  the receive thread has to wait.
+ *
+ *  A thread finding its queue empty sleeps on an eventfd, which the
+ *  other thread only writes to when it sees the sleeping flag set, i.e.
+ *  the queues need no system calls while both threads are busy.
+ *
+ *  The writer can also be shared by several files, e.g. one per BSC,
+ *  in which case the receive thread keeps one current block per file.
+ */
+
+#ifndef EVHANDL_BLOCK_WRITER_H
+#define EVHANDL_BLOCK_WRITER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "evhandl_metrics.h"
+#include "evhandl_output_file.h"
+#include "evhandl_spsc_queue.h"
+#include "evhandl_thread_tuning.h"
+
+// Size of each block handed to the writer thread. Must be able to hold
+// the largest frame.
+const size_t  WRITE_BLOCK_SIZE = 256 * 1024;
+
+// Default amount of memory used for buffering towards the disk, in MB
+const uint32_t  DEFAULT_WRITE_BUFFER_MB = 32;
+
+// Max amount of memory allowed for buffering towards the disk, in MB
+const uint32_t  MAX_WRITE_BUFFER_MB = 1024;
+
+struct WriteBlock {
+  char     *data;
+  size_t    used;        // Number of octets filled in
+  uint32_t  frames;      // Number of frames in the block
+  bool      flush;       // Flush the file after writing this block
+  bool      close;       // Close the file after writing this block
+  uint64_t  firstTimeMs; // Time the first frame was added
+  uint64_t  firstReceiveNs; // Arrival of the first frame with a known
+                            // arrival time, 0 if none
+  uint64_t  lastTimeMs;  // Time the block was handed to the writer
+  OutputFile *file;      // File to write the block to
+  const char *name;      // File name used in error printouts
+};
+
+class BlockWriter {
+public:
+  // Writer for one file, see append() and flush(). display_name is the
+  // file name as seen from the NBFS, used in error printouts.
+  BlockWriter(OutputFile& out, const std::string& display_name,
+              size_t buffer_size);
+
+  // Writer shared by several files, see acquire() and submit()
+  explicit BlockWriter(size_t buffer_size);
+  ~BlockWriter();
+
+  // Start the writer thread, which applies tuning to itself
+  void start(const ThreadTuning& tuning = NO_THREAD_TUNING);
+
+  // Copy a complete frame into the current block. Called from the
+  // receive thread only. receive_ns is the arrival time of the frame in
+  // ns since the epoch, 0 if not known.
+  void append(const char *frame, size_t length, uint64_t receive_ns = 0);
+
+  // Hand the current block to the writer thread, even if not full, and
+  // let the writer flush the file after it has been written.
+  void flush();
+
+  // Write everything still buffered and stop the writer thread
+  void stop();
+
+  // Get an empty block for the given file, waiting for the writer thread
+  // if none is free. name must be valid until the block is written.
+  WriteBlock* acquire(OutputFile *file, const char *name);
+
+  // Copy a complete frame into the block, submitting it and acquiring a
+  // new one for the same file when full. Returns the block to continue
+  // with.
+  WriteBlock* append(WriteBlock *block, const char *frame, size_t length,
+                     uint64_t receive_ns = 0);
+
+  // Hand a block to the writer thread. If close_after is set, the file is
+  // closed after the block has been written.
+  void submit(WriteBlock *block, bool flush_after, bool close_after = false);
+
+  // Max number of octets queued towards the disk since start
+  uint64_t high_water_mark() const { return highWaterMark; }
+
+  // Total time the receive thread has been waiting for a free block
+  uint64_t stall_time_ms() const { return stallTimeUs.load() / 1000; }
+
+  // Total amount of block memory
+  size_t capacity() const { return blocks.size() * WRITE_BLOCK_SIZE; }
+
+  // Time to write each block and to flush the file, updated by the
+  // writer thread
+  const LatencyHistogram& write_latency() const { return writeLatency; }
+  const LatencyHistogram& flush_latency() const { return flushLatency; }
+
+  // Time from the arrival of the first frame of a block until the block
+  // has been written, i.e. the worst case of the frames in the block
+  const LatencyHistogram& receive_to_write() const { return receiveToWrite; }
+
+private:
+  void init_blocks();
+  static void* writer_thread(void *pParams);
+  void run();
+  WriteBlock* get_free_block();
+
+  // Sleep until a block is filled or the writer is stopped, called by
+  // the writer thread
+  void wait_for_filled_block();
+
+  // Sleep until a block is free, called by the receive thread
+  void wait_for_free_block();
+
+  // Wake up the other thread if it is sleeping on wake_fd
+  static void wake(std::atomic<bool>& sleeping, int wake_fd);
+
+  OutputFile               *out;
+  std::string               displayName;
+  std::vector<WriteBlock>   blocks;
+  SpscQueue<WriteBlock*>    filledBlocks; // Receive thread -> writer
+  SpscQueue<WriteBlock*>    freeBlocks;   // Writer -> receive thread
+  WriteBlock               *current;
+  pthread_t                 thread;
+  ThreadTuning              tuning;
+  bool                      started;
+  std::atomic<bool>         done;
+  std::atomic<bool>         writerSleeping;   // On filledWakeFd
+  std::atomic<bool>         receiverSleeping; // On freeWakeFd
+  int                       filledWakeFd;
+  int                       freeWakeFd;
+  std::atomic<uint64_t>     queuedBytes;
+  std::atomic<uint64_t>     stallTimeUs;
+  uint64_t                  highWaterMark;
+  char                      pad0[64];
+  LatencyHistogram          writeLatency;
+  LatencyHistogram          flushLatency;
+  LatencyHistogram          receiveToWrite;
+};
+
+#endif // EVHANDL_BLOCK_WRITER_H
@@ -0,0 +1,65 @@
+/*
+ *
+ * NAME: evhandl_capture_engine.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Interface for the alternative capture engines. An engine takes over
+ *  the socket and the log file once the connection and the event
+ *  subscriptions have been set up, and moves the event stream to the
+ *  file until the connection is closed or logging is stopped.
+ */
+
+#ifndef EVHANDL_CAPTURE_ENGINE_H
+#define EVHANDL_CAPTURE_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Selectable capture engines
+struct Engine {
+  enum { standard, uring, splice };
+};
+
+// Why a capture engine returned
+struct CaptureEnd {
+  enum { connectionClosed, stopped, maxFileSize };
+};
+
+// Counters and limits shared between the engine and the main program
+struct CaptureState {
+  uint32_t&                  numberOfEvents;
+  uint64_t&                  bytesWritten;   // Also the current file offset
+  uint64_t                   maxFileSize;
+  std::atomic<const char*>&  stopReason;     // Set when asked to stop
+  std::atomic<bool>&         flushDue;       // Set on every housekeeping
+                                             // tick, cleared by the engine
+};
+
+class CaptureEngine {
+public:
+  virtual ~CaptureEngine() {}
+
+  // Move frames from socket_fd to file_fd, starting at file offset
+  // state.bytesWritten. The stream starts with the partial_length octets
+  // at partial, the start of a frame already read from the socket.
+  // Returns one of CaptureEnd.
+  virtual int run(int socket_fd, int file_fd, const char *partial,
+                  size_t partial_length, CaptureState& state) = 0;
+
+  // Number of system calls used for receiving since start
+  virtual uint64_t syscalls() const = 0;
+};
+
+#endif // EVHANDL_CAPTURE_ENGINE_H
@@ -0,0 +1,88 @@
+/*
+ *
+ * NAME: evhandl_capture_loop.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Event loop of a single BSC capture. One epoll instance multiplexes
+ *  the BSC socket, stdin, a signalfd and timerfds for the periodic
+ *  housekeeping and the max logging time, so that the receive loop
+ *  needs no clock reads or other threads for them. An eventfd lets
+ *  another thread wake up the thread waiting in the loop.
+ *
+ *  The stop signals must be blocked in all threads for the signalfd to
+ *  receive them, i.e. block_signals() must be called before any thread
+ *  is started.
+ */
+
+#ifndef EVHANDL_CAPTURE_LOOP_H
+#define EVHANDL_CAPTURE_LOOP_H
+
+#include <stdint.h>
+
+// What wait() returned for, or'ed together
+struct LoopEvent {
+  enum {
+    socket  = 0x01,  // The BSC socket is readable or closed
+    quit    = 0x02,  // 'q' or 'Q' entered on stdin
+    signal  = 0x04,  // A stop signal was received, see last_signal()
+    tick    = 0x08,  // Time for the periodic housekeeping
+    maxTime = 0x10,  // The max logging time has passed
+    wake    = 0x20   // wake() was called
+  };
+};
+
+class CaptureLoop {
+public:
+  CaptureLoop();
+  ~CaptureLoop();
+
+  // Block SIGINT, SIGTERM and SIGHUP in the calling thread and the
+  // threads it starts, or unblock them again
+  static void block_signals(bool block = true);
+
+  // Set up the loop with stdin and the signals. A tick is given every
+  // tick_ms, max_time_sec after the start maxTime is given once unless
+  // 0. Returns false with errno set on failure.
+  bool open(uint32_t tick_ms, uint32_t max_time_sec);
+
+  // Wait for the BSC socket as well. Returns false with errno set on
+  // failure.
+  bool watch_socket(int socket_fd);
+
+  // Wait until at least one event, or at most timeout_ms unless -1.
+  // Returns the LoopEvent bits, 0 on timeout.
+  int wait(int timeout_ms = -1);
+
+  // Wake up the thread in wait(), from another thread
+  void wake();
+
+  // The last stop signal received
+  int last_signal() const { return lastSignal; }
+
+private:
+  bool add(int fd);
+  void read_input();
+
+  int   epollFd;
+  int   signalFd;
+  int   tickFd;
+  int   maxTimeFd;
+  int   wakeFd;
+  int   socketFd;
+  bool  inputOpen;
+  int   lastSignal;
+  int   pending;     // LoopEvent bits not yet returned
+};
+
+#endif // EVHANDL_CAPTURE_LOOP_H
@@ -0,0 +1,84 @@
+/*
+ *
+ * NAME: evhandl_compressed_file.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Compressed log files. The file is a sequence of independently
+ *  compressed blocks, each holding complete frames as written by the
+ *  writer thread, i.e. the file can be decompressed while it is still
+ *  being written and damaged blocks only lose their own frames.
+ *
+ *  Each block starts with a header, all fields little endian:
+ *    magic          4 octets  "EHZ1"
+ *    raw length     4 octets  Length of the frames in the block
+ *    stored length  4 octets  Length of the data following the header
+ *    checksum       4 octets  Adler-32 of the stored data
+ *  The stored data is LZ4 compressed, unless the stored length equals
+ *  the raw length in which case the frames are stored as is.
+ */
+
+#ifndef EVHANDL_COMPRESSED_FILE_H
+#define EVHANDL_COMPRESSED_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "evhandl_output_file.h"
+
+const size_t    COMPRESSED_BLOCK_HEADER_LENGTH = 16;
+
+// Blocks claiming more than this are considered damaged
+const uint32_t  MAX_COMPRESSED_BLOCK_RAW_LENGTH = 16 * 1024 * 1024;
+
+// Suffix added to the name of compressed log files
+const std::string  COMPRESSED_SUFFIX = ".z";
+
+// Compresses each write into a block before passing it on to the file
+class CompressedOutputFile : public OutputFile {
+public:
+  // The file is deleted together with this object
+  explicit CompressedOutputFile(OutputFile *file);
+  virtual ~CompressedOutputFile();
+
+  virtual bool open(const std::string& name);
+  virtual bool write(const char *data, size_t length);
+  virtual bool flush();
+  virtual bool close();
+
+  // Number of octets written to the file, may be read by any thread
+  uint64_t stored_bytes() const { return storedBytes; }
+
+private:
+  OutputFile             *file;
+  std::vector<char>       block;
+  std::atomic<uint64_t>   storedBytes;
+};
+
+struct DecompressResult {
+  uint32_t  blocks;
+  uint64_t  rawBytes;       // Octets written to the output file
+  uint32_t  damagedBlocks;
+  uint64_t  skippedBytes;   // Octets of the input file not decompressed
+};
+
+// Decompress a file written by CompressedOutputFile, skipping damaged
+// blocks and a truncated last block. Returns false with errno set if a
+// file can not be read or written.
+bool decompress_file(const std::string& in_name, const std::string& out_name,
+                     DecompressResult& result);
+
+#endif // EVHANDL_COMPRESSED_FILE_H
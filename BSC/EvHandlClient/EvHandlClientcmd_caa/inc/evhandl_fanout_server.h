@@ -0,0 +1,119 @@
+/*
+ *
+ * NAME: evhandl_fanout_server.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Shares the received frame stream with local consumers. Consumers
+ *  connect to a Unix domain stream socket and receive every event frame
+ *  received from the BSC after they connected, in the same format as in
+ *  the log file.
+ *
+ *  The receive thread copies each frame into a lock-free hand-off ring
+ *  and never waits. A fan-out thread moves the frames from the ring into
+ *  a bounded queue per consumer and sends them with non-blocking writes.
+ *  When the queue of a slow consumer is full, whole frames are dropped
+ *  for that consumer only and counted, so the stream each consumer
+ *  receives always consists of complete frames.
+ */
+
+#ifndef EVHANDL_FANOUT_SERVER_H
+#define EVHANDL_FANOUT_SERVER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Size of the ring between the receive thread and the fan-out thread
+const size_t  FANOUT_HANDOFF_SIZE = 8 * 1024 * 1024;
+
+// Size of the queue of each consumer. Frames are dropped for a consumer
+// not keeping up when its queue is full.
+const size_t  FANOUT_QUEUE_SIZE = 4 * 1024 * 1024;
+
+// Max number of consumers connected at the same time
+const uint32_t  MAX_FANOUT_SUBSCRIBERS = 64;
+
+struct FanoutSubscriber;
+
+class FanoutServer {
+public:
+  FanoutServer();
+  ~FanoutServer();
+
+  // Create the listening socket, replacing a socket file left by an
+  // earlier run. Returns false with errno set on failure.
+  bool open(const std::string& path);
+
+  void start();
+
+  // Called by the receive thread for each frame. Never blocks.
+  void publish(const char *frame, size_t length);
+
+  // Send what is queued to the consumers still connected, then close
+  // all connections and remove the socket file.
+  void stop();
+
+  // Number of connected consumers, may be called from any thread
+  uint32_t subscribers() const { return subscriberCount.load(); }
+
+  // Number of frames dropped for any consumer, may be called from any
+  // thread
+  uint64_t dropped_frames() const
+  {
+    return droppedFrames.load() + handoffDrops.load();
+  }
+
+  // Print the frames queued for and dropped for each consumer. Only to be
+  // called after stop().
+  void print_summary() const;
+
+private:
+  static void* fanout_thread(void *pParams);
+  void run();
+  void accept_subscribers();
+  void distribute(size_t from, size_t to);
+  void send_queued(FanoutSubscriber *subscriber);
+  void close_subscriber(FanoutSubscriber *subscriber);
+  void wait_for_work();
+
+  std::string                    path;
+  int                            listenFd;
+  int                            epollFd;
+  int                            wakeFd;    // eventfd waking the thread
+  pthread_t                      thread;
+  bool                           started;
+
+  // Hand-off ring, written by the receive thread only
+  std::vector<char>              ring;
+  size_t                         mask;
+  char                           pad0[64];
+  std::atomic<size_t>            head;      // Next octet to move out
+  char                           pad1[64];
+  std::atomic<size_t>            tail;      // Next octet to fill in
+  char                           pad2[64];
+  std::atomic<bool>              sleeping;  // Fan-out thread waits
+  std::atomic<bool>              stopping;
+
+  // Owned by the fan-out thread, closed consumers are kept for the
+  // summary
+  std::vector<FanoutSubscriber*> subscriberList;
+  std::atomic<uint32_t>          subscriberCount;
+  std::atomic<uint64_t>          droppedFrames;
+  std::atomic<uint64_t>          handoffDrops;
+};
+
+#endif // EVHANDL_FANOUT_SERVER_H
@@ -0,0 +1,64 @@
+/*
+ *
+ * NAME: evhandl_frame.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Layout of the frames exchanged with the BSC Event Handler, as
+ *  described in the GMLog and R-PMO IWDs.
+ *
+ *  Every frame starts with a four octet header:
+ *
+ *  |    DW0    |    DW1    |
+ *  +-----+-----+-----+-----+
+ *  |  0  |  1  |  2  |  3  |
+ *  +-----+-----+-----+-----+
+ *  |   NDW     |  Channel  |
+ *
+ *  NDW == Number of Data Words (16 bit) following the header
+ *  Channel == 0 for control messages, 2 for event data
+ */
+
+#ifndef EVHANDL_FRAME_H
+#define EVHANDL_FRAME_H
+
+#include <stdint.h>
+
+const int32_t  FRAME_HEADER_LENGTH = 4;
+
+const int32_t  CONTROL_CHANNEL = 0;
+const int32_t  EVENT_CHANNEL   = 2;
+
+// Number of different Event IDs
+const uint32_t  EVENT_ID_COUNT = 65536;
+
+// Number of octets of data following the header
+inline int frame_data_length(const char *header)
+{
+  return ((unsigned char)header[0] * 256 + (unsigned char)header[1]) * 2;
+}
+
+// Channel the frame was sent on
+inline int frame_channel(const char *header)
+{
+  return (unsigned char)header[2] * 256 + (unsigned char)header[3];
+}
+
+// Event ID of an event frame, the first data word following the header.
+// The frame must have at least one data word.
+inline int frame_event_id(const char *header)
+{
+  return (unsigned char)header[4] * 256 + (unsigned char)header[5];
+}
+
+#endif // EVHANDL_FRAME_H
@@ -0,0 +1,72 @@
+/*
+ *
+ * NAME: evhandl_frame_filter.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Local filter on the received event frames. The filter expression
+ *  is compiled once into a short program evaluated on each frame:
+ *
+ *    expr       := term { "or" term }
+ *    term       := factor { "and" factor }
+ *    factor     := "not" factor | "(" expr ")" | comparison
+ *    comparison := field op number | field "in" list
+ *    field      := "eid" | "len" | "channel" | "word[" number "]"
+ *    op         := "==" | "!=" | "<" | "<=" | ">" | ">="
+ *    list       := item { "," item },  item := number | number "-" number
+ *
+ *  eid is the first data word, len the frame length in octets including
+ *  the header and word[N] data word N, word[0] being the Event ID.
+ *  Numbers are decimal, also with leading zeros, or hexadecimal with 0x.
+ *  A comparison on a word beyond the end of the frame is false. Lists are
+ *  compiled into bit sets, so the cost of "in" does not depend on the
+ *  length of the list. "and" and "or" only evaluate the right side when
+ *  needed.
+ *
+ *  Example: eid in 1,2,7 and word[3] in 100-110 and len >= 64
+ */
+
+#ifndef EVHANDL_FRAME_FILTER_H
+#define EVHANDL_FRAME_FILTER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct FilterInstruction {
+  int       op;       // FilterOp
+  int       field;    // FilterField
+  int       word;     // Data word index for FilterField::word
+  int       compare;  // FilterCompare
+  uint32_t  value;    // Value to compare with, set index or jump target
+};
+
+class FrameFilter {
+public:
+  FrameFilter();
+
+  // Compile an expression. Returns false with a description of the
+  // error if the expression is not valid.
+  bool compile(const std::string& expression, std::string& error);
+
+  // Evaluate the filter on a frame
+  bool accept(const char *frame) const;
+
+private:
+  struct Parser;
+
+  std::vector<FilterInstruction>        program;
+  std::vector<std::vector<uint64_t> >   sets;
+};
+
+#endif // EVHANDL_FRAME_FILTER_H
@@ -0,0 +1,120 @@
+/*
+ *
+ * NAME: evhandl_frame_receiver.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Batched receive path for the event stream. Data is read from the
+ *  socket in large chunks into a ring buffer and complete frames are
+ *  handed out in place, i.e. the socket is only read again when the
+ *  buffered data does not contain a complete frame.
+ *
+ *  When receive timestamps are enabled, the kernel reports the time the
+ *  last segment of each read arrived. As the socket is only read when no
+ *  complete frame is buffered, the last octet of every frame handed out
+ *  after a read arrived in that read, i.e. its timestamp is the arrival
+ *  time of the frame.
+ */
+
+#ifndef EVHANDL_FRAME_RECEIVER_H
+#define EVHANDL_FRAME_RECEIVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "evhandl_metrics.h"
+
+// Default size of the receive ring buffer
+const size_t  RECEIVE_RING_SIZE = 1024 * 1024;
+
+class FrameReceiver {
+public:
+  // max_data_length is the largest number of data octets (excluding the
+  // header) accepted in a single frame.
+  FrameReceiver(int socket_fd, int max_data_length,
+                size_t ring_size = RECEIVE_RING_SIZE);
+  ~FrameReceiver();
+
+  // Return the next complete frame (header included) and store its
+  // length in frame_length. The returned pointer is valid until the next
+  // call. Returns NULL when the connection has been closed, or in
+  // non-blocking mode also when no complete frame can be read now.
+  char* next_frame(int& frame_length);
+
+  // As next_frame(), but only returns a frame already complete in the
+  // buffer, the socket is never read
+  char* buffered_frame(int& frame_length);
+
+  // Do not wait for data when reading, for use with an event loop
+  void set_nonblocking(bool enable) { recvFlags = enable ? MSG_DONTWAIT : 0; }
+
+  // True when the connection has been closed by the remote side
+  bool closed() const { return endOfStream; }
+
+  // Number of recv() calls done since start
+  uint64_t recv_calls() const { return recvCalls; }
+
+  // Number of frames handed out since start
+  uint64_t frames() const { return framesReceived; }
+
+  // Number of octets read from the socket since start
+  uint64_t bytes() const { return bytesReceived; }
+
+  // Number of octets read but not yet handed out, e.g. a partial frame
+  size_t buffered() const { return writePos - readPos; }
+
+  // The octets read but not yet handed out, buffered() of them
+  const char* buffered_data() const { return ring + readPos; }
+
+  // Ask the kernel for receive timestamps (SO_TIMESTAMPNS). Returns false
+  // with errno set if not supported, the time of the read is then used.
+  bool enable_timestamps();
+
+  // Arrival time of the last frame handed out, in ns since the epoch.
+  // 0 unless timestamps are enabled.
+  uint64_t receive_time_ns() const { return receiveTimeNs; }
+
+  // Time between the arrival of consecutive frames. Frames arriving in
+  // the same read have no gap.
+  const LatencyHistogram& inter_arrival() const { return interArrival; }
+
+private:
+  // Read more data from the socket. Returns false on end of stream or
+  // when no data is available in non-blocking mode.
+  bool fill();
+
+  // recv() taking the receive timestamp of the data
+  ssize_t receive_with_timestamp();
+
+  int       socketFd;
+  int       recvFlags;
+  int       maxFrameLength;
+  char     *ring;
+  size_t    ringSize;
+  size_t    readPos;  // Start of the first unconsumed octet
+  size_t    writePos; // End of the received data
+
+  uint64_t  recvCalls;
+  uint64_t  framesReceived;
+  uint64_t  bytesReceived;
+  bool      endOfStream;
+
+  bool      timestamps;
+  uint64_t  readTimeNs;     // Time of the last read
+  uint64_t  receiveTimeNs;  // Time of the last frame handed out
+  LatencyHistogram interArrival;
+};
+
+#endif // EVHANDL_FRAME_RECEIVER_H
@@ -0,0 +1,124 @@
+/*
+ *
+ * NAME: evhandl_indexed_file.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Log file format v2, the raw frames in blocks preceded by a block
+ *  marker, followed by an index of all blocks at the end of the file.
+ *  The index makes it possible to read only the blocks of a time window
+ *  or containing given events. All fields are little endian.
+ *
+ *  Block marker, followed by the frames of the block:
+ *    magic          4 octets  "EHB2"
+ *    length         4 octets  Length of the frames following the marker
+ *    frames         4 octets  Number of frames in the block
+ *    spare          4 octets
+ *    first time     8 octets  Capture time of the first frame, ms since
+ *                             the Epoch
+ *    last time      8 octets  Capture time of the last frame
+ *    event mask     8 octets  Bit (eid % 64) set for each Event ID in the
+ *                             block
+ *
+ *  Index, one entry per block:
+ *    offset         8 octets  File offset of the block marker
+ *    first time     8 octets
+ *    last time      8 octets
+ *    event mask     8 octets
+ *    length         4 octets
+ *    frames         4 octets
+ *
+ *  Trailer, the last octets of the file:
+ *    magic          4 octets  "EHX2"
+ *    entries        4 octets  Number of index entries
+ *    offset         8 octets  File offset of the index
+ *
+ *  A file without trailer, e.g. after a crash, is read by hopping from
+ *  block marker to block marker instead.
+ */
+
+#ifndef EVHANDL_INDEXED_FILE_H
+#define EVHANDL_INDEXED_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "evhandl_output_file.h"
+
+const size_t  BLOCK_MARKER_LENGTH  = 40;
+const size_t  INDEX_ENTRY_LENGTH   = 40;
+const size_t  INDEX_TRAILER_LENGTH = 16;
+
+// Suffix added to the name of v2 log files
+const std::string  INDEXED_SUFFIX = ".v2";
+
+struct BlockIndexEntry {
+  uint64_t  offset;
+  uint64_t  firstTimeMs;
+  uint64_t  lastTimeMs;
+  uint64_t  eventMask;
+  uint32_t  length;
+  uint32_t  frames;
+};
+
+// Bit in the event mask for an Event ID
+inline uint64_t event_mask_bit(int eid)
+{
+  return 1ULL << (eid % 64);
+}
+
+// Adds a block marker before each write and the index when closed
+class IndexedOutputFile : public OutputFile {
+public:
+  // The file is deleted together with this object
+  explicit IndexedOutputFile(OutputFile *file);
+  virtual ~IndexedOutputFile();
+
+  virtual bool open(const std::string& name);
+  virtual void set_capture_time(uint64_t first_ms, uint64_t last_ms);
+  virtual bool write(const char *data, size_t length);
+  virtual bool flush();
+  virtual bool close();
+
+private:
+  OutputFile                    *file;
+  std::vector<BlockIndexEntry>   index;
+  uint64_t                       offset;       // Current file offset
+  uint64_t                       firstTimeMs;  // Of the next write
+  uint64_t                       lastTimeMs;
+};
+
+struct ExtractFilter {
+  uint64_t          fromMs;   // Blocks ending before this are skipped
+  uint64_t          toMs;     // Blocks starting after this are skipped
+  std::vector<int>  eids;     // Event IDs to extract, empty for all
+};
+
+struct ExtractResult {
+  bool      indexed;      // The index was used, rather than the markers
+  uint32_t  blocks;       // Blocks in the file
+  uint32_t  blocksRead;   // Blocks read as they matched the filter
+  uint64_t  frames;       // Frames written to the output file
+  uint64_t  bytes;        // Octets written to the output file
+};
+
+// Write the raw frames of a v2 file matching the filter to out_name.
+// Control frames of matching blocks are always written. Returns false
+// with errno set if a file can not be read or written, or EINVAL if
+// in_name is not a v2 file.
+bool extract_frames(const std::string& in_name, const std::string& out_name,
+                    const ExtractFilter& filter, ExtractResult& result);
+
+#endif // EVHANDL_INDEXED_FILE_H
@@ -0,0 +1,52 @@
+/*
+ *
+ * NAME: evhandl_little_endian.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Encoding of the little endian fields used in the log file formats
+ *  added by the client, independent of the host byte order.
+ */
+
+#ifndef EVHANDL_LITTLE_ENDIAN_H
+#define EVHANDL_LITTLE_ENDIAN_H
+
+#include <stdint.h>
+
+inline void put32(char *p, uint32_t value)
+{
+  p[0] = (char)(value & 0xff);
+  p[1] = (char)((value >> 8) & 0xff);
+  p[2] = (char)((value >> 16) & 0xff);
+  p[3] = (char)(value >> 24);
+}
+
+inline uint32_t get32(const char *p)
+{
+  const uint8_t *u = (const uint8_t *)p;
+
+  return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+inline void put64(char *p, uint64_t value)
+{
+  put32(p, (uint32_t)value);
+  put32(p + 4, (uint32_t)(value >> 32));
+}
+
+inline uint64_t get64(const char *p)
+{
+  return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+#endif // EVHANDL_LITTLE_ENDIAN_H
@@ -0,0 +1,42 @@
+/*
+ *
+ * NAME: evhandl_lz4.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Block compression using the LZ4 block format. The compressor is a
+ *  plain single pass greedy matcher, which is fast enough to keep up
+ *  with the writer thread. Blocks can be decompressed by any LZ4 block
+ *  decoder.
+ */
+
+#ifndef EVHANDL_LZ4_H
+#define EVHANDL_LZ4_H
+
+#include <stddef.h>
+
+// Max compressed length of length octets
+inline size_t lz4_compress_bound(size_t length)
+{
+  return length + (length / 255) + 16;
+}
+
+// Compress length octets from src into dst. Returns the compressed
+// length, or 0 if it does not fit in capacity octets.
+size_t lz4_compress(const char *src, size_t length, char *dst, size_t capacity);
+
+// Decompress length octets from src into dst. Returns the decompressed
+// length, or -1 if the data is corrupt or does not fit in capacity octets.
+long lz4_decompress(const char *src, size_t length, char *dst, size_t capacity);
+
+#endif // EVHANDL_LZ4_H
@@ -0,0 +1,232 @@
+/*
+ *
+ * NAME: evhandl_metrics.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Live metrics of a capture: frames and octets per Event ID and per
+ *  channel, latency histograms and values collected from the rest of
+ *  the client. They are served over HTTP in the Prometheus text format
+ *  by a thread of their own and can be dumped as JSON.
+ *
+ *  Each counter and histogram is only updated by one thread, using
+ *  relaxed atomic loads and stores, i.e. plain memory accesses. Counters
+ *  updated by different threads are kept on separate cache lines.
+ */
+
+#ifndef EVHANDL_METRICS_H
+#define EVHANDL_METRICS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "evhandl_frame.h"
+#include "evhandl_thread_tuning.h"
+
+// Latency histograms have log-linear buckets like HdrHistogram: each
+// power of two is split into 8 buckets, i.e. a value is known within
+// 12.5%. Below 128 ns the buckets are 16 ns wide. The last bucket holds
+// durations above 2^LATENCY_MAX_POWER ns (about 17 s).
+const int       LATENCY_SUB_BUCKETS = 8;
+const int       LATENCY_MIN_POWER   = 7;
+const int       LATENCY_MAX_POWER   = 34;
+const int       LATENCY_BUCKETS     = (LATENCY_MAX_POWER - LATENCY_MIN_POWER + 1) *
+                                      LATENCY_SUB_BUCKETS + 1;
+
+// Frames on channels from this number on are counted together
+const int       METRICS_CHANNELS = 16;
+
+// The time spent handling a frame in the receive loop is measured for
+// one frame in this many
+const uint32_t  METRICS_SAMPLE_INTERVAL = 64;
+
+// Max number of bytes read of an HTTP request
+const size_t    MAX_METRICS_REQUEST_SIZE = 4096;
+
+// Monotonic time in nanoseconds
+inline uint64_t monotonic_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Add to a counter only updated by the calling thread
+inline void add_counter(std::atomic<uint64_t>& counter, uint64_t value)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+
+  // Add a duration, only to be called by one thread
+  void add(uint64_t duration_ns)
+  {
+    int bucket;
+
+    // Bucket n covers durations above its lower and up to its upper
+    // bound, as the Prometheus buckets
+    if (duration_ns <= (1ULL << LATENCY_MIN_POWER)) {
+      bucket = (duration_ns == 0) ? 0 :
+               (duration_ns - 1) >> (LATENCY_MIN_POWER - 3);
+    }
+    else {
+      uint64_t value = duration_ns - 1;
+      int      power = 63 - __builtin_clzll(value);
+
+      if (power >= LATENCY_MAX_POWER) {
+        bucket = LATENCY_BUCKETS - 1;
+      }
+      else {
+        bucket = (power - LATENCY_MIN_POWER + 1) * LATENCY_SUB_BUCKETS +
+                 ((value >> (power - 3)) & (LATENCY_SUB_BUCKETS - 1));
+      }
+    }
+    add_counter(buckets[bucket], 1);
+    add_counter(sumNs, duration_ns);
+    if (duration_ns > maxNs.load(std::memory_order_relaxed)) {
+      maxNs.store(duration_ns, std::memory_order_relaxed);
+    }
+  }
+
+  // Number of durations added, may be called from any thread
+  uint64_t count() const;
+
+  // Duration not exceeded by the given fraction of the durations, e.g.
+  // 0.99, as the upper bound of its bucket. 0 if empty.
+  uint64_t percentile_ns(double fraction) const;
+
+  uint64_t max_ns() const { return maxNs.load(std::memory_order_relaxed); }
+
+  // Print count, percentiles and max on one line after a title
+  void print_summary(const char *title) const;
+
+  // Append the histogram in the Prometheus text format, or as a JSON
+  // object
+  void write_prometheus(std::string& text, const char *name,
+                        const char *help) const;
+  void write_json(std::string& text) const;
+
+private:
+  static uint64_t upper_bound(int bucket);
+
+  std::atomic<uint64_t>  buckets[LATENCY_BUCKETS];
+  std::atomic<uint64_t>  sumNs;
+  std::atomic<uint64_t>  maxNs;
+};
+
+struct FrameCounter {
+  std::atomic<uint64_t>  frames;
+  std::atomic<uint64_t>  bytes;
+};
+
+// Value collected from the rest of the client when serving the metrics
+struct MetricValue {
+  const char  *name;
+  const char  *help;
+  const char  *type;    // "counter" or "gauge"
+  double       value;
+};
+
+typedef void (*MetricsCollector)(std::vector<MetricValue>& values);
+
+struct NamedHistogram {
+  const char              *name;
+  const char              *help;
+  const LatencyHistogram  *histogram;
+};
+
+class CaptureMetrics {
+public:
+  // collector may be NULL
+  explicit CaptureMetrics(MetricsCollector metrics_collector);
+  ~CaptureMetrics();
+
+  // Count a received frame. Called by the receive thread only.
+  void count_frame(const char *frame, size_t length)
+  {
+    int channel = frame_channel(frame);
+
+    if (channel >= METRICS_CHANNELS) {
+      channel = METRICS_CHANNELS;
+    }
+    add_counter(channels[channel].frames, 1);
+    add_counter(channels[channel].bytes, length);
+
+    if ((channel == EVENT_CHANNEL) && (length > (size_t)FRAME_HEADER_LENGTH)) {
+      FrameCounter& counter = events[frame_event_id(frame)];
+
+      add_counter(counter.frames, 1);
+      add_counter(counter.bytes, length);
+    }
+  }
+
+  // Time spent handling a frame in the receive loop, updated by the
+  // receive thread only
+  LatencyHistogram& frame_handling() { return frameHandling; }
+
+  // Include a histogram updated elsewhere, e.g. by the writer thread.
+  // name and help must stay valid.
+  void add_histogram(const char *name, const char *help,
+                     const LatencyHistogram *histogram);
+
+  // Listen for HTTP requests on [<address>:]<port>, the address
+  // defaults to 127.0.0.1. Returns false with errno set on failure.
+  bool listen(const std::string& address_port);
+
+  // Start serving the requests and updating the rates. The metrics
+  // thread applies tuning to itself.
+  void start(const ThreadTuning& tuning = NO_THREAD_TUNING);
+  void stop();
+
+  // Write all metrics as JSON to a file. Returns false with errno set on
+  // failure.
+  bool write_json(const std::string& name) const;
+
+private:
+  static void* metrics_thread(void *pParams);
+  void run();
+  void update_rates();
+  void serve(int fd);
+  void write_prometheus(std::string& text) const;
+
+  // Updated by the receive thread
+  std::vector<FrameCounter>  events;       // Indexed by Event ID
+  FrameCounter               channels[METRICS_CHANNELS + 1];
+  LatencyHistogram           frameHandling;
+  char                       pad0[64];
+
+  // Owned by the metrics thread
+  MetricsCollector           collector;
+  std::vector<NamedHistogram> histograms;
+  uint64_t                   startNs;
+  int                        listenFd;
+  int                        wakeFd;      // eventfd stopping the thread
+  pthread_t                  thread;
+  ThreadTuning               tuning;
+  bool                       started;
+  uint64_t                   lastRateNs;
+  std::vector<uint64_t>      lastEventFrames;
+  std::vector<double>        eventRates;  // Frames per second
+  uint64_t                   lastChannelFrames[METRICS_CHANNELS + 1];
+  double                     channelRates[METRICS_CHANNELS + 1];
+};
+
+#endif // EVHANDL_METRICS_H
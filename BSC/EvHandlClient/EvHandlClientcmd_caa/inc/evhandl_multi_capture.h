@@ -0,0 +1,94 @@
+/*
+ *
+ * NAME: evhandl_multi_capture.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Capture from several BSCs in one process. All connections are
+ *  non-blocking and handled by one thread using epoll, i.e. connect,
+ *  subscription and capture of all sessions are interleaved. Each
+ *  session writes its own file through one writer thread shared by all
+ *  sessions. The user quits by entering 'q' on stdin, which is also
+ *  handled by the event loop.
+ */
+
+#ifndef EVHANDL_MULTI_CAPTURE_H
+#define EVHANDL_MULTI_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "evhandl_block_writer.h"
+#include "evhandl_protocol.h"
+
+// Max number of BSCs captured by one process
+const uint32_t  MAX_CAPTURE_TARGETS = 256;
+
+struct CaptureTarget {
+  int               cmd;          // InvokedAs
+  std::string       ip;
+  int               port;
+  std::vector<int>  events;
+  std::vector<int>  cells;        // Ends with -1
+  int               msId;
+  char              msIdBuff[IMSI_LENGTH];
+  std::string       filename;     // Absolute path
+  std::string       displayName;  // As seen from the NBFS
+};
+
+struct Session;
+
+class MultiCapture {
+public:
+  // max_file_size applies to each session, max_logging_time (seconds) to
+  // all sessions together
+  MultiCapture(int max_data_length, size_t write_buffer_size,
+               uint64_t max_file_size, uint32_t max_logging_time);
+  ~MultiCapture();
+
+  void add_target(const CaptureTarget& target);
+
+  // Capture until all sessions have ended, the max logging time has
+  // passed or the user quits. Returns the number of sessions that
+  // failed before capturing.
+  int run();
+
+private:
+  void start_session(Session *session);
+  void end_session(Session *session, const std::string& result);
+  void handle_input();
+  void handle_output(Session *session);
+  void handle_receive(Session *session);
+  void handle_frame(Session *session, const char *frame, int length);
+  void send_message(Session *session, const char *message, int length);
+  void send_next_subscription(Session *session);
+  void write_frame(Session *session, const char *frame, int length);
+  void flush_sessions();
+  void print_statistics();
+  void print_summary();
+
+  int                      maxDataLength;
+  size_t                   writeBufferSize;
+  uint64_t                 maxFileSize;
+  uint32_t                 maxLoggingTime;
+  std::vector<Session*>    sessions;
+  BlockWriter             *writer;
+  int                      epollFd;
+  uint32_t                 activeSessions;
+  bool                     inputOpen;
+  const char              *stopReason;   // Set when all sessions shall end
+};
+
+#endif // EVHANDL_MULTI_CAPTURE_H
@@ -0,0 +1,179 @@
+/*
+ *
+ * NAME: evhandl_output_file.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  The log file as written by the writer thread. All functions return
+ *  false with errno set on failure.
+ */
+
+#ifndef EVHANDL_OUTPUT_FILE_H
+#define EVHANDL_OUTPUT_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <deque>
+#include <fstream>
+#include <string>
+
+class Writeback;
+
+// Selectable output file writers
+struct Writer {
+  enum { stream, direct, mapped };
+};
+
+// Selectable log file formats
+struct Format {
+  enum { raw, compressed, v2 };
+};
+
+class OutputFile {
+public:
+  virtual ~OutputFile() {}
+
+  // Create the file, or truncate it if it exists
+  virtual bool open(const std::string& name) = 0;
+
+  // Capture time of the frames in the following write, in ms since the
+  // Epoch
+  virtual void set_capture_time(uint64_t /*first_ms*/, uint64_t /*last_ms*/) {}
+
+  // Called with complete frames only
+  virtual bool write(const char *data, size_t length) = 0;
+
+  // Hand everything written so far over to the kernel
+  virtual bool flush() = 0;
+
+  virtual bool close() = 0;
+};
+
+// Buffered writing using an ofstream
+class StreamOutputFile : public OutputFile {
+public:
+  virtual bool open(const std::string& name);
+  virtual bool write(const char *data, size_t length);
+  virtual bool flush();
+  virtual bool close();
+
+private:
+  std::ofstream  out;
+};
+
+// Writing with O_DIRECT from aligned buffers, i.e. bypassing the page
+// cache. The file is preallocated up front to limit fragmentation. The
+// file size always is the real length, also between flushes.
+class DirectOutputFile : public OutputFile {
+public:
+  // preallocate_size is the number of octets to allocate when opened
+  explicit DirectOutputFile(uint64_t preallocate_size);
+  virtual ~DirectOutputFile();
+
+  virtual bool open(const std::string& name);
+  virtual bool write(const char *data, size_t length);
+  virtual bool flush();
+  virtual bool close();
+
+private:
+  // Write the staged octets padded to a full alignment unit at the
+  // current file offset, and cut the padding off again
+  bool write_staged_tail();
+
+  // Allocate the rest of preallocateSize beyond the current end of the
+  // file, without changing the file size
+  void preallocate(bool note_failure);
+
+  uint64_t   preallocateSize;
+  int        fd;
+  char      *staging;       // Aligned staging buffer
+  size_t     stagingUsed;
+  uint64_t   fileOffset;    // Offset of the staging buffer in the file
+};
+
+// Writing by copying into a shared mapping of a window of the file, i.e.
+// without a user space buffer or a write() per block. The window is
+// allocated on disk before it is mapped, so that running out of disk
+// space fails the write instead of raising SIGBUS. The file size is not
+// changed by the allocation, the file is grown to cover each write just
+// before the data is copied, i.e. a reader of the file or a file left
+// behind by a crash never sees the zeros of the rest of the window.
+class MappedOutputFile : public OutputFile {
+public:
+  MappedOutputFile();
+  virtual ~MappedOutputFile();
+
+  virtual bool open(const std::string& name);
+  virtual bool write(const char *data, size_t length);
+  virtual bool flush();
+  virtual bool close();
+
+private:
+  // Unmap the full window and map the one following it
+  bool map_next_window();
+
+  // Grow the file to cover the next length octets of the window, and
+  // fault in their pages
+  bool grow(size_t length);
+
+  int        fd;
+  char      *window;
+  uint64_t   windowOffset;  // Offset of the window in the file
+  size_t     windowUsed;
+};
+
+// Log file split into numbered segments, e.g. logfile_rpmo.0001.rpm,
+// logfile_rpmo.0002.rpm and so on. A new segment is started when the
+// current one would grow beyond the segment size, or is older than the
+// segment time. As writes always contain complete frames, no frame is
+// split between segments. Only the newest segments are kept.
+class SegmentedOutputFile : public OutputFile {
+public:
+  SegmentedOutputFile(int writer_type, uint64_t segment_size,
+                      uint32_t segment_time, uint32_t max_segments,
+                      Writeback *writeback = NULL);
+  virtual ~SegmentedOutputFile();
+
+  // name is the file name without segment number
+  virtual bool open(const std::string& name);
+  virtual bool write(const char *data, size_t length);
+  virtual bool flush();
+  virtual bool close();
+
+private:
+  bool open_next_segment();
+
+  int                      writerType;
+  Writeback               *writeback;
+  uint64_t                 segmentSize;
+  uint32_t                 segmentTime;   // Seconds
+  uint32_t                 maxSegments;
+  std::string              baseName;
+  std::deque<std::string>  segments;      // Names of the kept segments
+  uint32_t                 segmentNumber;
+  OutputFile              *segment;
+  uint64_t                 segmentBytes;
+  time_t                   segmentStart;
+};
+
+// Create a file writer of the given type, see Writer. The file is
+// written with the policy of writeback unless NULL, see
+// evhandl_writeback.h.
+OutputFile* create_output_file(int writer_type, uint64_t max_file_size,
+                               Writeback *writeback = NULL);
+
+// Name of a segment, the number is inserted before the suffix
+std::string segment_file_name(const std::string& name, uint32_t number);
+
+#endif // EVHANDL_OUTPUT_FILE_H
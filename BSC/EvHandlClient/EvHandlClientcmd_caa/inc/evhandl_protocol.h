@@ -0,0 +1,97 @@
+/*
+ *
+ * NAME: evhandl_protocol.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Encoding of the control messages sent to the BSC Event Handler and
+ *  decoding of the command line lists, as described in the GMLog and
+ *  R-PMO IWDs. Shared by the single and multi BSC capture.
+ */
+
+#ifndef EVHANDL_PROTOCOL_H
+#define EVHANDL_PROTOCOL_H
+
+#include <stdint.h>
+
+// Enumerations
+struct InvokedAs {
+  enum { unknown, GMLog, RPMO };
+};
+
+struct MsId {
+  enum { IMSI, TLLI, none };
+};
+
+// Constants
+const int32_t  MAX_EVENT_IDS  = 64;
+const int32_t  MAX_CELLS      = 2048;
+
+const int32_t  IMSI_LENGTH        = 10;  // Encoded IMSI length
+const int32_t  IMSI_FILTER_ID     = 1;
+const int32_t  IMSI_FILTER_LENGTH = (IMSI_LENGTH/2)+1;  // Length in words
+
+const int32_t  TLLI_LENGTH        = 4;
+const int32_t  TLLI_FILTER_ID     = 2;
+const int32_t  TLLI_FILTER_LENGTH = (TLLI_LENGTH/2)+1;  // Length in words
+
+const int32_t  GMLOG_EID_TROUBLE_SHOOTING_RP = 17;
+const int32_t  GMLOG_EID_TROUBLE_SHOOTING_CP = 18;
+
+// All system events are between 0xFF00 and 0xFFFF
+const int32_t  EID_SYSTEM_EVENT_MASK = 0xFF00;
+
+// Control Message Numbers
+const int32_t  CMN_CONNECT   = 1;
+const int32_t  CMN_SUBSCRIBE = 11;
+
+// The connect request is 6 octets and the reply 10 octets, the result
+// of the connect request is in octet 7 of the reply
+const int32_t  CONNECT_REQUEST_LENGTH = 6;
+const int32_t  CONNECT_REPLY_LENGTH   = 10;
+const int32_t  CONNECT_RESULT_INDEX   = 7;
+
+// Max length of a subscription request, with all cells and an IMSI
+const int32_t  MAX_SUBSCRIPTION_REQUEST_LENGTH = 12 + 2*MAX_CELLS + 4 + IMSI_LENGTH;
+
+// Build a connect request. Returns the length.
+int build_connect_request(char *buffer);
+
+// Build a subscription request for an event. cell_list ends with -1,
+// msFlt is the assembled IMSI or TLLI if msId is not MsId::none. Returns
+// the length.
+int build_subscription_request(char *buffer, int eid, const int *cell_list,
+                               const char *msFlt, int msId, int cmd);
+
+// Reason for a failed connect request, "" if not known
+const char* connection_result_text(int result);
+
+// Reason for a failed subscription request, "" if not known
+const char* subscription_result_text(int result);
+
+// Assemble the IMSI as coded in GMLOG IWD
+void assemble_imsi(char *imsi_buff, const char *imsi);
+
+// Assemble TLLI as coded in GMLOG IWD
+void assemble_tlli(char *tlli_buff, char *tlli);
+
+// Decode the events id arguments. Comma separated to a array of int.
+int decode_event_list(char *events, int *event_list);
+
+// Decode the cell pointers arguments. Comma separated to a array of int.
+int decode_cell_list(char *cells, int *cell_list);
+
+// Print hex buffer
+void printBuffer(char * buff, int len);
+
+#endif // EVHANDL_PROTOCOL_H
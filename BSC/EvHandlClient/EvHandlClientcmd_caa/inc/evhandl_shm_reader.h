@@ -0,0 +1,190 @@
+/*
+ *
+ * NAME: evhandl_shm_reader.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Reader of the shared memory ring written by evhandlclient --shm.
+ *  Header only, a reader needs this file and evhandl_shm_ring.h and is
+ *  linked with -lrt. Example:
+ *
+ *    ShmRingReader reader;
+ *    char          frame[SHM_MAX_FRAME_LENGTH];
+ *
+ *    if (!reader.attach("rpmo")) ...
+ *    while (true) {
+ *      int length = reader.next(frame, sizeof(frame));
+ *      if (length < 0) break;            // Capture has ended
+ *      if (length == 0) { usleep(100); continue; }
+ *      ... frame[0..length-1], reader.lost_frames() ...
+ *    }
+ *
+ *  next() never blocks, readers wanting the lowest latency poll it.
+ */
+
+#ifndef EVHANDL_SHM_READER_H
+#define EVHANDL_SHM_READER_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+
+#include "evhandl_shm_ring.h"
+
+// Largest frame, 65535 data words and the header
+const size_t  SHM_MAX_FRAME_LENGTH = 4 + 2 * 65535;
+
+class ShmRingReader {
+public:
+  ShmRingReader()
+    : header(NULL), data(NULL), mapSize(0), readPos(0), nextSequence(0),
+      synced(false), lostFrames(0)
+  {
+  }
+
+  ~ShmRingReader() { detach(); }
+
+  // Attach to the ring of a running capture. Reading starts with the
+  // next frame published. Returns false with errno set on failure.
+  bool attach(const std::string& name)
+  {
+    std::string  path = "/" + name;
+    struct stat  st;
+    int          fd = shm_open(path.c_str(), O_RDONLY, 0);
+
+    if (fd < 0) {
+      return false;
+    }
+    if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < SHM_RING_HEADER_SIZE)) {
+      ::close(fd);
+      errno = EINVAL;
+      return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+      return false;
+    }
+
+    header = static_cast<ShmRingHeader*>(map);
+    if ((header->magic != SHM_RING_MAGIC) ||
+        (header->headerSize + header->dataSize != (uint64_t)st.st_size)) {
+      munmap(map, st.st_size);
+      header = NULL;
+      errno  = EINVAL;
+      return false;
+    }
+    mapSize = st.st_size;
+    data    = static_cast<char*>(map) + header->headerSize;
+    readPos = header->writePos.load(std::memory_order_acquire);
+    synced  = false;
+    return true;
+  }
+
+  void detach()
+  {
+    if (header != NULL) {
+      munmap(header, mapSize);
+      header = NULL;
+    }
+  }
+
+  // Copy the next frame to buffer. Returns the frame length, 0 if there
+  // is no new frame and -1 when the capture has ended and all frames
+  // have been read. Frames longer than capacity are skipped and counted
+  // as lost.
+  int next(char *buffer, size_t capacity)
+  {
+    const uint64_t size = header->dataSize;
+
+    while (true) {
+      uint64_t write_pos = header->writePos.load(std::memory_order_acquire);
+
+      if (readPos == write_pos) {
+        if (header->closed.load(std::memory_order_acquire) &&
+            (readPos == header->writePos.load(std::memory_order_acquire))) {
+          return -1;
+        }
+        return 0;
+      }
+      if (write_pos - readPos > size) {
+        // Overrun, continue with the newest frame
+        readPos = write_pos;
+        continue;
+      }
+
+      size_t          offset = readPos & (size - 1);
+      ShmRecordHeader record;
+      size_t          length;
+
+      memcpy(&record, data + offset, sizeof(record));
+      if (record.length == SHM_RECORD_PADDING) {
+        length = size - offset - sizeof(record);
+      }
+      else {
+        length = record.length;
+        if ((length <= capacity) &&
+            (offset + shm_record_size(length) <= size)) {
+          memcpy(buffer, data + offset + sizeof(record), length);
+        }
+      }
+
+      // The record is valid only if the writer did not start to
+      // overwrite it while it was copied
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (header->reservePos.load(std::memory_order_relaxed) - readPos >
+          size) {
+        readPos = header->writePos.load(std::memory_order_acquire);
+        continue;
+      }
+
+      if (record.length == SHM_RECORD_PADDING) {
+        readPos += size - offset;
+        continue;
+      }
+      readPos += shm_record_size(length);
+
+      if (synced && (record.sequence != nextSequence)) {
+        lostFrames += record.sequence - nextSequence;
+      }
+      nextSequence = record.sequence + 1;
+      synced       = true;
+
+      if (length > capacity) {
+        lostFrames++;
+        continue;
+      }
+      return length;
+    }
+  }
+
+  // Frames overwritten before they could be read
+  uint64_t lost_frames() const { return lostFrames; }
+
+private:
+  ShmRingHeader  *header;
+  const char     *data;
+  size_t          mapSize;
+  uint64_t        readPos;
+  uint64_t        nextSequence;
+  bool            synced;        // nextSequence is known
+  uint64_t        lostFrames;
+};
+
+#endif // EVHANDL_SHM_READER_H
@@ -0,0 +1,112 @@
+/*
+ *
+ * NAME: evhandl_shm_ring.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Shared memory ring in /dev/shm publishing the received frames to
+ *  local readers. There is one writer, the receive thread, and any
+ *  number of readers, each keeping its own read position. The writer
+ *  never waits for the readers, it overwrites the oldest frames.
+ *
+ *  The ring starts with a header page followed by the data area. Each
+ *  frame is stored as a record, a 16 octet record header followed by the
+ *  frame as received from the BSC, padded to 16 octets. Records do not
+ *  wrap, the end of the data area is filled with a padding record
+ *  instead.
+ *
+ *  Before writing a record the writer announces the end of it in
+ *  reservePos, and when the record is complete it is published in
+ *  writePos. A reader copies a record and then checks reservePos to see
+ *  if the record was overwritten meanwhile. Each frame has a sequence
+ *  number, so a reader that has been overrun knows how many frames it
+ *  missed.
+ *
+ *  Readers use evhandl_shm_reader.h, which only depends on this file.
+ */
+
+#ifndef EVHANDL_SHM_RING_H
+#define EVHANDL_SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// "EHR1"
+const uint32_t  SHM_RING_MAGIC = 0x31524845;
+
+// Size of the header page, the data area follows it
+const size_t  SHM_RING_HEADER_SIZE = 4096;
+
+// Size of the data area, a power of two
+const size_t  SHM_RING_DATA_SIZE = 64 * 1024 * 1024;
+
+// Records start at multiples of this
+const size_t  SHM_RECORD_ALIGNMENT = 16;
+
+// Record length of the padding record at the end of the data area
+const uint32_t  SHM_RECORD_PADDING = 0xFFFFFFFF;
+
+struct ShmRingHeader {
+  uint32_t               magic;
+  uint32_t               headerSize;
+  uint64_t               dataSize;
+  uint32_t               writerPid;
+  std::atomic<uint32_t>  closed;       // Set when the writer has stopped
+  char                   pad0[40];
+  std::atomic<uint64_t>  reservePos;   // End of the record being written
+  std::atomic<uint64_t>  writePos;     // End of the last complete record
+  std::atomic<uint64_t>  frames;       // Sequence number of the next frame
+};
+
+struct ShmRecordHeader {
+  uint64_t  sequence;   // Frame sequence number, starting at 0
+  uint32_t  length;     // Frame length or SHM_RECORD_PADDING
+  uint32_t  spare;
+};
+
+// Octets used by a record holding a frame of the given length
+inline size_t shm_record_size(size_t frame_length)
+{
+  return (sizeof(ShmRecordHeader) + frame_length + SHM_RECORD_ALIGNMENT - 1) &
+         ~(SHM_RECORD_ALIGNMENT - 1);
+}
+
+class ShmRingWriter {
+public:
+  ShmRingWriter();
+  ~ShmRingWriter();
+
+  // Create /dev/shm/<name>, replacing a ring left by an earlier run.
+  // Returns false with errno set on failure.
+  bool open(const std::string& name);
+
+  // Publish a frame. Called by the receive thread, never blocks.
+  void publish(const char *frame, size_t length);
+
+  // Mark the ring as closed and remove the name. Attached readers keep
+  // their mapping until they detach.
+  void close();
+
+  // Number of frames published
+  uint64_t frames() const;
+
+private:
+  std::string     name;
+  ShmRingHeader  *header;
+  char           *data;
+  size_t          mapSize;
+};
+
+#endif // EVHANDL_SHM_RING_H
@@ -0,0 +1,99 @@
+/*
+ *
+ * NAME: evhandl_socket_monitor.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Tuning and monitoring of the BSC socket, to tell whether the client
+ *  keeps up with the BSC. Data queued in the socket has arrived but not
+ *  yet been read by the client. When the queue fills the receive buffer
+ *  the advertised TCP window closes and the BSC can not send, i.e.
+ *  events pile up in the BSC until it reports High load.
+ *
+ *  The window itself is not reported by TCP_INFO on all kernels, so a
+ *  closed window is taken to be a receive queue leaving less than one
+ *  segment of the receive buffer free.
+ */
+
+#ifndef EVHANDL_SOCKET_MONITOR_H
+#define EVHANDL_SOCKET_MONITOR_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Selectable socket tuning profiles
+struct Tuning {
+  enum { none, throughput, latency };
+};
+
+// Receive buffer set by the tuning profiles
+const int  TUNED_RECEIVE_BUFFER = 16 * 1024 * 1024;
+
+// Time to busy poll the device queue for data, used by the latency
+// profile, in microseconds
+const int  TUNED_BUSY_POLL_US = 50;
+
+// Set the socket options of a tuning profile. Called before connecting,
+// as the TCP window scale is decided by the receive buffer at that time.
+// Options that can not be set are noted and skipped.
+void tune_socket(int socket_fd, int profile);
+
+class SocketMonitor {
+public:
+  // quick_ack re-enables TCP_QUICKACK at every sample, as the kernel
+  // turns it off again on its own
+  SocketMonitor(int socket_fd, bool quick_ack);
+
+  // Sample the receive queue and TCP_INFO, called once a second by one
+  // thread
+  void sample();
+
+  // Octets queued in the socket at the last sample, and the max so far
+  uint32_t queued_bytes() const
+  {
+    return queuedBytes.load(std::memory_order_relaxed);
+  }
+  uint32_t max_queued_bytes() const
+  {
+    return maxQueuedBytes.load(std::memory_order_relaxed);
+  }
+
+  // Number of samples when the receive window was closed
+  uint64_t zero_windows() const
+  {
+    return zeroWindows.load(std::memory_order_relaxed);
+  }
+
+  // Smoothed round trip time in microseconds
+  uint32_t rtt_us() const
+  {
+    return rttUs.load(std::memory_order_relaxed);
+  }
+
+  // Receive buffer of the socket in octets, as reported by the kernel
+  uint32_t receive_buffer() const
+  {
+    return receiveBuffer.load(std::memory_order_relaxed);
+  }
+
+private:
+  int                    socketFd;
+  bool                   quickAck;
+  std::atomic<uint32_t>  queuedBytes;
+  std::atomic<uint32_t>  maxQueuedBytes;
+  std::atomic<uint64_t>  zeroWindows;
+  std::atomic<uint32_t>  rttUs;
+  std::atomic<uint32_t>  receiveBuffer;
+};
+
+#endif // EVHANDL_SOCKET_MONITOR_H
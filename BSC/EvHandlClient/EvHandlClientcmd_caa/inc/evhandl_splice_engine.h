@@ -0,0 +1,76 @@
+/*
+ *
+ * NAME: evhandl_splice_engine.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Raw capture engine moving the event stream from the socket to the
+ *  file with splice() through a pipe, i.e. the event data is never
+ *  copied to user space. Only the four octet header of each frame is
+ *  peeked at, to keep track of the frame boundaries for the event
+ *  counter and the max file size check.
+ *
+ *  Since the header of every frame has to be peeked at, the engine pays
+ *  off for streams of large frames. For streams of many small frames
+ *  the default engine needs fewer system calls.
+ */
+
+#ifndef EVHANDL_SPLICE_ENGINE_H
+#define EVHANDL_SPLICE_ENGINE_H
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "evhandl_capture_engine.h"
+
+class SpliceEngine : public CaptureEngine {
+public:
+  SpliceEngine();
+  virtual ~SpliceEngine();
+
+  // Create the pipe. Returns 0 when successful, otherwise the errno
+  // telling why the engine can not be used.
+  int init(int max_data_length);
+
+  virtual int run(int socket_fd, int file_fd, const char *partial,
+                  size_t partial_length, CaptureState& state);
+
+  virtual uint64_t syscalls() const { return receiveCalls; }
+
+private:
+  // Peek at the next frame header. Returns false on end of stream.
+  bool peek_header(char *header);
+
+  // Move octets from the pipe to the file
+  void drain_pipe(size_t octets);
+
+  // Write octets read into user space to the pipe
+  void fill_pipe(const char *data, size_t length);
+
+  // Complete the header of a frame partly read before the engine took
+  // over the socket. Returns false on end of stream.
+  bool receive_header(char *header, size_t received);
+
+  int       pipeFds[2];
+  size_t    pipeSize;
+  size_t    pipeFill;     // Octets in the pipe
+  size_t    pipeComplete; // Octets in the pipe belonging to complete frames
+  int       maxFrameLength;
+  int       socketFd;
+  int       fileFd;
+  loff_t    fileOffset;
+  uint64_t  receiveCalls;
+};
+
+#endif // EVHANDL_SPLICE_ENGINE_H
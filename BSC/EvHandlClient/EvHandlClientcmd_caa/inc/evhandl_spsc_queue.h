@@ -0,0 +1,85 @@
+/*
+ *
+ * NAME: evhandl_spsc_queue.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Bounded lock-free queue for exactly one producer thread and exactly
+ *  one consumer thread.
+ */
+
+#ifndef EVHANDL_SPSC_QUEUE_H
+#define EVHANDL_SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+template <typename T>
+class SpscQueue {
+public:
+  // The capacity is rounded up to the nearest power of two
+  explicit SpscQueue(size_t capacity)
+    : head(0), tail(0)
+  {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots.resize(size);
+    mask = size - 1;
+  }
+
+  // Called by the producer only. Returns false if the queue is full.
+  bool push(const T& item)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) > mask) {
+      return false;
+    }
+    slots[t & mask] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Called by the consumer only. Returns false if the queue is empty.
+  bool pop(T& item)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = slots[h & mask];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate number of queued items, may be called from any thread
+  size_t size() const
+  {
+    return tail.load(std::memory_order_acquire) -
+           head.load(std::memory_order_acquire);
+  }
+
+private:
+  std::vector<T>       slots;
+  size_t               mask;
+  // Keep the consumer and producer indexes on separate cache lines
+  char                 pad0[64];
+  std::atomic<size_t>  head;
+  char                 pad1[64];
+  std::atomic<size_t>  tail;
+  char                 pad2[64];
+};
+
+#endif // EVHANDL_SPSC_QUEUE_H
@@ -0,0 +1,61 @@
+/*
+ *
+ * NAME: evhandl_thread_tuning.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  CPU pinning, scheduling policy and I/O priority of the capture
+ *  threads, so that the receive loop does not migrate between cores and
+ *  the capture can be kept from starving the AP services.
+ *
+ *  The settings are applied by each thread to itself when it starts, as
+ *  the nice value and the I/O priority are per thread in Linux. Settings
+ *  needing a privilege (CAP_SYS_NICE, or CAP_SYS_ADMIN for real time I/O
+ *  priority) the process does not have are noted and skipped, i.e. the
+ *  capture runs as before.
+ */
+
+#ifndef EVHANDL_THREAD_TUNING_H
+#define EVHANDL_THREAD_TUNING_H
+
+// Nice value and I/O priority of a thread not changed
+const int  NICE_UNCHANGED   = 100;
+const int  IOPRIO_UNCHANGED = -1;
+
+struct ThreadTuning {
+  int  cpu;       // CPU to run on, -1 if not pinned
+  int  policy;    // SCHED_FIFO or SCHED_RR, SCHED_OTHER if not changed
+  int  priority;  // Real time priority with SCHED_FIFO and SCHED_RR
+  int  nice;      // Nice value with SCHED_OTHER
+  int  ioprio;    // I/O priority as given to ioprio_set()
+};
+
+extern const ThreadTuning  NO_THREAD_TUNING;
+
+// Apply the settings to the calling thread. name is the thread as shown
+// in notes, e.g. "writer".
+void tune_thread(const ThreadTuning& tuning, const char *name);
+
+// Parse the CPUs of --pin, <cpu>,<cpu>,... with - for a thread not
+// pinned. Fewer than count CPUs may be given. Returns false if invalid.
+bool parse_cpu_list(const char *value, int cpus[], int count);
+
+// Parse --sched, fifo:<priority>, rr:<priority> or nice:<value>, into
+// tuning. Returns false if invalid.
+bool parse_sched(const char *value, ThreadTuning& tuning);
+
+// Parse --ioprio, rt:<level>, be:<level> or idle, into an I/O priority.
+// Returns false if invalid.
+bool parse_ioprio(const char *value, int& ioprio);
+
+#endif // EVHANDL_THREAD_TUNING_H
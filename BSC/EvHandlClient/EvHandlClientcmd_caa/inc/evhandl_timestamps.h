@@ -0,0 +1,42 @@
+/*
+ *
+ * NAME: evhandl_timestamps.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Layout of the side-car file written with --timestamps, giving the
+ *  arrival time of each frame written to the log file. The file starts
+ *  with TIMESTAMP_FILE_MAGIC followed by one record per frame, in the
+ *  order the frames were written. Records are in the byte order of the
+ *  host running the client.
+ *
+ *  The offset is the position of the frame in the raw frame stream,
+ *  i.e. in the log file itself unless compressed, in v2 format or
+ *  split into segments, where it is the position in the file given by
+ *  decompress or by concatenating the segments. The connect request and
+ *  reply have no record.
+ */
+
+#ifndef EVHANDL_TIMESTAMPS_H
+#define EVHANDL_TIMESTAMPS_H
+
+#include <stdint.h>
+
+const char      TIMESTAMP_FILE_MAGIC[8] = { 'E', 'V', 'H', 'T', 'S', '0', '1', '\n' };
+
+struct TimestampRecord {
+  uint64_t  offset;         // Of the frame in the raw frame stream
+  uint64_t  receiveTimeNs;  // Arrival time, ns since the epoch
+};
+
+#endif // EVHANDL_TIMESTAMPS_H
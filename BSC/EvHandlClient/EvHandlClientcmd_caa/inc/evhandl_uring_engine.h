@@ -0,0 +1,111 @@
+/*
+ *
+ * NAME: evhandl_uring_engine.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Capture engine based on Linux io_uring. The socket is read directly
+ *  into registered blocks and completed blocks are written to the file
+ *  from the same registered memory, so the data is never copied in user
+ *  space. File writes are submitted together with the next receive,
+ *  i.e. a single io_uring_enter() call both hands over the written
+ *  blocks and waits for more event data.
+ */
+
+#ifndef EVHANDL_URING_ENGINE_H
+#define EVHANDL_URING_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "evhandl_capture_engine.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+class UringEngine : public CaptureEngine {
+public:
+  UringEngine();
+  virtual ~UringEngine();
+
+  // Set up the ring and register the block memory. Returns 0 when
+  // successful, otherwise the errno telling why io_uring can not be used.
+  int init(int max_data_length);
+
+  virtual int run(int socket_fd, int file_fd, const char *partial,
+                  size_t partial_length, CaptureState& state);
+
+  virtual uint64_t syscalls() const { return enterCalls; }
+
+private:
+  struct Block {
+    char     *data;
+    int       index;          // Index among the registered buffers
+    size_t    fill;           // End of received data
+    size_t    parsed;         // End of the last complete frame
+    size_t    written;        // End of data queued for writing
+    int       pendingWrites;  // Writes not yet completed
+    bool      retired;        // No longer receiving, free when written
+  };
+
+  struct WriteRequest {
+    Block    *block;
+    size_t    start;
+    size_t    length;
+    uint64_t  offset;         // Offset in the file
+  };
+
+  io_uring_sqe* get_sqe();
+  void queue_receive();
+  void queue_write(Block *block, size_t start, size_t length, uint64_t offset);
+  void queue_block_write(Block *block);
+  void submit_and_wait(unsigned min_complete);
+  void reap_completions();
+  void parse_frames(CaptureState& state);
+  void next_block();
+
+  int        ringFd;
+  unsigned   sqEntries;
+  void      *sqRing;
+  size_t     sqRingSize;
+  void      *cqRing;
+  size_t     cqRingSize;
+  io_uring_sqe *sqes;
+  size_t     sqesSize;
+  unsigned  *sqHead;
+  unsigned  *sqTail;
+  unsigned  *sqMask;
+  unsigned  *sqArray;
+  unsigned  *cqHead;
+  unsigned  *cqTail;
+  unsigned  *cqMask;
+  io_uring_cqe *cqes;
+  unsigned   queued;          // SQEs queued but not yet submitted
+
+  int        socketFd;
+  int        fileFd;
+  int        maxFrameLength;
+  std::vector<Block>         blocks;
+  std::vector<Block*>        freeBlocks;
+  std::vector<WriteRequest>  writeRequests;
+  std::vector<WriteRequest*> freeRequests;
+  Block     *current;
+  uint64_t   fileOffset;
+  bool       receivePending;
+  int        receiveResult;
+  int        pendingWrites;
+  uint64_t   enterCalls;
+};
+
+#endif // EVHANDL_URING_ENGINE_H
@@ -0,0 +1,160 @@
+/*
+ *
+ * NAME: evhandl_watchlist.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Watchlist of subscribers, matched against the MS identities carried
+ *  in the received event frames.
+ *
+ *  The watchlist file has one IMSI (14 or 15 digits) or TLLI (up to 10
+ *  digits, decimal) per line, empty lines and lines starting with '#'
+ *  are ignored. Each identity is encoded as in the GMLog IWD, see
+ *  assemble_imsi() and assemble_tlli(), and stored in a hash set keyed
+ *  on the encoded octets. A frame is matched by looking for those
+ *  octets in it:
+ *
+ *  - IMSI: a data word holding the IMSI length (8) followed by 4 data
+ *    words of BCD digits with identity type IMSI in the low bits of
+ *    the second octet. Those 8 octets are looked up, the filler nibble
+ *    of an even length IMSI is not compared.
+ *  - TLLI: every 4 octets starting at a data word after the Event ID
+ *    are looked up, only done if the watchlist has TLLIs.
+ *
+ *  The hash sets use open addressing with a load factor of at most 1/2,
+ *  so a lookup is a hash and normally one or two probes whatever the
+ *  size of the watchlist. Large watchlists are fronted by a Bloom filter
+ *  which is small enough to stay in the CPU cache, most lookups of
+ *  identities not in the watchlist then never touch the hash set.
+ */
+
+#ifndef EVHANDL_WATCHLIST_H
+#define EVHANDL_WATCHLIST_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "evhandl_block_writer.h"
+#include "evhandl_output_file.h"
+
+// Max number of identities in a watchlist
+const uint32_t  MAX_WATCHLIST_SIZE = 1000000;
+
+// Watchlists larger than this are fronted by a Bloom filter
+const uint32_t  WATCHLIST_BLOOM_THRESHOLD = 4096;
+
+// Hash set of encoded identities, see evhandl_watchlist.cpp
+class IdentitySet {
+public:
+  IdentitySet();
+
+  // Size the set for the given number of identities, must be called
+  // before insert()
+  void reserve(uint32_t identities);
+
+  // Returns false if the key is already in the set
+  bool insert(uint64_t key, int32_t index);
+
+  // Index of the key, or -1 if not in the set
+  int32_t find(uint64_t key) const;
+
+  uint32_t size() const { return count; }
+
+private:
+  std::vector<uint64_t>  keys;
+  std::vector<int32_t>   indexes;     // -1 for a free slot
+  uint64_t               mask;
+  uint32_t               count;
+  std::vector<uint64_t>  bloom;       // Empty when not used
+  uint64_t               bloomMask;   // In bits
+};
+
+class Watchlist {
+public:
+  Watchlist();
+
+  // Load a watchlist file. Returns false with a description of the
+  // error if the file can not be read or has an invalid line.
+  bool load(const std::string& name, std::string& error);
+
+  // Index of the first watched identity found in an event frame, or -1
+  int32_t match(const char *frame) const;
+
+  // The identity as given in the watchlist file
+  const std::string& identity(int32_t index) const { return identities[index]; }
+
+  uint32_t size() const { return identities.size(); }
+  uint32_t imsi_count() const { return imsis.size(); }
+  uint32_t tlli_count() const { return tllis.size(); }
+
+private:
+  std::vector<std::string>  identities;
+  IdentitySet               imsis;
+  IdentitySet               tllis;
+};
+
+// Writes the events of each watched identity to a file of its own,
+// named as the log file with the identity inserted before the suffix.
+// The files are opened when the first event of the identity is seen.
+// A file that can not be opened, e.g. when out of descriptors, is
+// reported to the caller, which is to stop the capture.
+// Frames are collected per identity and handed to the block writer
+// when a block is full and at each flush, so only one block is held at
+// a time whatever the number of identities.
+class WatchlistFiles {
+public:
+  WatchlistFiles(const Watchlist& list, BlockWriter& block_writer,
+                 const std::string& log_file_name, uint64_t max_file_size);
+  ~WatchlistFiles();
+
+  // Add a frame matching the identity. Returns false with errno set if
+  // the file of the identity could not be opened, see file_name().
+  bool append(int32_t index, const char *frame, size_t length);
+
+  // Name of the file of an identity, set once its opening was tried
+  const std::string& file_name(int32_t index) const
+  {
+    return entries[index].name;
+  }
+
+  // Hand everything collected to the writer, letting it flush the files
+  void flush();
+
+  // Hand everything collected to the writer and let it close the files.
+  // Must be called before stopping the writer.
+  void close();
+
+  // Number of files opened
+  uint32_t files() const { return openFiles; }
+
+private:
+  struct IdentityFile {
+    OutputFile  *file;      // NULL until the first event
+    std::string  name;
+    std::string  pending;   // Frames not yet handed to the writer
+  };
+
+  bool open_file(IdentityFile& entry, int32_t index);
+  void submit(IdentityFile& entry, bool close_after);
+
+  const Watchlist&           watchlist;
+  BlockWriter&               writer;
+  std::string                logFileName;
+  uint64_t                   maxFileSize;
+  std::vector<IdentityFile>  entries;
+  std::vector<int32_t>       dirty;     // Entries with pending frames
+  uint32_t                   openFiles;
+};
+
+#endif // EVHANDL_WATCHLIST_H
@@ -0,0 +1,116 @@
+/*
+ *
+ * NAME: evhandl_writeback.h
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Background durability policy of the log file. Left alone, the kernel
+ *  lets gigabytes of dirty log file pages build up and then writes them
+ *  all at once, stalling the writer thread and filling the page cache
+ *  with data that is never read again.
+ *
+ *  With a writeback window, the write back of each window of the file
+ *  is started with sync_file_range() as soon as the window has been
+ *  written. Before that, the writer waits for the window before it to
+ *  reach the disk and drops it from the page cache with
+ *  posix_fadvise(POSIX_FADV_DONTNEED). At most two windows are then dirty
+ *  at any time.
+ *
+ *  With a sync interval, a thread of its own calls fdatasync() on the
+ *  file periodically, i.e. bounds the amount of data lost on a power
+ *  failure without the writer thread ever waiting for it.
+ */
+
+#ifndef EVHANDL_WRITEBACK_H
+#define EVHANDL_WRITEBACK_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#include "evhandl_metrics.h"
+#include "evhandl_output_file.h"
+
+// Max writeback window, in MB
+const uint32_t  MAX_WRITEBACK_WINDOW_MB = 1024;
+
+class Writeback {
+public:
+  // window_size is the size of the writeback windows in octets, 0 for
+  // none. sync_interval_sec is the time between fdatasync() calls, 0
+  // for none.
+  Writeback(uint64_t window_size, uint32_t sync_interval_sec);
+  ~Writeback();
+
+  // Start the fdatasync thread, if any
+  void start();
+
+  // Stop the fdatasync thread, waiting for an ongoing fdatasync()
+  void stop();
+
+  uint64_t window_size() const { return windowSize; }
+
+  // Time waiting for a window to be written back, and of the fdatasync()
+  // calls
+  const LatencyHistogram& wait_latency() const { return waitLatency; }
+  const LatencyHistogram& sync_latency() const { return syncLatency; }
+
+private:
+  friend class WritebackOutputFile;
+
+  // Set the file synced by the fdatasync thread, -1 for none
+  void set_sync_fd(int fd);
+
+  // Wait for a window to be written back, and drop it from the page
+  // cache. Called by the writer thread.
+  void wait_for_window(int fd, uint64_t offset);
+
+  static void* sync_thread(void *pParams);
+  void run();
+
+  uint64_t           windowSize;
+  uint32_t           syncInterval;  // Seconds
+  pthread_mutex_t    mutex;
+  int                syncFd;        // Protected by mutex
+  pthread_t          thread;
+  bool               started;
+  std::atomic<bool>  done;
+  LatencyHistogram   waitLatency;
+  LatencyHistogram   syncLatency;
+};
+
+// File written with the policy of a Writeback. The written octets are
+// passed on to another file, e.g. a StreamOutputFile, while the policy
+// is applied through a descriptor of its own to the same file.
+class WritebackOutputFile : public OutputFile {
+public:
+  // Takes over the ownership of file
+  WritebackOutputFile(OutputFile *file, Writeback& writeback);
+  virtual ~WritebackOutputFile();
+
+  virtual bool open(const std::string& name);
+  virtual void set_capture_time(uint64_t first_ms, uint64_t last_ms);
+  virtual bool write(const char *data, size_t length);
+  virtual bool flush();
+  virtual bool close();
+
+private:
+  OutputFile  *file;
+  Writeback&   writeback;
+  int          fd;
+  uint64_t     written;      // Octets written to the file
+  uint64_t     kicked;       // Octets whose write back has been started
+};
+
+#endif // EVHANDL_WRITEBACK_H
@@ -0,0 +1,314 @@
+/*
+ *
+ * NAME: evhandl_analyze.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Parallel analysis of a raw log file, see evhandl_analyze.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "evhandl_analyze.h"
+#include "evhandl_frame.h"
+
+using namespace std;
+
+
+// Chunks are not made smaller than this, small files use fewer threads
+const uint64_t  MIN_ANALYZE_CHUNK_SIZE = 16 * 1024 * 1024;
+
+// Number of consecutive plausible headers needed to guess a frame
+// boundary
+const int       SYNC_CHAIN_LENGTH = 16;
+
+struct ChunkStats {
+  const char               *base;
+  uint64_t                  size;        // Of the whole file
+  int                       maxDataLength;
+  uint64_t                  from;        // Chunk, frames starting in
+  uint64_t                  to;          // [from, to) belong to it
+  uint64_t                  start;       // First frame parsed
+  uint64_t                  end;         // First octet not parsed
+  bool                      invalid;     // Stopped at an invalid header
+  uint64_t                  truncatedBytes;
+  FrameCount                total;
+  map<int, FrameCount>      channels;
+  vector<FrameCount>        events;
+  map<pair<int, int>, uint64_t> controlMessages;
+};
+
+// A header that can be trusted when guessing a frame boundary. Control
+// and event frames are the only ones sent by the BSC, and empty frames
+// are skipped as a run of zeroes would look like a chain of them.
+static bool plausible_header(const char *header, int max_data_length)
+{
+  int channel = frame_channel(header);
+  int length  = frame_data_length(header);
+
+  return (((channel == CONTROL_CHANNEL) || (channel == EVENT_CHANNEL)) &&
+          (length > 0) && (length <= max_data_length));
+}
+
+//===============================================================================
+//      Guess the first frame boundary at or after from. Frames always
+//      have an even length, i.e. start at even offsets.
+//
+//===============================================================================
+static uint64_t find_frame_boundary(const ChunkStats& chunk)
+{
+  for (uint64_t pos = chunk.from; pos < chunk.to; pos += 2) {
+    uint64_t next = pos;
+    int      n;
+
+    for (n = 0; n < SYNC_CHAIN_LENGTH; n++) {
+      if (next == chunk.size) {
+        break;  // The chain ends exactly at the end of the file
+      }
+      if ((next + FRAME_HEADER_LENGTH > chunk.size) ||
+          !plausible_header(chunk.base + next, chunk.maxDataLength)) {
+        break;
+      }
+      next += FRAME_HEADER_LENGTH + frame_data_length(chunk.base + next);
+      if (next > chunk.size) {
+        break;
+      }
+    }
+    if ((n == SYNC_CHAIN_LENGTH) || (next == chunk.size)) {
+      return pos;
+    }
+  }
+  return chunk.to;
+}
+
+//===============================================================================
+//      Parse the frames starting in [start, to)
+//
+//===============================================================================
+static void parse_chunk(ChunkStats& chunk, uint64_t start)
+{
+  uint64_t pos = start;
+
+  chunk.start          = start;
+  chunk.invalid        = false;
+  chunk.truncatedBytes = 0;
+  chunk.total.frames   = 0;
+  chunk.total.bytes    = 0;
+  chunk.channels.clear();
+  chunk.controlMessages.clear();
+  chunk.events.assign(EVENT_ID_COUNT, FrameCount());
+
+  while (pos < chunk.to) {
+    const char *frame = chunk.base + pos;
+
+    if (pos + FRAME_HEADER_LENGTH > chunk.size) {
+      chunk.truncatedBytes = chunk.size - pos;
+      pos = chunk.size;
+      break;
+    }
+
+    int data_length = frame_data_length(frame);
+    int channel     = frame_channel(frame);
+
+    if (data_length > chunk.maxDataLength) {
+      chunk.invalid = true;
+      break;
+    }
+
+    uint64_t length = FRAME_HEADER_LENGTH + data_length;
+    if (pos + length > chunk.size) {
+      chunk.truncatedBytes = chunk.size - pos;
+      pos = chunk.size;
+      break;
+    }
+
+    chunk.total.frames++;
+    chunk.total.bytes += length;
+
+    FrameCount& per_channel = chunk.channels[channel];
+    per_channel.frames++;
+    per_channel.bytes += length;
+
+    if ((channel == EVENT_CHANNEL) && (data_length >= 2)) {
+      FrameCount& per_event = chunk.events[frame_event_id(frame)];
+      per_event.frames++;
+      per_event.bytes += length;
+    }
+    else if ((channel == CONTROL_CHANNEL) && (data_length >= 2)) {
+      int cmn    = (unsigned char)frame[4] * 256 + (unsigned char)frame[5];
+      int result = -1;
+
+      if (data_length >= 4) {
+        result = (unsigned char)frame[6] * 256 + (unsigned char)frame[7];
+      }
+      chunk.controlMessages[make_pair(cmn, result)]++;
+    }
+    pos += length;
+  }
+  chunk.end = pos;
+}
+
+static void* analyze_thread(void *pParams)
+{
+  ChunkStats& chunk = *static_cast<ChunkStats*>(pParams);
+
+  madvise((void *)((uintptr_t)(chunk.base + chunk.from) & ~(uintptr_t)4095),
+          chunk.to - chunk.from + 4096, MADV_WILLNEED);
+
+  uint64_t start = (chunk.from == 0) ? 0 : find_frame_boundary(chunk);
+  parse_chunk(chunk, start);
+
+  return NULL;
+}
+
+static void add_count(FrameCount& to, const FrameCount& from)
+{
+  to.frames += from.frames;
+  to.bytes  += from.bytes;
+}
+
+//===============================================================================
+//      Analyze a raw log file on several threads
+//
+//===============================================================================
+bool analyze_file(const string& name, int max_data_length, uint32_t threads,
+                  AnalyzeResult& result)
+{
+  struct stat st;
+  int         fd = open(name.c_str(), O_RDONLY);
+
+  if (fd < 0) {
+    return false;
+  }
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return false;
+  }
+
+  result.fileSize       = st.st_size;
+  result.reparsedChunks = 0;
+  result.total.frames   = 0;
+  result.total.bytes    = 0;
+  result.channels.clear();
+  result.controlMessages.clear();
+  result.events.assign(EVENT_ID_COUNT, FrameCount());
+  result.invalidOffset  = result.fileSize;
+  result.truncatedBytes = 0;
+
+  if (result.fileSize == 0) {
+    close(fd);
+    result.threads = 0;
+    return true;
+  }
+
+  const char *base = (const char *)mmap(NULL, result.fileSize, PROT_READ,
+                                        MAP_SHARED, fd, 0);
+  int error = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    errno = error;
+    return false;
+  }
+  madvise((void *)base, result.fileSize, MADV_SEQUENTIAL);
+
+  // One chunk per thread, but not smaller than the minimum chunk size
+  uint64_t max_chunks = (result.fileSize + MIN_ANALYZE_CHUNK_SIZE - 1) /
+                        MIN_ANALYZE_CHUNK_SIZE;
+  if (threads > MAX_ANALYZE_THREADS) {
+    threads = MAX_ANALYZE_THREADS;
+  }
+  if ((threads == 0) || (threads > max_chunks)) {
+    threads = (max_chunks < MAX_ANALYZE_THREADS) ? max_chunks :
+                                                    MAX_ANALYZE_THREADS;
+  }
+  result.threads = threads;
+
+  // Chunk boundaries are even, like the frame boundaries
+  vector<ChunkStats> chunks(threads);
+  vector<pthread_t>  thread_ids(threads);
+  uint64_t           chunk_size = (result.fileSize / threads) & ~1ULL;
+
+  for (uint32_t n = 0; n < threads; n++) {
+    chunks[n].base          = base;
+    chunks[n].size          = result.fileSize;
+    chunks[n].maxDataLength = max_data_length;
+    chunks[n].from          = n * chunk_size;
+    chunks[n].to            = (n + 1 == threads) ? result.fileSize :
+                                                   (n + 1) * chunk_size;
+  }
+
+  // The first chunk is parsed by this thread
+  for (uint32_t n = 1; n < threads; n++) {
+    if (pthread_create(&thread_ids[n], NULL, &analyze_thread,
+                       &chunks[n]) != 0) {
+      // Parsed below instead
+      chunks[n].start = UINT64_MAX;
+      thread_ids[n]   = 0;
+    }
+  }
+  analyze_thread(&chunks[0]);
+  for (uint32_t n = 1; n < threads; n++) {
+    if (thread_ids[n] != 0) {
+      pthread_join(thread_ids[n], NULL);
+    }
+  }
+
+  // Each chunk must start where the previous one ended
+  uint64_t expected = 0;
+  for (uint32_t n = 0; n < threads; n++) {
+    ChunkStats& chunk = chunks[n];
+
+    if (expected >= chunk.to) {
+      // The previous chunk ended with a frame covering this chunk
+      continue;
+    }
+    if (chunk.start != expected) {
+      parse_chunk(chunk, expected);
+      result.reparsedChunks++;
+    }
+
+    add_count(result.total, chunk.total);
+    for (map<int, FrameCount>::const_iterator it = chunk.channels.begin();
+         it != chunk.channels.end(); ++it) {
+      add_count(result.channels[it->first], it->second);
+    }
+    for (uint32_t eid = 0; eid < EVENT_ID_COUNT; eid++) {
+      add_count(result.events[eid], chunk.events[eid]);
+    }
+    for (map<pair<int, int>, uint64_t>::const_iterator it =
+           chunk.controlMessages.begin();
+         it != chunk.controlMessages.end(); ++it) {
+      result.controlMessages[it->first] += it->second;
+    }
+    result.truncatedBytes += chunk.truncatedBytes;
+
+    if (chunk.invalid) {
+      result.invalidOffset = chunk.end;
+      break;
+    }
+    expected = chunk.end;
+  }
+
+  munmap((void *)base, result.fileSize);
+  return true;
+}
@@ -0,0 +1,402 @@
+/*
+ *
+ * NAME: evhandl_block_writer.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Writer thread decoupling the receive loop from disk I/O, see
+ *  evhandl_block_writer.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "evhandl_block_writer.h"
+
+using namespace std;
+
+
+// Block memory is page aligned so the same blocks can be used for
+// direct I/O
+const size_t  BLOCK_ALIGNMENT = 4096;
+
+// Monotonic time in microseconds
+static uint64_t monotonic_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Wall clock time in nanoseconds, as the kernel receive timestamps
+static uint64_t realtime_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Wall clock time in milliseconds. The coarse clock is good enough for
+// time stamping blocks and cheap enough to read for every block.
+static uint64_t realtime_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  return (uint64_t)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+BlockWriter::BlockWriter(OutputFile& out, const string& display_name,
+                         size_t buffer_size)
+  : out(&out),
+    displayName(display_name),
+    blocks(buffer_size / WRITE_BLOCK_SIZE < 2 ?
+           2 : buffer_size / WRITE_BLOCK_SIZE),
+    filledBlocks(blocks.size()),
+    freeBlocks(blocks.size()),
+    current(NULL),
+    tuning(NO_THREAD_TUNING),
+    started(false),
+    done(false),
+    writerSleeping(false),
+    receiverSleeping(false),
+    filledWakeFd(-1),
+    freeWakeFd(-1),
+    queuedBytes(0),
+    stallTimeUs(0),
+    highWaterMark(0)
+{
+  init_blocks();
+  current = acquire(this->out, displayName.c_str());
+}
+
+BlockWriter::BlockWriter(size_t buffer_size)
+  : out(NULL),
+    blocks(buffer_size / WRITE_BLOCK_SIZE < 2 ?
+           2 : buffer_size / WRITE_BLOCK_SIZE),
+    filledBlocks(blocks.size()),
+    freeBlocks(blocks.size()),
+    current(NULL),
+    tuning(NO_THREAD_TUNING),
+    started(false),
+    done(false),
+    writerSleeping(false),
+    receiverSleeping(false),
+    filledWakeFd(-1),
+    freeWakeFd(-1),
+    queuedBytes(0),
+    stallTimeUs(0),
+    highWaterMark(0)
+{
+  init_blocks();
+}
+
+void BlockWriter::init_blocks()
+{
+  filledWakeFd = eventfd(0, EFD_CLOEXEC);
+  freeWakeFd   = eventfd(0, EFD_CLOEXEC);
+  if ((filledWakeFd < 0) || (freeWakeFd < 0)) {
+    printf("\nERROR: Failed to create the writer thread wakeup\n"
+           "Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+
+  for (size_t n = 0; n < blocks.size(); n++) {
+    void *data;
+
+    if (posix_memalign(&data, BLOCK_ALIGNMENT, WRITE_BLOCK_SIZE) != 0) {
+      printf("\nOut of memory, aborting!\n\n");
+      exit(1);
+    }
+    blocks[n].data        = (char *)data;
+    blocks[n].used        = 0;
+    blocks[n].frames      = 0;
+    blocks[n].flush       = false;
+    blocks[n].close       = false;
+    blocks[n].firstTimeMs = 0;
+    blocks[n].firstReceiveNs = 0;
+    blocks[n].lastTimeMs  = 0;
+    blocks[n].file        = NULL;
+    blocks[n].name        = NULL;
+
+    freeBlocks.push(&blocks[n]);
+  }
+}
+
+BlockWriter::~BlockWriter()
+{
+  for (size_t n = 0; n < blocks.size(); n++) {
+    free(blocks[n].data);
+  }
+  close(filledWakeFd);
+  close(freeWakeFd);
+}
+
+void BlockWriter::start(const ThreadTuning& tuning)
+{
+  this->tuning = tuning;
+  if (pthread_create(&thread, NULL, &BlockWriter::writer_thread, this) != 0) {
+    printf("\nERROR: Failed to start writer thread\n"
+           "Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+  started = true;
+}
+
+//===============================================================================
+//      Copy a frame into the current block, handing the block over to the
+//      writer thread when the frame does not fit.
+//
+//===============================================================================
+void BlockWriter::append(const char *frame, size_t length,
+                         uint64_t receive_ns)
+{
+  current = append(current, frame, length, receive_ns);
+}
+
+WriteBlock* BlockWriter::append(WriteBlock *block, const char *frame,
+                                size_t length, uint64_t receive_ns)
+{
+  if (block->used + length > WRITE_BLOCK_SIZE) {
+    OutputFile *file = block->file;
+    const char *name = block->name;
+
+    submit(block, false);
+    block = acquire(file, name);
+  }
+  if (block->frames == 0) {
+    block->firstTimeMs = realtime_ms();
+  }
+  if (block->firstReceiveNs == 0) {
+    block->firstReceiveNs = receive_ns;
+  }
+
+  memcpy(block->data + block->used, frame, length);
+  block->used += length;
+  block->frames++;
+
+  return block;
+}
+
+void BlockWriter::flush()
+{
+  submit(current, true);
+  current = acquire(out, displayName.c_str());
+}
+
+void BlockWriter::stop()
+{
+  if (current != NULL) {
+    submit(current, true);
+    current = NULL;
+  }
+  done = true;
+  wake(writerSleeping, filledWakeFd);
+
+  if (started) {
+    pthread_join(thread, NULL);
+    started = false;
+  }
+}
+
+//===============================================================================
+//      Get an empty block for a file
+//
+//===============================================================================
+WriteBlock* BlockWriter::acquire(OutputFile *file, const char *name)
+{
+  WriteBlock *block = get_free_block();
+
+  block->file = file;
+  block->name = name;
+
+  return block;
+}
+
+//===============================================================================
+//      Hand a block to the writer thread
+//
+//===============================================================================
+void BlockWriter::submit(WriteBlock *block, bool flush_after, bool close_after)
+{
+  block->flush      = flush_after;
+  block->close      = close_after;
+  block->lastTimeMs = realtime_ms();
+  if (block->frames == 0) {
+    block->firstTimeMs = block->lastTimeMs;
+  }
+
+  uint64_t queued = (queuedBytes += block->used);
+  if (queued > highWaterMark) {
+    highWaterMark = queued;
+  }
+
+  // Can not fail, the queue has room for all blocks
+  filledBlocks.push(block);
+  wake(writerSleeping, filledWakeFd);
+}
+
+//===============================================================================
+//      Get a free block, waiting for the writer thread if all blocks are
+//      queued towards the disk. The waiting time is accounted as stall
+//      time.
+//
+//===============================================================================
+WriteBlock* BlockWriter::get_free_block()
+{
+  WriteBlock *block;
+
+  if (freeBlocks.pop(block)) {
+    return block;
+  }
+
+  uint64_t stall_start = monotonic_us();
+  while (!freeBlocks.pop(block)) {
+    wait_for_free_block();
+  }
+  stallTimeUs += monotonic_us() - stall_start;
+
+  return block;
+}
+
+void* BlockWriter::writer_thread(void *pParams)
+{
+  ((BlockWriter *)pParams)->run();
+  return NULL;
+}
+
+//===============================================================================
+//      Writer thread main loop. Writes filled blocks to the file until
+//      stopped and the queue has been emptied.
+//
+//===============================================================================
+void BlockWriter::run()
+{
+  tune_thread(tuning, "writer");
+
+  while (true) {
+    // Read the done flag before checking the queue so that no block
+    // pushed before stop() can be missed
+    bool        finishing = done;
+    WriteBlock *block;
+
+    if (!filledBlocks.pop(block)) {
+      if (finishing) {
+        break;
+      }
+      wait_for_filled_block();
+      continue;
+    }
+
+    OutputFile *file = block->file;
+
+    file->set_capture_time(block->firstTimeMs, block->lastTimeMs);
+
+    uint64_t start = monotonic_ns();
+    bool     ok    = file->write(block->data, block->used);
+    uint64_t end   = monotonic_ns();
+
+    writeLatency.add(end - start);
+    if (block->firstReceiveNs != 0) {
+      uint64_t now = realtime_ns();
+
+      receiveToWrite.add((now > block->firstReceiveNs) ?
+                         now - block->firstReceiveNs : 0);
+    }
+    if (ok && block->flush) {
+      ok = file->flush();
+      flushLatency.add(monotonic_ns() - end);
+    }
+    if (ok && block->close) {
+      ok = file->close();
+    }
+
+    if (!ok) {
+      printf("\nERROR: Write operation to log file\n"
+             "%s "
+             "failed.\n"
+             "Reason: %s\n\n", block->name, strerror(errno));
+      exit(1);
+    }
+
+    queuedBytes -= block->used;
+    block->used   = 0;
+    block->frames = 0;
+    block->firstReceiveNs = 0;
+    block->flush  = false;
+    block->close  = false;
+    freeBlocks.push(block);
+    wake(receiverSleeping, freeWakeFd);
+  }
+}
+
+//===============================================================================
+//      Sleep until the receive thread has submitted a block or stopped the
+//      writer. The sleeping flag is set before the queue is checked again,
+//      and the fences pair with the one in wake(), so that either the
+//      queue or the flag is seen by the other thread.
+//
+//===============================================================================
+void BlockWriter::wait_for_filled_block()
+{
+  uint64_t wakeups;
+
+  writerSleeping.store(true);
+  atomic_thread_fence(memory_order_seq_cst);
+  if ((filledBlocks.size() == 0) && !done) {
+    ssize_t result = read(filledWakeFd, &wakeups, sizeof(wakeups));
+    (void)result;
+  }
+  writerSleeping.store(false);
+}
+
+//===============================================================================
+//      Sleep until the writer thread has written a block, see
+//      wait_for_filled_block()
+//
+//===============================================================================
+void BlockWriter::wait_for_free_block()
+{
+  uint64_t wakeups;
+
+  receiverSleeping.store(true);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (freeBlocks.size() == 0) {
+    ssize_t result = read(freeWakeFd, &wakeups, sizeof(wakeups));
+    (void)result;
+  }
+  receiverSleeping.store(false);
+}
+
+//===============================================================================
+//      Wake up the other thread after pushing to its queue. Only costs a
+//      system call when it is sleeping. A wakeup left over from a thread
+//      that found the queue non-empty after all only makes its next sleep
+//      return at once.
+//
+//===============================================================================
+void BlockWriter::wake(atomic<bool>& sleeping, int wake_fd)
+{
+  atomic_thread_fence(memory_order_seq_cst);
+  if (sleeping.load(memory_order_relaxed) && sleeping.exchange(false)) {
+    uint64_t one    = 1;
+    ssize_t  result = write(wake_fd, &one, sizeof(one));
+    (void)result;
+  }
+}
@@ -0,0 +1,230 @@
+/*
+ *
+ * NAME: evhandl_capture_loop.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Event loop of a single BSC capture, see evhandl_capture_loop.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "evhandl_capture_loop.h"
+
+
+const int  MAX_LOOP_EVENTS = 8;
+
+// Signals stopping the capture as if 'q' was entered
+static void stop_signals(sigset_t *signals)
+{
+  sigemptyset(signals);
+  sigaddset(signals, SIGINT);
+  sigaddset(signals, SIGTERM);
+  sigaddset(signals, SIGHUP);
+}
+
+// Arm a timer expiring after first_ms and then every interval_ms, or
+// only once if interval_ms is 0
+static bool arm_timer(int fd, uint64_t first_ms, uint64_t interval_ms)
+{
+  struct itimerspec spec;
+
+  spec.it_value.tv_sec     = first_ms / 1000;
+  spec.it_value.tv_nsec    = (first_ms % 1000) * 1000000;
+  spec.it_interval.tv_sec  = interval_ms / 1000;
+  spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000;
+  return (timerfd_settime(fd, 0, &spec, NULL) == 0);
+}
+
+
+CaptureLoop::CaptureLoop()
+  : epollFd(-1),
+    signalFd(-1),
+    tickFd(-1),
+    maxTimeFd(-1),
+    wakeFd(-1),
+    socketFd(-1),
+    inputOpen(false),
+    lastSignal(0),
+    pending(0)
+{
+}
+
+CaptureLoop::~CaptureLoop()
+{
+  int fds[] = { epollFd, signalFd, tickFd, maxTimeFd, wakeFd };
+
+  for (size_t n = 0; n < sizeof(fds) / sizeof(fds[0]); n++) {
+    if (fds[n] >= 0) {
+      close(fds[n]);
+    }
+  }
+}
+
+void CaptureLoop::block_signals(bool block)
+{
+  sigset_t signals;
+
+  stop_signals(&signals);
+  pthread_sigmask(block ? SIG_BLOCK : SIG_UNBLOCK, &signals, NULL);
+}
+
+bool CaptureLoop::open(uint32_t tick_ms, uint32_t max_time_sec)
+{
+  sigset_t signals;
+
+  stop_signals(&signals);
+  epollFd  = epoll_create1(EPOLL_CLOEXEC);
+  signalFd = signalfd(-1, &signals, SFD_CLOEXEC);
+  tickFd   = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  wakeFd   = eventfd(0, EFD_CLOEXEC);
+  if ((epollFd < 0) || (signalFd < 0) || (tickFd < 0) || (wakeFd < 0) ||
+      !add(signalFd) || !add(tickFd) || !add(wakeFd) ||
+      !arm_timer(tickFd, tick_ms, tick_ms)) {
+    return false;
+  }
+
+  if (max_time_sec > 0) {
+    maxTimeFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if ((maxTimeFd < 0) || !add(maxTimeFd) ||
+        !arm_timer(maxTimeFd, (uint64_t)max_time_sec * 1000, 0)) {
+      return false;
+    }
+  }
+
+  // Without stdin, e.g. when started in the background, the capture is
+  // stopped by a signal instead
+  inputOpen = add(STDIN_FILENO);
+  return true;
+}
+
+bool CaptureLoop::watch_socket(int socket_fd)
+{
+  socketFd = socket_fd;
+  return add(socket_fd);
+}
+
+bool CaptureLoop::add(int fd)
+{
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events  = EPOLLIN;
+  event.data.fd = fd;
+  return (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0);
+}
+
+//===============================================================================
+//      Wait for at least one event. Timer and signal events are consumed
+//      here, the socket is left to the caller.
+//
+//===============================================================================
+int CaptureLoop::wait(int timeout_ms)
+{
+  while (pending == 0) {
+    struct epoll_event events[MAX_LOOP_EVENTS];
+    int                n = epoll_wait(epollFd, events, MAX_LOOP_EVENTS,
+                                       timeout_ms);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // Not expected, let the caller stop the capture
+      pending |= LoopEvent::quit;
+      break;
+    }
+    if (n == 0) {
+      break;
+    }
+
+    for (int i = 0; i < n; i++) {
+      int      fd = events[i].data.fd;
+      uint64_t expirations;
+
+      if (fd == socketFd) {
+        pending |= LoopEvent::socket;
+      }
+      else if (fd == STDIN_FILENO) {
+        read_input();
+      }
+      else if (fd == signalFd) {
+        struct signalfd_siginfo info;
+
+        if (read(signalFd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+          lastSignal = info.ssi_signo;
+          pending   |= LoopEvent::signal;
+        }
+      }
+      else if (fd == tickFd) {
+        if (read(tickFd, &expirations, sizeof(expirations)) > 0) {
+          pending |= LoopEvent::tick;
+        }
+      }
+      else if (fd == maxTimeFd) {
+        if (read(maxTimeFd, &expirations, sizeof(expirations)) > 0) {
+          pending |= LoopEvent::maxTime;
+        }
+      }
+      else if (fd == wakeFd) {
+        if (read(wakeFd, &expirations, sizeof(expirations)) > 0) {
+          pending |= LoopEvent::wake;
+        }
+      }
+    }
+  }
+
+  int result = pending;
+  pending = 0;
+  return result;
+}
+
+void CaptureLoop::wake()
+{
+  uint64_t one    = 1;
+  ssize_t  result = write(wakeFd, &one, sizeof(one));
+  (void)result;
+}
+
+//===============================================================================
+//      Look for 'q' or 'Q' on stdin
+//
+//===============================================================================
+void CaptureLoop::read_input()
+{
+  char    input[64];
+  ssize_t n = read(STDIN_FILENO, input, sizeof(input));
+
+  if (n <= 0) {
+    // No more input, e.g. stdin redirected from /dev/null
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+    inputOpen = false;
+    return;
+  }
+
+  // Setting bit 5 of an uppercase ASCII character gives the lowercase
+  for (ssize_t i = 0; i < n; i++) {
+    if ((input[i] | (char)0x20) == 'q') {
+      pending |= LoopEvent::quit;
+    }
+  }
+}
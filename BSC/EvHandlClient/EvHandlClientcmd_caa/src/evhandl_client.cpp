@@ -41,15 +41,21 @@
 
 // Module Include Files
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <signal.h>
+#include <dirent.h>
+#include <poll.h>
 #include <sys/capability.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <atomic>
 #include <ctime>
 #include <iostream>
 #include <fstream>
@@ -58,6 +64,29 @@
 #include <cstdint>
 #include <unistd.h> 
 
+#include "evhandl_analyze.h"
+#include "evhandl_block_writer.h"
+#include "evhandl_capture_engine.h"
+#include "evhandl_capture_loop.h"
+#include "evhandl_compressed_file.h"
+#include "evhandl_fanout_server.h"
+#include "evhandl_frame.h"
+#include "evhandl_frame_filter.h"
+#include "evhandl_frame_receiver.h"
+#include "evhandl_indexed_file.h"
+#include "evhandl_metrics.h"
+#include "evhandl_multi_capture.h"
+#include "evhandl_output_file.h"
+#include "evhandl_protocol.h"
+#include "evhandl_shm_ring.h"
+#include "evhandl_socket_monitor.h"
+#include "evhandl_splice_engine.h"
+#include "evhandl_thread_tuning.h"
+#include "evhandl_timestamps.h"
+#include "evhandl_uring_engine.h"
+#include "evhandl_watchlist.h"
+#include "evhandl_writeback.h"
+
 using namespace std;
 
 
@@ -69,15 +98,6 @@ using namespace std;
 #define NO_ID 2
 #define VERSION "CAA 139 2066 R2C01"
 
-// Enumerations
-struct InvokedAs {
-  enum { unknown, GMLog, RPMO };
-};
-
-struct MsId {
-  enum { IMSI, TLLI, none };
-};
-
 // Constants
 // Max supported output file size is 10GB
 const uint64_t  MAX_FILE_SIZE = 10000000000ULL;
@@ -85,27 +105,23 @@ const uint64_t  MAX_FILE_SIZE = 10000000000ULL;
 // Max supported logging time, unit is seconds, i.e. 60 minutes
 const uint32_t  MAX_LOGGING_TIME = 3600;
 
-const int32_t  MAX_EVENT_IDS  = 64;
-const int32_t  MAX_CELLS      = 2048;
+// Max number of segment files kept when logging to segments
+const uint32_t  MAX_SEGMENTS = 9999;
 
 const int32_t  HEADER_LENGTH  = 4;
 
-const int32_t  IMSI_LENGTH        = 10;  // Encoded IMSI length
-const int32_t  IMSI_FILTER_ID     = 1;
-const int32_t  IMSI_FILTER_LENGTH = (IMSI_LENGTH/2)+1;  // Length in words
-
-const int32_t  TLLI_LENGTH        = 4;
-const int32_t  TLLI_FILTER_ID     = 2;
-const int32_t  TLLI_FILTER_LENGTH = (TLLI_LENGTH/2)+1;  // Length in words
+// Interval of the statistics and of letting the writer flush the files
+const uint32_t  HOUSEKEEPING_INTERVAL_MS = 1000;
 
-const int32_t  GMLOG_EID_TROUBLE_SHOOTING_RP = 17;
-const int32_t  GMLOG_EID_TROUBLE_SHOOTING_CP = 18;
-
-// All system events are between 0xFF00 and 0xFFFF
-const int32_t  EID_SYSTEM_EVENT_MASK = 0xFF00;
+// Max frames handled each time the socket is reported readable
+const int       MAX_FRAMES_PER_WAKEUP = 4096;
 
 const string GMLOG_COMMAND_NAME = "gmlog";
 const string RPMO_COMMAND_NAME  = "rpmo";
+const string DECOMPRESS_COMMAND_NAME = "decompress";
+const string EXTRACT_COMMAND_NAME    = "extract";
+const string MULTI_COMMAND_NAME      = "multi";
+const string ANALYZE_COMMAND_NAME    = "analyze";
 
 // Absolute path to the output directory in the NBFS (North Bound File
 // System) What is visible when connecting to APG using FTP or SFTP is
@@ -141,11 +157,9 @@ const string DEFAULT_RPMO_FILENAME = "logfile_rpmo.rpm";
 // Clear any system resource capability if running as root.
 void clear_sys_resource_capability();
 
-// Send request and wait on the reply.
-int send_receive_data(char *buffer, int bytes_to_send, int socket_fd);
-
-// Send the buffer to the socket.
-int send_buffer(char *buffer, int bytes_to_send, int socket_fd);
+// Send the buffer to the socket. With MSG_DONTWAIT in flags, 0 is
+// returned when the socket can not take any data now.
+int send_buffer(char *buffer, int bytes_to_send, int socket_fd, int flags = 0);
 
 // receive data from the socket.
 int receive_buffer(char *buffer, int bytes_to_receive, int socket_fd);
@@ -154,19 +168,36 @@ int receive_buffer(char *buffer, int bytes_to_receive, int socket_fd);
 int receive_buffer_timeout(char *buffer, int bytes_to_receive, int socket_fd);
 
 // Write the eventdata to the file or to the stdout if the out == null.
-void write_to_file(char *buffer, int number_of_bytes, uint64_t& bytesWritten);
+// receive_ns is the arrival time of the frame, 0 if not known.
+void write_to_file(char *buffer, int number_of_bytes, uint64_t& bytesWritten,
+                   uint64_t receive_ns = 0);
 
-// Send a request of the event. Packing of packet with the filter and eid.
-void request_event_subscription(int eid, int *cell_list, int socket_fd, char *msFlt, int msId, int cmd);
+// Send the subscription requests of all events at once and wait for the
+// replies. Frames received meanwhile are handled as any other.
+void subscribe_to_events(const int *event_list, const int *cell_list,
+                         int socket_fd, const char *msFlt, int msId, int cmd);
+
+// Count, filter, write and publish a frame received from the BSC.
+void handle_frame(char *frame, int frame_length);
 
 // Check the result from an connection request.
 void check_connection_result(char result);
 
-// Decode the events id arguments. Comma separated to a array of int.
-int decode_event_list(char *events, int *event_list);
+// Return the value of a long option given as --<name>=<value>, or NULL if
+// the argument is not that option.
+const char* long_option_value(const char *arg, const char *name);
+
+// Check that the log file name ends with the suffix of the command.
+// Prints the error and the usage if not.
+void check_log_file_suffix(int cmd);
 
-// Decode the cell pointers arguments. Comma separated to a array of int.
-int decode_cell_list(char *cells, int *cell_list);
+// Name of a file that logging to filename, with the given format and
+// segments, would overwrite. Empty if none.
+string existing_log_file();
+
+// Ask before overwriting an existing log file, letting the user give a
+// new name or quit.
+void confirm_overwrite(int cmd);
 
 // Prints usage (depends on GMLog and RPMO specific print usage functions).
 void print_usage(int cmd);
@@ -177,30 +208,106 @@ void print_gmlog_help_txt();
 // Print syntax and example text for R-PMO usage.
 void print_rpmo_help_txt();
 
-// Assemble the IMSI as coded in GMLOG IWD
-void assemble_imsi(char *imsi_buff, const char *imsi);
+// Print the options common to GMLog and R-PMO for tuning the capture.
+void print_capture_options_help_txt();
+
+// Decompress a log file written with --format=compressed.
+int decompress_command(int argc, char *argv[]);
+
+// Extract a time window or events from a log file written with
+// --format=v2.
+int extract_command(int argc, char *argv[]);
+
+// Capture from several BSCs listed in a target file.
+int multi_command(int argc, char *argv[]);
+
+// Parse one line of a multi capture target file. Prints the error and
+// exits if the line is not valid.
+void parse_capture_target(char *line, int line_number, CaptureTarget& target);
+
+// Print frame statistics per channel, Event ID and control message of
+// a raw log file.
+int analyze_command(int argc, char *argv[]);
+
+// Convert a time given as YYYY-MM-DDTHH:MM:SS local time to ms since
+// the Epoch. Returns false if not a valid time.
+bool parse_time_ms(const char *value, uint64_t& time_ms);
+
+// Current size of the log file, may be called from any thread.
+uint64_t log_file_size();
 
-// Assemble TLLI as coded in GMLOG IWD
-void assemble_tlli(char *tlli_buff, char *tlli);
+// Print the statistics line (total number of collected events and
+// kilobytes written to file), called once a second
+void print_statistics();
 
-// Print hex buffer
-void printBuffer(char * buff, int len);
+// Let the writer thread flush the files and check the file size, called
+// once a second by the receive loop
+void flush_files();
 
-// Quit thread function. Listens for 'q' or 'Q' followed by <Enter> or
-// <Return> on stdin to quit
-void* quit_request_checker(void* pParams);
+// Stop logging on a quit request, stop signal or the max logging time
+// reported by the capture loop
+void handle_stop_events(int events);
 
-// Print statistics thread function. Periodically (total number of
-// collected events and kilobytes written to file)
-void* print_statistics(void* pParams);
+// Housekeeping thread function used with the capture engines, which take
+// over the socket and the receive loop
+void* housekeeping_thread(void* pParams);
 
+// Request the receive loop to stop, drain buffered data and close the
+// file. May be called from any thread.
+void stop_logging(const char *reason);
 
-ofstream   out;
+// Collect the values of the client shown with the metrics. Called by the
+// metrics thread.
+void collect_metrics(vector<MetricValue>& values);
+
+
+OutputFile *out           = NULL;
 string     filename;
+bool       logFileGiven   = false;            // Log file named with -f
 uint32_t   numberOfEvents;
 uint64_t   bytesWritten   = 0;
 uint64_t   maxFileSize    = MAX_FILE_SIZE;    // Default is max (10 GB)
 uint32_t   maxLoggingTime = MAX_LOGGING_TIME; // Default is max (60 minutes)
+uint32_t   writeBufferMb  = DEFAULT_WRITE_BUFFER_MB;
+int        socketFd       = -1;
+FrameReceiver *receiver   = NULL;
+BlockWriter   *writer     = NULL;
+int            engine     = Engine::standard;
+int            writerType = Writer::stream;
+uint32_t       writebackMb = 0;               // 0 when no writeback window
+uint32_t       syncInterval = 0;              // 0 when not calling fdatasync
+Writeback     *writeback  = NULL;
+int            tuningProfile = Tuning::none;
+SocketMonitor *socketMonitor = NULL;
+ThreadTuning   receiveTuning = NO_THREAD_TUNING;
+ThreadTuning   writerTuning  = NO_THREAD_TUNING;
+ThreadTuning   statsTuning   = NO_THREAD_TUNING; // Metrics and housekeeping
+uint32_t       maxSegments = 0;               // 0 when not using segments
+int            fileFormat = Format::raw;
+CompressedOutputFile *compressedOut = NULL;
+CaptureEngine *captureEngine = NULL;
+FanoutServer  *fanout     = NULL;
+string         fanoutName;                    // Empty when not fanning out
+ShmRingWriter *shmRing    = NULL;
+string         shmName;                       // Empty when not using --shm
+FrameFilter   *frameFilter = NULL;
+uint64_t       acceptedFrames = 0;            // Event frames passing the filter
+uint64_t       filteredFrames = 0;            // Event frames not written
+Watchlist     *watchlist  = NULL;
+WatchlistFiles *watchlistFiles = NULL;        // NULL unless split
+string         watchlistError;                // Stop reason, set once
+bool           watchlistSplit = false;
+uint64_t       watchedFrames   = 0;           // Event frames matched
+uint64_t       unwatchedFrames = 0;           // Event frames not matched
+CaptureMetrics *metrics   = NULL;
+string         metricsAddress;                // Empty when not serving
+string         metricsJsonName;               // Empty when not dumping
+string         timestampName;                 // Empty when no side-car
+OutputFile    *timestampOut = NULL;
+WriteBlock    *timestampBlock = NULL;
+atomic<const char*> stopReason(NULL);
+atomic<bool>   flushDue(false);               // Engine to write, per tick
+CaptureLoop    captureLoop;
 
 int main(int argc, char *argv[])
 {
@@ -256,6 +363,19 @@ int main(int argc, char *argv[])
   //  printf("argv[%d] = %s\n", n, argv[n]);
   //}
 
+  if ((argc > 1) && (DECOMPRESS_COMMAND_NAME == argv[1])) {
+    return decompress_command(argc, argv);
+  }
+  if ((argc > 1) && (EXTRACT_COMMAND_NAME == argv[1])) {
+    return extract_command(argc, argv);
+  }
+  if ((argc > 1) && (MULTI_COMMAND_NAME == argv[1])) {
+    return multi_command(argc, argv);
+  }
+  if ((argc > 1) && (ANALYZE_COMMAND_NAME == argv[1])) {
+    return analyze_command(argc, argv);
+  }
+
   if (GMLOG_COMMAND_NAME == argv[1]) {
     cmd = InvokedAs::GMLog;
     // Set default filename
@@ -269,6 +389,10 @@ int main(int argc, char *argv[])
   else {
     print_usage(InvokedAs::unknown);
   }
+
+  // The stop signals are taken by the capture loop, they must be blocked
+  // before any thread is started
+  CaptureLoop::block_signals();
   
   // Check that number of parameters are correct
   if (argc < 5) {
@@ -283,102 +407,210 @@ int main(int argc, char *argv[])
   
   //Get cmd line options
   for (int n=5; n< argc; n++) {
-    if (argv[n][0] == '-') {
+    const char *value;
+
+    if ((argv[n][0] == '-') && (argv[n][1] == '-')) {
+      // Long options are given as --<name>=<value>
+      if ((value = long_option_value(argv[n], "engine")) != NULL) {
+        if (strcmp(value, "uring") == 0) {
+          engine = Engine::uring;
+        }
+        else if (strcmp(value, "splice") == 0) {
+          engine = Engine::splice;
+        }
+        else if (strcmp(value, "default") == 0) {
+          engine = Engine::standard;
+        }
+        else {
+          printf("\nUnknown capture engine: %s\n\n", value);
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "writer")) != NULL) {
+        if (strcmp(value, "direct") == 0) {
+          writerType = Writer::direct;
+        }
+        else if (strcmp(value, "mmap") == 0) {
+          writerType = Writer::mapped;
+        }
+        else if (strcmp(value, "default") == 0) {
+          writerType = Writer::stream;
+        }
+        else {
+          printf("\nUnknown file writer: %s\n\n", value);
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "pin")) != NULL) {
+        int cpus[3] = { -1, -1, -1 };
+
+        if (!parse_cpu_list(value, cpus, 3)) {
+          printf("\nInvalid CPU list: %s\n\n", value);
+          print_usage(cmd);
+        }
+        receiveTuning.cpu = cpus[0];
+        writerTuning.cpu  = cpus[1];
+        statsTuning.cpu   = cpus[2];
+      }
+      else if ((value = long_option_value(argv[n], "sched")) != NULL) {
+        if (!parse_sched(value, receiveTuning)) {
+          printf("\nInvalid scheduling: %s\n\n", value);
+          print_usage(cmd);
+        }
+        // The writer follows the receive loop, or the receive loop would
+        // wait for free blocks
+        writerTuning.policy   = receiveTuning.policy;
+        writerTuning.priority = receiveTuning.priority;
+        writerTuning.nice     = receiveTuning.nice;
+      }
+      else if ((value = long_option_value(argv[n], "ioprio")) != NULL) {
+        if (!parse_ioprio(value, writerTuning.ioprio)) {
+          printf("\nInvalid I/O priority: %s\n\n", value);
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "tune")) != NULL) {
+        if (strcmp(value, "throughput") == 0) {
+          tuningProfile = Tuning::throughput;
+        }
+        else if (strcmp(value, "latency") == 0) {
+          tuningProfile = Tuning::latency;
+        }
+        else if (strcmp(value, "none") == 0) {
+          tuningProfile = Tuning::none;
+        }
+        else {
+          printf("\nUnknown tuning profile: %s\n\n", value);
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "writeback")) != NULL) {
+        writebackMb = atoi(value);
+        if ((writebackMb < 1) || (writebackMb > MAX_WRITEBACK_WINDOW_MB)) {
+          printf("\nWriteback window must be between 1 and %u megabytes.\n",
+                 MAX_WRITEBACK_WINDOW_MB);
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "fdatasync")) != NULL) {
+        syncInterval = atoi(value);
+        if (syncInterval < 1) {
+          printf("\nThe fdatasync interval must be at least 1 second.\n");
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "segments")) != NULL) {
+        maxSegments = atoi(value);
+        if ((maxSegments == 0) || (maxSegments > MAX_SEGMENTS)) {
+          printf("\nNumber of segments to keep must be between 1 and %u.\n",
+                 MAX_SEGMENTS);
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "format")) != NULL) {
+        if (strcmp(value, "compressed") == 0) {
+          fileFormat = Format::compressed;
+        }
+        else if (strcmp(value, "v2") == 0) {
+          fileFormat = Format::v2;
+        }
+        else if (strcmp(value, "raw") == 0) {
+          fileFormat = Format::raw;
+        }
+        else {
+          printf("\nUnknown file format: %s\n\n", value);
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "fanout")) != NULL) {
+        fanoutName = value;
+        if (fanoutName.empty()) {
+          printf("\nA socket name must be given with --fanout.\n\n");
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "filter")) != NULL) {
+        string error;
+
+        frameFilter = new FrameFilter();
+        if (frameFilter->compile(value, error) == false) {
+          printf("\nInvalid filter: %s\n\n", error.c_str());
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "watchlist")) != NULL) {
+        string error;
+
+        watchlist = new Watchlist();
+        if (watchlist->load(value, error) == false) {
+          printf("\nUnable to load the watchlist %s\n", value);
+          printf("Reason: %s\n\n", error.c_str());
+          exit(1);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "watchlist-output")) != NULL) {
+        if (strcmp(value, "split") == 0) {
+          watchlistSplit = true;
+        }
+        else if (strcmp(value, "merged") == 0) {
+          watchlistSplit = false;
+        }
+        else {
+          printf("\nUnknown watchlist output: %s\n\n", value);
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "metrics")) != NULL) {
+        metricsAddress = value;
+        if (metricsAddress.empty()) {
+          printf("\nA port must be given with --metrics.\n\n");
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "metrics-json")) != NULL) {
+        metricsJsonName = value;
+        if (metricsJsonName.empty() ||
+            (metricsJsonName.find('/') != string::npos)) {
+          printf("\nA file name without '/' must be given with "
+                 "--metrics-json.\n\n");
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "timestamps")) != NULL) {
+        timestampName = value;
+        if (timestampName.empty() ||
+            (timestampName.find('/') != string::npos)) {
+          printf("\nA file name without '/' must be given with "
+                 "--timestamps.\n\n");
+          print_usage(cmd);
+        }
+      }
+      else if ((value = long_option_value(argv[n], "shm")) != NULL) {
+        shmName = value;
+        if (shmName.empty() || (shmName.find('/') != string::npos)) {
+          printf("\nA name without '/' must be given with --shm.\n\n");
+          print_usage(cmd);
+        }
+      }
+      else {
+        printf("\nUnknown option: %s\n\n", argv[n]);
+        print_usage(cmd);
+      }
+    }
+    else if (argv[n][0] == '-') {
       if (argc == n+1) {
         printf("\nMissing arguments...\n");
         print_usage(cmd);
       }
       
       if (argv[n][1] == 'f') {
-        // Log file name option
-        string  suffix_to_use =
-          (cmd == InvokedAs::GMLog)? GMLOG_SUFFIX : RPMO_SUFFIX;
-        
-        //printf("\nSuffix to use is: %s\n",suffix_to_use.c_str());
+        // Log file name option, checked for overwriting once all options
+        // are known
         n++;
         filename.clear();
         filename += OUTPUT_DIRECTORY + argv[n];
-        
-        //printf("\nAbsolute filename is: %s\n",filename.c_str());
-        if ((filename.length()-OUTPUT_DIRECTORY.length()) >=
-            suffix_to_use.length()) {
-          //printf("\nGiven filename is longer than the suffix\n");
-          if (filename.compare(filename.size() - suffix_to_use.size(),
-                               suffix_to_use.size(),
-                               suffix_to_use) != 0) {
-            int    len     = BASE_DIRECTORY.length()-1;
-            string subpath = filename.substr(len, filename.length());
-
-            printf("\n%s must end with %s\n\n",
-                   subpath.c_str(),
-                   suffix_to_use.c_str());
-            print_usage(cmd);
-          }
-        }
-        else {
-          int    len     = BASE_DIRECTORY.length()-1;
-          string subpath = filename.substr(len, filename.length());
-          
-          printf("\n%s must end with %s\n\n",
-                 subpath.c_str(),
-                 suffix_to_use.c_str());
-          print_usage(cmd);
-        }
-        
-        // Check if file already exists
-        struct stat  st;
-        char ch;
-        char new_file_name[100];
-        while (true) {
-          if (stat(filename.c_str(), &st) != -1) {
-            printf("\nLogfile already exists. Overwrite existing file(y/n) "
-                   "or quit(q)?\n");
-            scanf("%c", &ch);
-            
-            if (ch == 'n') {
-              printf("Please enter new filename + <ENTER>: \n");
-              scanf("%99s", new_file_name);
-              filename.clear();
-              filename += OUTPUT_DIRECTORY + new_file_name;
-              //printf("\nAbsolute filename is: %s\n",filename.c_str());
-
-              if ((filename.length()-OUTPUT_DIRECTORY.length()) >=
-                  suffix_to_use.length()) {
-                //printf("\nGiven filename is longer than the suffix\n");
-                if (filename.compare(filename.size() - suffix_to_use.size(),
-                                     suffix_to_use.size(),
-                                     suffix_to_use) != 0) {
-                  int    len     = BASE_DIRECTORY.length()-1;
-                  string subpath = filename.substr(len, filename.length());
-                  
-                  printf("\n%s must end with %s\n\n",
-                         subpath.c_str(),
-                         suffix_to_use.c_str());
-                  print_usage(cmd);
-                }
-              }
-              else {
-                int    len     = BASE_DIRECTORY.length()-1;
-                string subpath = filename.substr(len, filename.length());
-                
-                printf("\n%s must end with %s\n\n",
-                       subpath.c_str(),
-                       suffix_to_use.c_str());
-                print_usage(cmd);
-              }
-            }
-            else if (ch == 'y') {
-              // Overwrite existing file
-              break;
-            }
-            else if (ch == 'q') {
-              exit(0);
-            }
-          }
-          else {
-            break;
-          }
-        }
+        check_log_file_suffix(cmd);
+        logFileGiven = true;
       }
       else if (argv[n][1] == 's') {
         // Log file size option
@@ -389,6 +621,16 @@ int main(int argc, char *argv[])
           print_usage(cmd);
         }
       }
+      else if (argv[n][1] == 'b') {
+        // Write buffer size option
+        n++;
+        writeBufferMb = atoi((char *)argv[n]);
+        if ((writeBufferMb == 0) || (writeBufferMb > MAX_WRITE_BUFFER_MB)) {
+          printf("\nWrite buffer size must be between 1 and %u megabytes.\n",
+                 MAX_WRITE_BUFFER_MB);
+          print_usage(cmd);
+        }
+      }
       else if (argv[n][1] == 'h' ) {
         // Maximum time for logging option
         n++;
@@ -448,6 +690,7 @@ int main(int argc, char *argv[])
 
         msId = MsId::IMSI;
         assemble_imsi(msIdBuff, imsi);
+        printBuffer(msIdBuff, IMSI_LENGTH);
       }
       else if (argv[n][1] == 't') {
         // TLLI option only allowed for GMLog
@@ -478,14 +721,246 @@ int main(int argc, char *argv[])
     }
   }// FOR
   
-  // Open file to write binary data into
-  out.open(filename.c_str(), ios::out|ios::binary);
-  if (out.is_open() == false) {
+  // The alternative capture engines write the file themselves
+  if ((writerType != Writer::stream) && (engine != Engine::standard)) {
+    printf("\nThe --writer option can only be used with the default engine.\n\n");
+    print_usage(cmd);
+  }
+  if (((writebackMb != 0) || (syncInterval != 0)) &&
+      (engine != Engine::standard)) {
+    printf("\nThe --writeback and --fdatasync options can only be used with "
+           "the default engine.\n\n");
+    print_usage(cmd);
+  }
+  if ((writebackMb != 0) && (writerType == Writer::direct)) {
+    printf("\nThe --writeback option can not be used with the direct writer.\n\n");
+    print_usage(cmd);
+  }
+  if ((maxSegments != 0) && (engine != Engine::standard)) {
+    printf("\nThe --segments option can only be used with the default engine.\n\n");
+    print_usage(cmd);
+  }
+  if ((fileFormat != Format::raw) && (engine != Engine::standard)) {
+    printf("\nThe --format option can only be used with the default engine.\n\n");
+    print_usage(cmd);
+  }
+  if (!fanoutName.empty() && (engine != Engine::standard)) {
+    printf("\nThe --fanout option can only be used with the default engine.\n\n");
+    print_usage(cmd);
+  }
+  if (!shmName.empty() && (engine != Engine::standard)) {
+    printf("\nThe --shm option can only be used with the default engine.\n\n");
+    print_usage(cmd);
+  }
+  if ((frameFilter != NULL) && (engine != Engine::standard)) {
+    printf("\nThe --filter option can only be used with the default engine.\n\n");
+    print_usage(cmd);
+  }
+  if ((watchlist != NULL) && (engine != Engine::standard)) {
+    printf("\nThe --watchlist option can only be used with the default engine.\n\n");
+    print_usage(cmd);
+  }
+
+  if ((!metricsAddress.empty() || !metricsJsonName.empty()) &&
+      (engine != Engine::standard)) {
+    printf("\nThe --metrics options can only be used with the default engine.\n\n");
+    print_usage(cmd);
+  }
+
+  if (!timestampName.empty() && (engine != Engine::standard)) {
+    printf("\nThe --timestamps option can only be used with the default engine.\n\n");
+    print_usage(cmd);
+  }
+
+  // The watchlist replaces the single subscriber filter of the BSC
+  if ((watchlist != NULL) && (msId != MsId::none)) {
+    printf("\nThe --watchlist option can not be used with -i or -t.\n\n");
+    print_usage(cmd);
+  }
+  if (watchlistSplit && (watchlist == NULL)) {
+    printf("\nThe --watchlist-output option can only be used with --watchlist.\n\n");
+    print_usage(cmd);
+  }
+  if (watchlistSplit && !timestampName.empty()) {
+    printf("\nThe --timestamps option can not be used with "
+           "--watchlist-output=split.\n\n");
+    print_usage(cmd);
+  }
+
+  // The index of a v2 file covers the whole file
+  if ((fileFormat == Format::v2) && (maxSegments != 0)) {
+    printf("\nThe --format=v2 option can not be used with --segments.\n\n");
+    print_usage(cmd);
+  }
+
+  if (logFileGiven) {
+    confirm_overwrite(cmd);
+  }
+
+  // Compressed files are named e.g. logfile_rpmo.rpm.z, decompressing
+  // gives back logfile_rpmo.rpm. v2 files are named e.g.
+  // logfile_rpmo.rpm.v2.
+  if (fileFormat == Format::compressed) {
+    filename += COMPRESSED_SUFFIX;
+  }
+  else if (fileFormat == Format::v2) {
+    filename += INDEXED_SUFFIX;
+  }
+
+  // Open file to write binary data into. When logging to segments, the
+  // max file size and logging time apply to each segment, and logging
+  // goes on until stopped by the user.
+  if ((writebackMb != 0) || (syncInterval != 0)) {
+    writeback = new Writeback((uint64_t)writebackMb * 1024 * 1024,
+                              syncInterval);
+  }
+  if (maxSegments != 0) {
+    out = new SegmentedOutputFile(writerType, maxFileSize, maxLoggingTime,
+                                  maxSegments, writeback);
+  }
+  else {
+    out = create_output_file(writerType, maxFileSize, writeback);
+  }
+  if (fileFormat == Format::compressed) {
+    compressedOut = new CompressedOutputFile(out);
+    out           = compressedOut;
+  }
+  else if (fileFormat == Format::v2) {
+    out = new IndexedOutputFile(out);
+  }
+  if (out->open(filename) == false) {
     printf("Unable to open the file\n");
     printf("Reason: %s\n\n", strerror(errno));
     exit(1);
   }
 
+  // Frames are written to the file by a separate writer thread so that a
+  // stalling disk does not stop us from reading the socket
+  {
+    int    len     = BASE_DIRECTORY.length()-1;
+    string subpath = filename.substr(len, filename.length());
+
+    writer = new BlockWriter(*out, subpath,
+                             (size_t)writeBufferMb * 1024 * 1024);
+    writer->start(writerTuning);
+    if (writeback != NULL) {
+      writeback->start();
+    }
+  }
+
+  if (!metricsAddress.empty() || !metricsJsonName.empty()) {
+    metrics = new CaptureMetrics(&collect_metrics);
+    metrics->add_histogram("evhandl_receive_to_write_seconds",
+                           "Time from the arrival of the first frame of a "
+                           "block until the block is written",
+                           &writer->receive_to_write());
+    metrics->add_histogram("evhandl_block_write_seconds",
+                           "Time to write a block to the log file",
+                           &writer->write_latency());
+    metrics->add_histogram("evhandl_flush_seconds",
+                           "Time to flush the log file",
+                           &writer->flush_latency());
+    if (writeback != NULL) {
+      metrics->add_histogram("evhandl_writeback_wait_seconds",
+                             "Time waiting for a writeback window to reach "
+                             "the disk",
+                             &writeback->wait_latency());
+      metrics->add_histogram("evhandl_fdatasync_seconds",
+                             "Time of the periodic fdatasync of the log file",
+                             &writeback->sync_latency());
+    }
+    // Served once the receiver is set up, see below
+    if (!metricsAddress.empty() &&
+        (metrics->listen(metricsAddress) == false)) {
+      printf("Unable to serve metrics on %s\n", metricsAddress.c_str());
+      printf("Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+  }
+
+  // The side-car file is written by the writer thread as well
+  if (!timestampName.empty()) {
+    timestampOut = create_output_file(Writer::stream, maxFileSize);
+    if (timestampOut->open(OUTPUT_DIRECTORY + timestampName) == false) {
+      printf("Unable to open the file /%s%s\n",
+             DESTINATION_DIRECTORY.c_str(), timestampName.c_str());
+      printf("Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+    timestampBlock = writer->acquire(timestampOut, timestampName.c_str());
+    timestampBlock = writer->append(timestampBlock, TIMESTAMP_FILE_MAGIC,
+                                    sizeof(TIMESTAMP_FILE_MAGIC));
+  }
+
+  if (watchlist != NULL) {
+    printf("\nWatching %u IMSIs and %u TLLIs\n", watchlist->imsi_count(),
+           watchlist->tlli_count());
+
+    // Each watched subscriber may need a file of its own
+    if (watchlistSplit) {
+      struct rlimit limit;
+
+      if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+      }
+      watchlistFiles = new WatchlistFiles(*watchlist, *writer, filename,
+                                          maxFileSize);
+    }
+  }
+
+  // Local consumers may connect to the fan-out socket before the BSC
+  // connection is up
+  if (!fanoutName.empty()) {
+    fanout = new FanoutServer();
+    if (fanout->open(OUTPUT_DIRECTORY + fanoutName) == false) {
+      printf("Unable to create the fan-out socket /%s%s\n",
+             DESTINATION_DIRECTORY.c_str(), fanoutName.c_str());
+      printf("Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+    fanout->start();
+  }
+  if (!shmName.empty()) {
+    shmRing = new ShmRingWriter();
+    if (shmRing->open(shmName) == false) {
+      printf("Unable to create the shared memory ring /dev/shm/%s\n",
+             shmName.c_str());
+      printf("Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+  }
+
+  // Set up the selected capture engine before connecting, so that we can
+  // fall back to the default engine if the kernel does not support it
+  if (engine != Engine::standard) {
+    const char *name;
+    int         result;
+
+    if (engine == Engine::uring) {
+      UringEngine *uring = new UringEngine();
+
+      name          = "io_uring";
+      result        = uring->init(BUFFER_SIZE);
+      captureEngine = uring;
+    }
+    else {
+      SpliceEngine *splice_engine = new SpliceEngine();
+
+      name          = "splice";
+      result        = splice_engine->init(BUFFER_SIZE);
+      captureEngine = splice_engine;
+    }
+
+    if (result != 0) {
+      printf("\nThe %s engine can not be used, using the default engine.\n"
+             "Reason: %s\n", name, strerror(result));
+      delete captureEngine;
+      captureEngine = NULL;
+      engine        = Engine::standard;
+    }
+  }
+
   // Setup for the remote side (BSC).
   struct sockaddr_in bsc_address;
   bsc_address.sin_family = AF_INET;
@@ -496,6 +971,7 @@ int main(int argc, char *argv[])
   fflush(stdout);
 
   int  socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+  socketFd = socket_fd;
   if (socket_fd < 0) {
     printf("Could not create a socket.\n");
     printf("Reason: %s\n\n", strerror(errno));
@@ -513,22 +989,23 @@ int main(int argc, char *argv[])
       printf("Reason: %s\n\n", strerror(errno));
     }
   }
+  tune_socket(socket_fd, tuningProfile);
   
+  // The threads started so far keep the stop signals blocked, so that a
+  // stop signal ends the process while waiting for the BSC to answer
+  CaptureLoop::block_signals(false);
   if (connect(socket_fd, (struct sockaddr *)&bsc_address, sizeof(bsc_address)) < 0) {
     printf("Socket connection failed.\n");
     printf("Reason: %s\n\n", strerror(errno));
     exit(1);
   }
+  CaptureLoop::block_signals(true);
+  socketMonitor = new SocketMonitor(socket_fd, tuningProfile != Tuning::none);
   printf("done\n\n");
   fflush(stdout);
 
   // Create connect request message
-  buffer[0] = 0; // Length of the data
-  buffer[1] = 1; // Length of the data
-  buffer[2] = 0; // Channel
-  buffer[3] = 0; // Channel
-  buffer[4] = 0; // CMN = Connect
-  buffer[5] = 1; // CMN = Connect
+  build_connect_request(buffer);
 
   printf("Sending connection request to application (%s)...",argv[1]);
   fflush(stdout);
@@ -559,329 +1036,290 @@ int main(int argc, char *argv[])
   printf("connected\n\n");
   fflush(stdout);
 
-  // Send subscribe request for all given eids (event IDs)
-  for (int n=0; event_list[n] != -1; n++) {
-    request_event_subscription(event_list[n], cell_list, socket_fd, msIdBuff,
-                               msId, cmd);
+  // Complete frames (header and payload) are parsed in place in the
+  // receive ring and the socket is only read when the ring runs out of
+  // complete frames. The receiver is set up before subscribing so that
+  // events arriving during the subscriptions are handled as any other.
+  receiver = new FrameReceiver(socket_fd, BUFFER_SIZE);
+  if (captureEngine == NULL) {
+    if (receiver->enable_timestamps() == false) {
+      printf("Kernel receive timestamps are not available, using the time "
+             "of each read instead.\nReason: %s\n\n", strerror(errno));
+    }
+    if (metrics != NULL) {
+      metrics->add_histogram("evhandl_inter_arrival_seconds",
+                             "Time between the arrival of consecutive "
+                             "frames", &receiver->inter_arrival());
+      if (!metricsAddress.empty()) {
+        metrics->start(statsTuning);
+      }
+    }
   }
 
-  // Start thread to listen after q or Q on stdin. If received then quit
+  numberOfEvents = 0;
+  subscribe_to_events(event_list, cell_list, socket_fd, msIdBuff, msId, cmd);
+
+  // Quit on q or Q on stdin, a stop signal or the max logging time
+  if (captureLoop.open(HOUSEKEEPING_INTERVAL_MS,
+                       (maxSegments == 0) ? maxLoggingTime : 0) == false) {
+    printf("\nERROR: Failed to set up the capture loop\n"
+           "Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
   printf("\n\nTo quit press: 'q' or 'Q' + <ENTER> or <RETRUN>\n\n\n");
   fflush(stdout);
 
-  
-  pthread_t quit_thread;
-  pthread_t statistics_thread;
-  pthread_create(&quit_thread, NULL, &quit_request_checker, NULL);
-  pthread_create(&statistics_thread, NULL, &print_statistics, NULL);
+  if (captureEngine != NULL) {
+    int    frame_length;
+    char  *frame;
 
+    // The frames already read are handled here, without reading the
+    // socket as nothing can stop a blocking read before the engine runs.
+    // A partial frame left in the buffer is continued by the engine.
+    while ((frame = receiver->buffered_frame(frame_length)) != NULL) {
+      handle_frame(frame, frame_length);
+    }
 
-  // Receive event data until stopped
-  numberOfEvents = 0;
-  int    number_of_bytes;
-  int    bytes_received;
-  time_t last_sec = time(NULL);
-  while (true) {
-    bytes_received = receive_buffer(buffer, HEADER_LENGTH, socket_fd);
-
-    number_of_bytes = ((unsigned char)buffer[0] * 256 +
-                       (unsigned char)buffer[1]) * 2;
-    if (number_of_bytes > BUFFER_SIZE) {
-      printf("\nERROR: Reading from socket event length too long.\n"
-             "%10d bytes stated in received event, expected max %d bytes.\n",
-             number_of_bytes, BUFFER_SIZE);
+    // The frames received so far have been queued towards the writer
+    // thread, they must be on file before the capture engine continues
+    // writing after them
+    writer->stop();
+    out->close();
+
+    int file_fd = open(filename.c_str(), O_WRONLY);
+    if (file_fd < 0) {
+      printf("Unable to open the file\n");
+      printf("Reason: %s\n\n", strerror(errno));
       exit(1);
     }
-    write_to_file(buffer, bytes_received, bytesWritten);
-    
-    bytes_received = receive_buffer(buffer, number_of_bytes, socket_fd);
-    write_to_file(buffer, bytes_received, bytesWritten);
-    
-    numberOfEvents++;
-    
-    if (time(NULL) > (last_sec + 1)) {
-      // flush file max every second
-      out.flush();
-      last_sec = time(NULL);
-      
-      if (bytesWritten > maxFileSize) {
-        printf("\nMaximum file size reached. Logging stopped.\n");
-        out.close();
-        exit(1);
-      }
-    }
-  }
 
-  out.close();
-  shutdown(socket_fd, SHUT_RDWR); // Shutdown socket for both reading and writing
+    CaptureState state = { numberOfEvents, bytesWritten, maxFileSize,
+                           stopReason, flushDue };
+    pthread_t    housekeeping;
 
-  return 0;
-}
+    pthread_create(&housekeeping, NULL, &housekeeping_thread, NULL);
 
-//===============================================================================
-//      Clear the system resource capabilty bit in case we are running as
-//      root so we do not overstep any assigned quota on the file system we
-//      are writing to.
-//
-//===============================================================================
-void clear_sys_resource_capability()
-{
-  // Intent is to clear the CAP_SYS_RESOURCE bit so that root user
-  // cannot override disk quota limits
-  
-  cap_t caps = cap_get_proc();
+    // The engine writes the file from this thread
+    receiveTuning.ioprio = writerTuning.ioprio;
+    tune_thread(receiveTuning, "receive");
+    if (captureEngine->run(socket_fd, file_fd, receiver->buffered_data(),
+                           receiver->buffered(), state) ==
+        CaptureEnd::maxFileSize) {
+      stop_logging("Maximum file size reached. Logging stopped.");
+    }
+    close(file_fd);
 
-  if (caps == NULL) {
-    printf("\nERROR: Failed to get capabilities\n");
-    printf("Reason: %s", strerror(errno));
-    exit(1);
+    // The housekeeping thread is also woken when the BSC closed the
+    // connection, and must be done printing before the summary
+    captureLoop.wake();
+    pthread_join(housekeeping, NULL);
   }
   else {
-    cap_value_t cap_list[] = { CAP_SYS_RESOURCE };
-    
-    // Clear capability CAP_SYS_RESOURCE
-    if (cap_set_flag(caps, CAP_EFFECTIVE, sizeof(cap_list),
-                    cap_list, CAP_CLEAR) != 0) {
-      printf("\nERROR: Failed to clear capability flag\n");
-      printf("Reason: %s\n", strerror(errno));
+    // Receive event data until stopped. The socket is only read when
+    // the capture loop reports it readable, and the housekeeping is done
+    // on the ticks of the loop instead of checking the time per frame.
+    int    frame_length;
+    char  *frame;
+
+    tune_thread(receiveTuning, "receive");
+    receiver->set_nonblocking(true);
+    if (captureLoop.watch_socket(socket_fd) == false) {
+      printf("\nERROR: Failed to watch the socket\n"
+             "Reason: %s\n\n", strerror(errno));
       exit(1);
     }
-    else {
-      // Change process capability
-      if (cap_set_proc(caps) != 0) {
-        printf("\nERROR: Failed to change capability flag\n");
-        printf("Reason: %s\n", strerror(errno));
-        exit(1);
+
+    bool more_frames = false;
+    while ((stopReason == NULL) && !receiver->closed()) {
+      // Only look for the other events when frames are left from the
+      // last wakeup, they may already be in the ring
+      int events = captureLoop.wait(more_frames ? 0 : -1);
+
+      if (more_frames || (events & LoopEvent::socket)) {
+        // Limited per wakeup so that the other events are not starved
+        // when the BSC is sending faster than we can handle
+        int n = 0;
+        while ((n < MAX_FRAMES_PER_WAKEUP) &&
+               ((frame = receiver->next_frame(frame_length)) != NULL)) {
+          handle_frame(frame, frame_length);
+          n++;
+        }
+        more_frames = (n == MAX_FRAMES_PER_WAKEUP);
       }
+      if (events & LoopEvent::tick) {
+        flush_files();
+        socketMonitor->sample();
+        print_statistics();
+      }
+      handle_stop_events(events);
     }
-    
-    if (cap_free(caps) != 0) {
-      printf("\nERROR: Failed to free capability struct\n");
-      printf("Reason: %s\n", strerror(errno));
-      exit(1);
+
+    // Handle the complete frames already read, the socket is not read
+    // any more as that could go on for as long as the BSC is sending
+    while ((frame = receiver->buffered_frame(frame_length)) != NULL) {
+      handle_frame(frame, frame_length);
+    }
+
+    // Write everything still buffered before closing the file
+    if (watchlistFiles != NULL) {
+      watchlistFiles->close();
+    }
+    if (timestampOut != NULL) {
+      writer->submit(timestampBlock, true, true);
+      timestampBlock = NULL;
+    }
+    writer->stop();
+    if (out->close() == false) {
+      printf("\nERROR: Closing the log file failed.\n"
+             "Reason: %s\n\n", strerror(errno));
+    }
+    if (writeback != NULL) {
+      writeback->stop();
+    }
+
+    if ((compressedOut != NULL) && (bytesWritten > 0)) {
+      printf("\nCompressed %lu KB to %lu KB (%lu%%)\n",
+             bytesWritten/1000, compressedOut->stored_bytes()/1000,
+             compressedOut->stored_bytes() * 100 / bytesWritten);
+    }
+    if (frameFilter != NULL) {
+      printf("\nFilter accepted %lu and dropped %lu event frames\n",
+             acceptedFrames, filteredFrames);
+    }
+    if (watchlist != NULL) {
+      printf("\nWatchlist matched %lu and dropped %lu event frames\n",
+             watchedFrames, unwatchedFrames);
+      if (watchlistFiles != NULL) {
+        printf("Matching events written to %u files\n",
+               watchlistFiles->files());
+        delete watchlistFiles;
+        watchlistFiles = NULL;
+      }
+    }
+    printf("\nLatency (ms)");
+    receiver->inter_arrival().print_summary("\nInter-arrival");
+    writer->receive_to_write().print_summary("Receive to write");
+    writer->write_latency().print_summary("Block write");
+    writer->flush_latency().print_summary("Flush");
+    if (writeback != NULL) {
+      writeback->wait_latency().print_summary("Writeback wait");
+      writeback->sync_latency().print_summary("fdatasync");
+    }
+    printf("\nSocket receive buffer %u KB, max %u KB queued, "
+           "window closed in %lu samples\n",
+           socketMonitor->receive_buffer()/1000,
+           socketMonitor->max_queued_bytes()/1000,
+           socketMonitor->zero_windows());
+
+    if (fanout != NULL) {
+      fanout->stop();
+      fanout->print_summary();
+    }
+    if (shmRing != NULL) {
+      printf("\n%lu frames published to /dev/shm/%s\n", shmRing->frames(),
+             shmName.c_str());
+      shmRing->close();
+    }
+    if (metrics != NULL) {
+      metrics->stop();
+      if (!metricsJsonName.empty()) {
+        string name = OUTPUT_DIRECTORY + metricsJsonName;
+
+        if (metrics->write_json(name)) {
+          printf("\nMetrics written to /%s%s\n",
+                 DESTINATION_DIRECTORY.c_str(), metricsJsonName.c_str());
+        }
+        else {
+          printf("\nERROR: Writing the metrics to /%s%s failed.\n"
+                 "Reason: %s\n\n", DESTINATION_DIRECTORY.c_str(),
+                 metricsJsonName.c_str(), strerror(errno));
+        }
+      }
     }
   }
-}
+  shutdown(socket_fd, SHUT_RDWR); // Shutdown socket for both reading and writing
 
+  const char *reason = stopReason;
+  if (reason != NULL) {
+    printf("\n%s\n", reason);
+    fflush(stdout);
+    exit(1);
+  }
 
-//===============================================================================
-//      Assemble TLLI as coded in the GMLog IWD
-//
-//===============================================================================
-void assemble_tlli(char *tlli_buff, char *tlli) {
-  uint32_t  tlli_int = atoi(tlli);
+  printf("\nConnection closed by BSC. Logging stopped.\n");
 
-  tlli_buff[0] = (tlli_int & 0xff00) >> 8;
-  tlli_buff[1] =  tlli_int & 0xff;
-  tlli_buff[2] = (tlli_int & 0xff000000) >> 24;
-  tlli_buff[3] = (tlli_int & 0xff0000) >> 16;
+  return 0;
 }
 
 //===============================================================================
-//      Assemble IMSI as coded in the GMLog IWD
+//      Clear the system resource capabilty bit in case we are running as
+//      root so we do not overstep any assigned quota on the file system we
+//      are writing to.
 //
 //===============================================================================
-void assemble_imsi(char *imsi_buff, const char *imsi) {
-  const int imsi_length = strlen(imsi);
+void clear_sys_resource_capability()
+{
+  // Intent is to clear the CAP_SYS_RESOURCE bit so that root user
+  // cannot override disk quota limits
   
-  // IWD specifies contents using DW16 and here we use octets, i.e.
-  //
-  // |    DW0    |     DW1     |     DW2     |     DW3     |     DW4     |
-  // +-----+-----+------+------+------+------+------+------+------+------+
-  // |  0  |  1  |   2  |   3  |   4  |   5  |   6  |   7  |   8  |   9  |
-  // +-----+-----+------+------+------+------+------+------+------+------+
-  // | b15 - b00 | b15  -  b00 | b15  -  b00 | b15  -  b00 | b15  -  b00 |
-  //             | d3 d2  d1 --| d7 d6  d5 d4|d11 d10 d9 d8|d12d13 d14d15|
-  //             | n3 n2  n1 --| n3 n2  n1 n0| n3 n2  n1 n0| n3 n2  n1 n0|
-  //
-  // DWx == Data Word x
-  // bxx == bit xx
-  // dxx == digit xx
-  // nxx == nibble xx in Data Word (nibble == 4 bit section of octet)
-
-  imsi_buff[0] = 0; // DW0, b08-b15; spare
-  imsi_buff[1] = 8; // DW0, b00-b07; length in octets
-
-  // DW1, b00-b02; type of identity to "1", i.e. IMSI
-  // DW1,     b03; odd/even flag (even = 0, odd = 1)
-  switch (imsi_length) {
-  case 14:
-    /**  Digit #1 -+        even -+       ID -+
-    //   __________|_________     |     ______|_______
-    //  /                    \    |    /              \
-    // +-----+-----+-----+-----+-----+-----+-----+-----+
-    // |  0  |  0  |  0  |  0  |  0  |  0  |  0  |  1  |
-    // +-----+-----+-----+-----+-----+-----+-----+-----+
-    //   b07   b06   b05   b04   b03   b02   b01   b00
-    **/
-    imsi_buff[3] = 0x01;
-    break;
-  case 15:
-    /**  Digit #1 -+         odd -+       ID -+
-    //   __________|_________     |     ______|______
-    //  /                    \    |    /             \
-    // +-----+-----+-----+-----+-----+-----+-----+-----+
-    // |  0  |  0  |  0  |  0  |  1  |  0  |  0  |  1  |
-    // +-----+-----+-----+-----+-----+-----+-----+-----+
-    //   b07   b06   b05   b04   b03   b02   b01   b00
-    **/
-    imsi_buff[3] = 0x09;
-    break;
-  default:
-    printf("\nERROR: Illegal IMSI length, %d characters.\n", imsi_length);
+  cap_t caps = cap_get_proc();
+
+  if (caps == NULL) {
+    printf("\nERROR: Failed to get capabilities\n");
+    printf("Reason: %s", strerror(errno));
     exit(1);
   }
+  else {
+    cap_value_t cap_list[] = { CAP_SYS_RESOURCE };
     
-  // IMSI value encoded using BCD, i.e. each digit stored as
-  // a nibble, where first BCD digit should be put in DW1, b04-b07.
-  // This translates to b04-b07 of index 3 in the buffer.
-  
-  const int32_t IMSI_OFFSET = 3; // Octet where IMSI starts in imsi_buff
-  
-  for (int offset=0, nibble=0, word=0, i=1, digit=0; i<=imsi_length; i++) {
-    word   = i/4; // Data word relative to IMSI part in buffer
-    nibble = i%4; // Nibble within word in IMSI part in buffer
-    offset = word*2 - nibble/2 + IMSI_OFFSET;
-    
-    digit = imsi[i-1]-'0'; // Convert ASCII-encoded digit to integer
-    if ((digit<0) || (digit>9)) {
-      // A non-digit character has been found; only 0-9 are valid digits
-      // in an IMSI value
-      printf("\nERROR: Position %d in IMSI contains illegal character '%c'\n\n",
-             i, imsi[i-1]);
+    // Clear capability CAP_SYS_RESOURCE
+    if (cap_set_flag(caps, CAP_EFFECTIVE,
+                     sizeof(cap_list) / sizeof(cap_list[0]),
+                     cap_list, CAP_CLEAR) != 0) {
+      printf("\nERROR: Failed to clear capability flag\n");
+      printf("Reason: %s\n", strerror(errno));
       exit(1);
     }
-
-    // BCD-encode the digit and store it within the correct nibble in
-    // the octet located at the offset in the IMSI buffer.
-    if (i%2) {
-      // We should store in MSB part of octet (b04 - b07)
-      // Due to that storing the nibble in the LSB part of the octet
-      // automatically cleared any bits in the MSB part, we just need
-      // to shift and do a logical OR to store the bits. Thus the code
-      // below is an optimized version of this code in combination with
-      // LSB part:
-      // 
-      //imsi_buff[offset] &= 0x0F; // Clear previous contents
-      //imsi_buff[offset] |= (uint8_t)(digit<<4); // Store value
-      
-      imsi_buff[offset] |= (uint8_t)(digit<<4); // Store value
-    }
     else {
-      // We should store in LSB part of octet (b00 - b03)
-      // Due to that we store the nibble in the LSB part of the octet
-      // before the nibble in the MSB part we do not need to consider
-      // any value stored in the MSB part. As a side effect we also
-      // automatically clear the bits in the MSB part of the octet,
-      // i.e. the code below is an optimized version of this code in
-      // combination with optimization done for MSB part:
-      //
-      // imsi_buff[offset] &= 0xF0; // Clear previous contents
-      // imsi_buff[offset] |= (uint8_t)(digit); // Store value
-      
-      imsi_buff[offset] = digit; // Store value
+      // Change process capability
+      if (cap_set_proc(caps) != 0) {
+        printf("\nERROR: Failed to change capability flag\n");
+        printf("Reason: %s\n", strerror(errno));
+        exit(1);
+      }
     }
-  }
-  
-  // FIXME: ????
-  if (true) {
-    printBuffer(imsi_buff, IMSI_LENGTH);
-  }
-}
-
-//===============================================================================
-//      Send request and waits for specified CMN reply
-//
-//===============================================================================
-
-int send_receive_data(char *buffer, int bytes_to_send, int socket_fd )
-{
-  int n, number_of_bytes;
-
-  //printf("\n-->send_receive_data: bytes_to_send=%d\n", bytes_to_send);
-
-  // Send a control message on channel 0
-  //printf("\n---send_receive_data: sending data\n");
-  send_buffer(buffer, bytes_to_send, socket_fd);
-
-  // Read header in reply;
-  // buffer[0] and buffer[1] encodes the length of the following message
-  // buffer[2] abd buffer[3] encodes the channel used
-  // 
-  // Channel == 0 contains answer on the control channel
-  // Channel == 2 contains event data
-  //printf("\n---send_receive_data: reading header\n");
-  n = receive_buffer(buffer, HEADER_LENGTH, socket_fd);
-  
-  // Skip any event data received on channel 2
-  while ((buffer[2] == 0) && (buffer[3] == 2)) {
-    number_of_bytes = ((unsigned char)buffer[0]*256 +
-                       (unsigned char)buffer[1])*2;
     
-    if (number_of_bytes > BUFFER_SIZE) {
-      printf("\nERROR: Reading from socket event length too long.\n"
-             "%10d bytes stated in received event, expected max %d bytes.\n",
-             number_of_bytes, BUFFER_SIZE);
+    if (cap_free(caps) != 0) {
+      printf("\nERROR: Failed to free capability struct\n");
+      printf("Reason: %s\n", strerror(errno));
       exit(1);
     }
-    // Skip the data
-    // printf("\n---send_receive_data: skipping data received on channel 2\n");
-    n = receive_buffer(buffer, number_of_bytes, socket_fd);
-    // Read next header
-    // printf("\n---send_receive_data: reading header\n");
-    n = receive_buffer(buffer, HEADER_LENGTH, socket_fd);
-  }
-  
-  if (debug) {
-    printf("\nFirst four bytes in the reply (NDW and Channel) : ");
-    for (int i = 0; i < n ; i++ ) {
-      printf("%.2x ", (unsigned char)buffer[i]);
-    }
-    printf("\n");
-    fflush(stdout);
-  }
-  
-  number_of_bytes = ((unsigned char)buffer[0]*256 +
-                     (unsigned char)buffer[1])*2;
-  
-  if (debug) {
-    printf("\nNumber of bytes in the reply message = %i\n", number_of_bytes);
-    fflush(stdout);
-  }
-  
-  if (number_of_bytes > BUFFER_SIZE) {
-    printf("\nERROR: Reading from socket event length too long.\n"
-           "%10d bytes stated in received event, expected max %d bytes.\n",
-           number_of_bytes, BUFFER_SIZE);
-    exit(1);
   }
-  
-  //printf("\n---send_receive_data: reading payload; expecting %d bytes...\n",
-  //       number_of_bytes);
-  number_of_bytes = receive_buffer(buffer, number_of_bytes, socket_fd);
-  
-  //printf("\n<--send_receive_data: number_of_bytes=%d\n", number_of_bytes);
-  return number_of_bytes;
 }
 
+
 //===============================================================================
 //      Send the buffer to the socket
 //
 //===============================================================================
-int send_buffer(char *buffer, int bytes_to_send, int socket_fd)
+int send_buffer(char *buffer, int bytes_to_send, int socket_fd, int flags)
 {
   int n, i;
 
   //printf("\n-->send_buffer: bytes_to_send=%d\n", bytes_to_send);
 
-  n = send(socket_fd, buffer, bytes_to_send, 0);
+  n = send(socket_fd, buffer, bytes_to_send, flags);
   if (n < 0) {
+    if ((flags & MSG_DONTWAIT) &&
+        ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+      return 0;
+    }
     printf("ERROR: Writing to socket\n"
            "Reason: %s\n\n", strerror(errno));
     exit(1);
   }
   
-  if (debug) {
+  if (debug && (n > 0)) {
     printf("\nSent: ");
     for ( i = 0; i < n ; i++ ) {
       printf("%.2x ", (unsigned char)buffer[i]);
@@ -983,358 +1421,1183 @@ int receive_buffer(char *buffer, const int bytes_to_receive, const int socket_fd
 }
 
 //===============================================================================
-//      Write the eventdata to the file
+//      Write the eventdata to the file. The data is queued towards the
+//      writer thread, which does the actual file I/O.
 //
 //===============================================================================
 void write_to_file(char *buffer,
                    const int number_of_bytes,
-                   uint64_t& bytesWritten)
+                   uint64_t& bytesWritten,
+                   uint64_t receive_ns)
 {
-  out.write(buffer, number_of_bytes);
-  if (out.bad()) {
-    int    len     = BASE_DIRECTORY.length()-1;
-    string subpath = filename.substr(len, filename.length());
-
-    printf("\nERROR: Write operation to log file\n"
-           "%s "
-           "failed.\n"
-           "Reason: %s\n\n", subpath.c_str(), strerror(errno));
-    exit(1);
-  }
+  writer->append(buffer, number_of_bytes, receive_ns);
   
   bytesWritten += (uint64_t)number_of_bytes;
 }
 
 //===============================================================================
-//      Send a request of the event. Packing of packet with eid and filter
+//      Send the subscription requests of all events at once and wait for
+//      the replies, i.e. one round trip whatever the number of events.
+//      The replies come in the order of the requests. Event data received
+//      meanwhile is written as any other.
+//
+//      The requests are only sent as far as the socket takes them without
+//      blocking, and what the BSC sends is read in between. Otherwise
+//      both sides could block sending to each other with full buffers,
+//      the BSC sending replies and event data that are not read.
 //
 //===============================================================================
-void request_event_subscription(int eid, int *cell_list, int socket_fd,
-                                char *msFlt, int msId, int cmd)
+void subscribe_to_events(const int *event_list, const int *cell_list,
+                         int socket_fd, const char *msFlt, int msId, int cmd)
 {
-  char *buffer;
-  int buffPos = 0;
-  
-  if ((buffer = (char *)malloc(BUFFER_SIZE)) == NULL) {
+  int   events = 0;
+  int   length = 0;
+  char *requests;
+
+  while (event_list[events] != -1) {
+    events++;
+  }
+  if ((requests = (char *)malloc(events * MAX_SUBSCRIPTION_REQUEST_LENGTH)) ==
+      NULL) {
     printf("\nOut of memory, aborting!\n\n");
     exit(1);
   }
-  // Assemble a Subscribe request
-  buffer[0] = 0;   // Length.msb
-  buffer[1] = 0;   // Length.lsb will be set later
-  buffer[2] = 0;   // Channel.msb
-  buffer[3] = 0;   // Channel.lsb
-  buffer[4] = 0;   // CMN, subscribe on events.msb
-  buffer[5] = 11;  // CMN, subscribe on events.lsb
-  buffer[6] = (uint8_t)((eid & 0xFF00) >> 8); // EID, msb
-  buffer[7] = (uint8_t)(eid & 0xFF); // EID, lsb
-  
-  // If the EID is one of the System Events, then filtering is not allowed.
-  // System Events are defined as EID between 0xFF00 and 0xFFFF, this is
-  // captured in the EID_SYSTEM_EVENT_MASK constant.
-  //
-  // But there are a also two special cases when GMLog application is used
-  // that we must check for (the trouble-shooting events for RP and CP)
-  if ((eid & EID_SYSTEM_EVENT_MASK) ||
-      ((cmd == InvokedAs::GMLog) &&
-       ((eid == GMLOG_EID_TROUBLE_SHOOTING_RP) ||
-        (eid == GMLOG_EID_TROUBLE_SHOOTING_CP)))) {
-    // This eid does not support any filter
-    buffer[8] = 0;   // cell pointer list len.msb
-    buffer[9] = 0;   // cell pointer list len.lsb
-    buffPos = 10;
-    buffer[buffPos++] = 0;  // filterlength.msb
-    buffer[buffPos++] = 0;  // filterlength.lsb
+  for (int n = 0; n < events; n++) {
+    length += build_subscription_request(requests + length, event_list[n],
+                                         cell_list, msFlt, msId, cmd);
   }
-  else {
-    // Check cell option and add cells into message
-    if (cell_list[0] == -1) {
-      // No cells, set cell pointer list length to zero.
-      // Option only available for GMLog
-      buffer[8] = 0; // msb
-      buffer[9] = 0; // lsb
-      buffPos = 10;
-    }
-    else if (cell_list[0] == 0xFFFF) {
-      // All cells. Option only available for RPMO
-      buffer[8] = 0xFF;
-      buffer[9] = 0xFF;
-      buffPos = 10;
-    }
-    else if ((cell_list[0] != -1) && (cell_list[0] != 0xFFFF)){
-      // One or several cells. Several cells only available for RPMO
-      int cellIndex = 0;
-      buffPos       = 10;
-
-      while (cell_list[cellIndex] != -1) {
-        buffer[buffPos++] = (cell_list[cellIndex] & 0xFF00) >> 8; // Cellpointer.msb
-        buffer[buffPos++] = (cell_list[cellIndex] & 0xFF);      // Cellpointer.lsb
-        cellIndex++;
+
+  printf("\nSending Event subscription requests for %d event(s)...", events);
+  fflush(stdout);
+
+  int    sent    = 0;
+  int    replies = 0;
+  int    frame_length;
+  char  *frame;
+
+  receiver->set_nonblocking(true);
+  while (replies < events) {
+    if (sent < length) {
+      sent += send_buffer(requests + sent, length - sent, socket_fd,
+                          MSG_DONTWAIT);
+    }
+
+    if ((frame = receiver->next_frame(frame_length)) == NULL) {
+      if (receiver->closed()) {
+        printf("\nERROR: Connection closed by BSC during the event "
+               "subscriptions.\n\n");
+        exit(1);
       }
-      // Set cell pointer list length
-      buffer[8] = (cellIndex & 0xFF00) >> 8; // Cellpointer list length.msb
-      buffer[9] = (cellIndex & 0xFF);        // Cellpointer list length.lsb
-    }
-
-    //If any filter on MS id active
-    switch (msId) {
-    case MsId::IMSI:
-      buffer[buffPos++] = 0;                  //filter length.msb
-      buffer[buffPos++] = IMSI_FILTER_LENGTH; //filter length.lsb in words
-      buffer[buffPos++] = 0;                  //filterid.msb
-      buffer[buffPos++] = IMSI_FILTER_ID;     //filterid.lsb,
-
-      // Copy filter into buffer
-      for (int i = 0; i < IMSI_LENGTH; i++) {
-        buffer[buffPos++] = msFlt[i];
+
+      // Wait until the BSC has sent more, or takes more requests
+      struct pollfd pfd = { socket_fd, POLLIN, 0 };
+
+      if (sent < length) {
+        pfd.events |= POLLOUT;
       }
-      break;
-    case MsId::TLLI:
-      buffer[buffPos++] = 0;                  //filter length.msb
-      buffer[buffPos++] = TLLI_FILTER_LENGTH; //filter length.lsb
-      buffer[buffPos++] = 0;                  //filterid.msb
-      buffer[buffPos++] = TLLI_FILTER_ID;     //filterid.lsb
-
-      // Copy filter into buffer
-      for (int i = 0; i < TLLI_LENGTH; i++) {
-        buffer[buffPos++] = msFlt[i];
+      poll(&pfd, 1, -1);
+      continue;
+    }
+
+    // Word 0 of a subscription reply is the CMN and word 1 the result
+    if ((frame_channel(frame) != CONTROL_CHANNEL) ||
+        (frame_length < FRAME_HEADER_LENGTH + 4) ||
+        (frame[FRAME_HEADER_LENGTH] != 0) ||
+        (frame[FRAME_HEADER_LENGTH + 1] != CMN_SUBSCRIBE)) {
+      handle_frame(frame, frame_length);
+      continue;
+    }
+
+    if ((frame[FRAME_HEADER_LENGTH + 2] != 0) ||
+        (frame[FRAME_HEADER_LENGTH + 3] != 0)) {
+      printf("\nERROR while subscribing to event %d:\n", event_list[replies]);
+      printf("%s\n", subscription_result_text(frame[FRAME_HEADER_LENGTH + 3]));
+
+      if (debug) {
+        printf("Dump of received buffer: ");
+        for (int i = 0; i < frame_length; i++) {
+          printf("%.2x ", (uint8_t)frame[i]);
+        }
+        printf("\n");
       }
-      break;
-    case MsId::none:
-      buffer[buffPos++] = 0;
-      buffer[buffPos++] = 0;
-      break;
+      fflush(stdout);
+      exit(1);
     }
+    replies++;
   }
+  receiver->set_nonblocking(false);
+  free(requests);
 
-  printf("\nSending Event subscription request for event = %i...", eid);
+  printf("ok");
   fflush(stdout);
-  
-  buffer[1] = (buffPos/2)-2; // Set length of message in words
+}
+
+//===============================================================================
+//      Count, filter, write and publish a frame received from the BSC
+//
+//===============================================================================
+void handle_frame(char *frame, int frame_length)
+{
+  numberOfEvents++;
 
-  send_receive_data(buffer, buffPos, socket_fd);
+  uint64_t handling_start = 0;
+  if (metrics != NULL) {
+    metrics->count_frame(frame, frame_length);
+    if ((numberOfEvents % METRICS_SAMPLE_INTERVAL) == 0) {
+      handling_start = monotonic_ns();
+    }
+  }
 
-  if ((buffer[2] != 0) || (buffer[3] != 0)) {
-    printf("\nERROR while subscribeing to event(s):\n");
-    switch ( buffer[3] ) {
-    case 1:
-      printf("The subscription failed for the following cells.");
-      break;
-    case 3:
-      printf("The BSC can not handle the request. Try again later.");
-      break;
-    case 4:
-      printf("The CMN is invalid.");
-      break;
-    case 6:
-      printf("The client is not connected.");
-      break;
-    case 7:
-      printf("Submitted EID is invalid.");
-      break;
-    case 8:
-      printf("Submitted Cell Pointer List is invalid.");
-      break;
-    case 9:
-      printf("The subscription failed. The reason is unknown.");
-      break;
-    case 10:
-      printf("It is not allowed to subscribe to the EID.");
-      break;
-    case 11:
-      printf("Submitted filter is invalid.");
-      break;
-    case 13:
-      printf("High load.");
-      break;
+  // Control frames are always written
+  bool    event   = (frame_channel(frame) == EVENT_CHANNEL);
+  bool    dropped = false;
+  int32_t watched = -1;
+
+  if ((frameFilter != NULL) && event) {
+    if (frameFilter->accept(frame)) {
+      acceptedFrames++;
     }
-    printf("\n");
+    else {
+      filteredFrames++;
+      dropped = true;
+    }
+  }
+  if (!dropped && (watchlist != NULL) && event &&
+      ((watched = watchlist->match(frame)) == -1)) {
+    unwatchedFrames++;
+    dropped = true;
+  }
+  if (!dropped) {
+    if (watched != -1) {
+      watchedFrames++;
+    }
+    if ((watchlistFiles != NULL) && (watched != -1)) {
+      if (!watchlistFiles->append(watched, frame, frame_length) &&
+          watchlistError.empty()) {
+        // Stopped like on a full disk, so that everything buffered is
+        // still written to the other files
+        watchlistError = "Unable to open the file /" + DESTINATION_DIRECTORY +
+                         watchlistFiles->file_name(watched).substr(
+                           OUTPUT_DIRECTORY.length()) +
+                         ". Reason: " + strerror(errno) +
+                         ". Logging stopped.";
+        stop_logging(watchlistError.c_str());
+      }
+    }
+    else {
+      if (timestampOut != NULL) {
+        TimestampRecord record = { bytesWritten,
+                                   receiver->receive_time_ns() };
 
-    if (debug) {
-      printf("Dump of received buffer: ");
-      for (int i=0, n=(buffPos/2)-2; i < n ; i++ ) {
-        printf("%.2x ", (uint8_t)buffer[i]);
+        timestampBlock = writer->append(timestampBlock,
+                                        (const char *)&record,
+                                        sizeof(record));
       }
-      printf("\n");
+      write_to_file(frame, frame_length, bytesWritten,
+                    receiver->receive_time_ns());
+    }
+    if (fanout != NULL) {
+      fanout->publish(frame, frame_length);
+    }
+    if (shmRing != NULL) {
+      shmRing->publish(frame, frame_length);
     }
-    fflush(stdout);
-    exit(1);
   }
-  else {
-    printf("ok");
+  if (handling_start != 0) {
+    metrics->frame_handling().add(monotonic_ns() - handling_start);
   }
-  fflush(stdout);
+}
+
+//===============================================================================
+//      Check that the log file name ends with .gml or .rpm
+//
+//===============================================================================
+void check_log_file_suffix(int cmd)
+{
+  string suffix_to_use = (cmd == InvokedAs::GMLog)? GMLOG_SUFFIX : RPMO_SUFFIX;
 
-  free(buffer);
+  if (((filename.length()-OUTPUT_DIRECTORY.length()) < suffix_to_use.length()) ||
+      (filename.compare(filename.size() - suffix_to_use.size(),
+                        suffix_to_use.size(), suffix_to_use) != 0)) {
+    int    len     = BASE_DIRECTORY.length()-1;
+    string subpath = filename.substr(len, filename.length());
 
-  return;
+    printf("\n%s must end with %s\n\n",
+           subpath.c_str(),
+           suffix_to_use.c_str());
+    print_usage(cmd);
+  }
 }
 
 //===============================================================================
-//      Check the result from a connection request
+//      Find a file the capture would overwrite. The compressed and v2
+//      formats add a suffix to the name. Segments of an earlier capture
+//      may have been rotated, i.e. segment 0001 may be gone while later
+//      ones are left, so any segment number is looked for.
 //
 //===============================================================================
-void check_connection_result(char result)
+string existing_log_file()
 {
-  if (result != 0) {
-    printf("\nERROR: Connection failed. ");
-    switch (result) {
-    case 2:
-      printf("The client is not authorised to connect.\n");
-      break;
-    case 3:
-      printf("The BSC can not handle the request. Try again later.\n");
-      break;
-    case 4:
-      printf("The CMN is invalid.\n");
-      break;
-    case 5:
-      printf("The client is already connected.\n");
-      break;
-    default:
-      printf("\n");
+  string      name = filename;
+  struct stat st;
+
+  if (fileFormat == Format::compressed) {
+    name += COMPRESSED_SUFFIX;
+  }
+  else if (fileFormat == Format::v2) {
+    name += INDEXED_SUFFIX;
+  }
+
+  if (maxSegments == 0) {
+    return (stat(name.c_str(), &st) != -1) ? name : string();
+  }
+
+  // e.g. <directory>/logfile_rpmo. and .rpm around the segment number
+  string first  = segment_file_name(name, 1);
+  size_t number = first.rfind(".0001") + 1;
+  size_t slash  = first.rfind('/');
+  string prefix = first.substr(slash + 1, number - slash - 1);
+  string suffix = first.substr(number + 4);
+  string found;
+  DIR   *dir    = opendir(first.substr(0, slash + 1).c_str());
+
+  if (dir == NULL) {
+    return found;
+  }
+
+  struct dirent *entry;
+
+  while ((found.empty()) && ((entry = readdir(dir)) != NULL)) {
+    string entry_name = entry->d_name;
+    size_t digits     = entry_name.length() - prefix.length() - suffix.length();
+
+    if ((entry_name.length() >= prefix.length() + suffix.length() + 4) &&
+        (entry_name.compare(0, prefix.length(), prefix) == 0) &&
+        (entry_name.compare(prefix.length() + digits, suffix.length(),
+                            suffix) == 0) &&
+        (entry_name.find_first_not_of("0123456789", prefix.length()) ==
+         prefix.length() + digits)) {
+      found = first.substr(0, slash + 1) + entry_name;
     }
-    exit(1);
   }
+  closedir(dir);
+
+  return found;
 }
 
 //===============================================================================
-//      Decode the events id arguments. Comma separated to a array of int.
+//      Ask before overwriting an existing log file
 //
 //===============================================================================
-int decode_event_list(char *events, int *event_list)
+void confirm_overwrite(int cmd)
 {
-  int index = 0;
-  char * pch;
-
-  pch = strtok(events," ,");
-  while (pch != NULL) {
-    // The atoi function below will return 0 if presented with a
-    // non-integer, and due to this we need to verify that the given
-    // event ID is an integer number
-    for (int i=0, len=strlen(pch); i<len; i++) {
-      if (!isdigit(pch[i])) {
-        // We found a non-digit number, return an error code
-        printf("\n%s is not a valid Event ID\n\n", pch);
-        return -1;
-      }
+  char   ch;
+  char   new_file_name[100];
+  string existing;
+
+  while (!(existing = existing_log_file()).empty()) {
+    printf("\nLogfile /%s%s already exists. Overwrite existing file(y/n) "
+           "or quit(q)?\n", DESTINATION_DIRECTORY.c_str(),
+           existing.substr(OUTPUT_DIRECTORY.length()).c_str());
+    scanf(" %c", &ch);
+
+    if (ch == 'n') {
+      printf("Please enter new filename + <ENTER>: \n");
+      scanf("%99s", new_file_name);
+      filename.clear();
+      filename += OUTPUT_DIRECTORY + new_file_name;
+      check_log_file_suffix(cmd);
+    }
+    else if (ch == 'y') {
+      // Overwrite existing file
+      break;
     }
-    event_list[index] = atoi(pch);
-    index++;
-    if (index == 64) {
-      printf("\nToo many Event IDs specified; max is %d.\n\n", MAX_EVENT_IDS);
-      return -1;
+    else if (ch == 'q') {
+      exit(0);
     }
-    pch = strtok (NULL, ",");
   }
-  event_list[index] = -1; //End of list indication
-  
-  return 0;
 }
 
 //===============================================================================
-//      Decode the cellpointer arguments. Comma separated to a array of int.
+//      Check the result from a connection request
 //
 //===============================================================================
-int decode_cell_list(char *cells, int *cell_list)
+void check_connection_result(char result)
 {
-  int index = 0;
-  char * pch;
-
-  pch = strtok (cells," ,");
-  while (pch != NULL) {
-    cell_list[index] = atoi(pch);
-    index++;
-    if (index == MAX_CELLS) {
-      return -1;
-    }
-    pch = strtok(NULL, ",");
+  if (result != 0) {
+    printf("\nERROR: Connection failed. %s\n", connection_result_text(result));
+    exit(1);
   }
-  cell_list[index] = -1; //End of list indication
-
-  return 0;
 }
 
 //===============================================================================
-//      Print Hex buffer
+//      Prints the statistics line, overwritten by the next one
 //
 //===============================================================================
-void printBuffer(char * buff, int len)
+void print_statistics()
 {
-  printf("Buffer: ");
-  for ( int i = 0; i < len ; i++ ) {
-    printf("%.2x ", (unsigned char)buff[i]);
+  // Number of receive system calls needed per received event, should
+  // be well below one when the BSC is sending at a high rate
+  uint64_t recv_calls     = 0;
+  double   recv_per_event = 0.0;
+  if (captureEngine != NULL) {
+    recv_calls = captureEngine->syscalls();
+  }
+  else if (receiver != NULL) {
+    recv_calls = receiver->recv_calls();
+  }
+  if (numberOfEvents > 0) {
+    recv_per_event = (double)recv_calls / (double)numberOfEvents;
+  }
+  // High water mark of the write buffer in percent and the total time
+  // the receive loop has been waiting for the disk
+  printf("Events: %10d  FileSize: %7lu KB  Recv/Event: %5.2f  "
+         "BufHWM: %3lu%%  Stall: %6lu ms",
+         numberOfEvents, log_file_size()/1000, recv_per_event,
+         writer->high_water_mark() * 100 / writer->capacity(),
+         writer->stall_time_ms());
+  if (frameFilter != NULL) {
+    printf("  Filtered: %10lu", filteredFrames);
   }
+  if (watchlist != NULL) {
+    printf("  Watched: %10lu", watchedFrames);
+  }
+  if (fanout != NULL) {
+    // Connected local consumers and frames they have missed
+    printf("  Consumers: %2u  Dropped: %8lu", fanout->subscribers(),
+           fanout->dropped_frames());
+  }
+  if (socketMonitor != NULL) {
+    // Data waiting in the socket, and how often the BSC could not send
+    printf("  RecvQ: %6u KB  ZeroWin: %5lu  RTT: %6.2f ms",
+           socketMonitor->queued_bytes()/1000, socketMonitor->zero_windows(),
+           socketMonitor->rtt_us() / 1000.0);
+  }
+  printf("\r");
   fflush(stdout);
 }
 
 //===============================================================================
-//      Quit thread function. Listens for "Q" on stdin to quit
+//      Let the writer thread flush the files, and stop when the max file
+//      size is reached
 //
 //===============================================================================
-void* quit_request_checker(void* /*pParams*/) //pParams unused
+void flush_files()
 {
-  // Setting the 6th bit (0x20) for an uppercase ASCII character
-  // results in a lowercase ASCII character. In order to simplify the
-  // check, the output from getchar() is always converted to lowercase
-  // before checking which character it is.
-  //
-  // Wait until user presses 'q' or 'Q' followed by <Enter> or <Return>
-  for (char ch=0; ch!='q'; ch=(getchar() | (char)0x20)) {
-    ;
+  writer->flush();
+  if (watchlistFiles != NULL) {
+    watchlistFiles->flush();
+  }
+  if (timestampOut != NULL) {
+    writer->submit(timestampBlock, true);
+    timestampBlock = writer->acquire(timestampOut, timestampName.c_str());
+  }
+
+  if ((maxSegments == 0) && (log_file_size() > maxFileSize)) {
+    stop_logging("Maximum file size reached. Logging stopped.");
   }
-  
-  out.close();
-  printf("\nLogging stopped by user\n");
-  exit(1);
-  
-  return NULL;
 }
 
 //===============================================================================
-//      Prints statistics periodically
+//      Stop on the quit, signal and max logging time events of the loop
 //
 //===============================================================================
-void *print_statistics(void* /*pParams*/) // pParams unused
+void handle_stop_events(int events)
 {
-  time_t start_time_sec = time(NULL);
-  while (true) {
-    printf("Events: %10d  FileSize: %7lu KB\r", numberOfEvents, bytesWritten/1000);
-    fflush(stdout);
-    
-    usleep(1000000); // Sleep for 1 second
-    
-    if ((start_time_sec + maxLoggingTime) < time(NULL)) {
-      out.close();
-      printf("\nMax logging time exceeded. Logging Stopped\n");
-      fflush(stdout);
-      exit(1);
+  if (events & LoopEvent::quit) {
+    stop_logging("Logging stopped by user");
+  }
+  if (events & LoopEvent::signal) {
+    switch (captureLoop.last_signal()) {
+    case SIGINT:
+      stop_logging("Logging stopped by SIGINT");
+      break;
+    case SIGHUP:
+      stop_logging("Logging stopped by SIGHUP");
+      break;
+    default:
+      stop_logging("Logging stopped by SIGTERM");
+      break;
     }
   }
-  
-  return NULL;
+  if (events & LoopEvent::maxTime) {
+    stop_logging("Max logging time exceeded. Logging Stopped");
+  }
 }
 
 //===============================================================================
-//      Prints usage text
+//      Housekeeping while a capture engine runs. The engine notices a stop
+//      by the reading side of the socket being shut down. The thread ends
+//      on a stop, or when woken up by the receive thread when the engine
+//      is done.
 //
 //===============================================================================
-void print_usage(int cmd)
+void* housekeeping_thread(void* /*pParams*/) // pParams unused
 {
-  // String literals are automatically concatenated
-  printf("Event Handling Client version: " VERSION "\n\n");
+  tune_thread(statsTuning, "housekeeping");
 
-  if (cmd == InvokedAs::GMLog){
-    print_gmlog_help_txt();
+  while (stopReason == NULL) {
+    int events = captureLoop.wait();
+
+    if (events & LoopEvent::wake) {
+      break;
+    }
+
+    if (events & LoopEvent::tick) {
+      flushDue = true;
+      socketMonitor->sample();
+      print_statistics();
+    }
+    handle_stop_events(events);
   }
-  else if (cmd == InvokedAs::RPMO){
+  return NULL;
+}
+
+//===============================================================================
+//      Stop logging. The receive loop is woken up by shutting down the
+//      reading side of the socket, after which it writes all buffered
+//      data and closes the file.
+//
+//===============================================================================
+void stop_logging(const char *reason)
+{
+  const char *no_reason = NULL;
+
+  // Only the first reason is reported
+  if (stopReason.compare_exchange_strong(no_reason, reason)) {
+    shutdown(socketFd, SHUT_RD);
+  }
+}
+
+//===============================================================================
+//      Collect the values shown with the metrics. The counters are only
+//      updated by the receive thread, a value read here may be slightly
+//      behind.
+//
+//===============================================================================
+void collect_metrics(vector<MetricValue>& values)
+{
+  MetricValue value;
+
+  value.type  = "counter";
+  value.name  = "evhandl_written_bytes_total";
+  value.help  = "Octets queued for writing to the log file";
+  value.value = bytesWritten;
+  values.push_back(value);
+
+  value.name  = "evhandl_recv_calls_total";
+  value.help  = "Receive system calls on the BSC socket";
+  value.value = (receiver != NULL) ? receiver->recv_calls() : 0;
+  values.push_back(value);
+
+  value.name  = "evhandl_flushes_total";
+  value.help  = "Flushes of the log file";
+  value.value = writer->flush_latency().count();
+  values.push_back(value);
+
+  value.name  = "evhandl_write_stall_seconds_total";
+  value.help  = "Time the receive loop has waited for the disk";
+  value.value = writer->stall_time_ms() / 1000.0;
+  values.push_back(value);
+
+  if (frameFilter != NULL) {
+    value.name  = "evhandl_filtered_frames_total";
+    value.help  = "Event frames dropped by the filter";
+    value.value = filteredFrames;
+    values.push_back(value);
+  }
+  if (watchlist != NULL) {
+    value.name  = "evhandl_watchlist_matched_frames_total";
+    value.help  = "Event frames carrying a watched identity";
+    value.value = watchedFrames;
+    values.push_back(value);
+
+    value.name  = "evhandl_watchlist_dropped_frames_total";
+    value.help  = "Event frames not carrying a watched identity";
+    value.value = unwatchedFrames;
+    values.push_back(value);
+  }
+  if (fanout != NULL) {
+    value.name  = "evhandl_fanout_dropped_frames_total";
+    value.help  = "Frames dropped for fan-out consumers not keeping up";
+    value.value = fanout->dropped_frames();
+    values.push_back(value);
+  }
+  if (socketMonitor != NULL) {
+    value.name  = "evhandl_socket_zero_window_samples_total";
+    value.help  = "Samples of the BSC socket with the receive window closed";
+    value.value = socketMonitor->zero_windows();
+    values.push_back(value);
+  }
+
+  value.type  = "gauge";
+  value.name  = "evhandl_file_size_bytes";
+  value.help  = "Size of the log file";
+  value.value = log_file_size();
+  values.push_back(value);
+
+  value.name  = "evhandl_write_buffer_high_water_bytes";
+  value.help  = "Max number of octets queued towards the disk";
+  value.value = writer->high_water_mark();
+  values.push_back(value);
+
+  value.name  = "evhandl_write_buffer_bytes";
+  value.help  = "Memory used to absorb disk stalls";
+  value.value = writer->capacity();
+  values.push_back(value);
+
+  if (fanout != NULL) {
+    value.name  = "evhandl_fanout_consumers";
+    value.help  = "Connected fan-out consumers";
+    value.value = fanout->subscribers();
+    values.push_back(value);
+  }
+  if (socketMonitor != NULL) {
+    value.name  = "evhandl_socket_queued_bytes";
+    value.help  = "Octets waiting in the BSC socket at the last sample";
+    value.value = socketMonitor->queued_bytes();
+    values.push_back(value);
+
+    value.name  = "evhandl_socket_rtt_seconds";
+    value.help  = "Smoothed round trip time of the BSC connection";
+    value.value = socketMonitor->rtt_us() / 1e6;
+    values.push_back(value);
+  }
+}
+
+//===============================================================================
+//      Current size of the log file, i.e. the compressed size when
+//      compressing
+//
+//===============================================================================
+uint64_t log_file_size()
+{
+  if (compressedOut != NULL) {
+    return compressedOut->stored_bytes();
+  }
+  return bytesWritten;
+}
+
+//===============================================================================
+//      Decompress a log file written with --format=compressed, e.g.
+//      logfile_rpmo.rpm.z to logfile_rpmo.rpm
+//
+//===============================================================================
+int decompress_command(int argc, char *argv[])
+{
+  if (argc != 3) {
+    printf("\nMissing arguments...\n\n");
+    print_usage(InvokedAs::unknown);
+  }
+
+  string in_name = OUTPUT_DIRECTORY + argv[2];
+  size_t length  = in_name.length();
+
+  if ((length <= OUTPUT_DIRECTORY.length() + COMPRESSED_SUFFIX.length()) ||
+      (in_name.compare(length - COMPRESSED_SUFFIX.length(),
+                       COMPRESSED_SUFFIX.length(), COMPRESSED_SUFFIX) != 0)) {
+    printf("\n%s must end with %s\n\n", argv[2], COMPRESSED_SUFFIX.c_str());
+    print_usage(InvokedAs::unknown);
+  }
+
+  string out_name = in_name.substr(0, length - COMPRESSED_SUFFIX.length());
+  struct stat st;
+
+  if (stat(out_name.c_str(), &st) != -1) {
+    printf("\n/%s%s already exists.\n\n", DESTINATION_DIRECTORY.c_str(),
+           out_name.substr(OUTPUT_DIRECTORY.length()).c_str());
+    exit(1);
+  }
+
+  printf("\nDecompressing /%s%s...", DESTINATION_DIRECTORY.c_str(), argv[2]);
+  fflush(stdout);
+
+  DecompressResult result;
+
+  if (decompress_file(in_name, out_name, result) == false) {
+    printf("failed\n");
+    printf("Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+  printf("done\n\n");
+  printf("Blocks: %u  Size: %lu KB\n", result.blocks, result.rawBytes/1000);
+
+  if (result.damagedBlocks > 0) {
+    printf("\nWARNING: %u damaged or truncated blocks skipped, %lu octets "
+           "not decompressed.\n", result.damagedBlocks, result.skippedBytes);
+    exit(1);
+  }
+  printf("\n");
+
+  return 0;
+}
+
+//===============================================================================
+//      Extract the frames of a time window and/or given events from a log
+//      file written with --format=v2
+//
+//===============================================================================
+int extract_command(int argc, char *argv[])
+{
+  ExtractFilter  filter;
+  int            event_list[MAX_EVENT_IDS];
+
+  filter.fromMs = 0;
+  filter.toMs   = UINT64_MAX;
+
+  if (argc < 4) {
+    printf("\nMissing arguments...\n\n");
+    print_usage(InvokedAs::unknown);
+  }
+
+  for (int n = 4; n < argc; n++) {
+    const char *value;
+
+    if ((value = long_option_value(argv[n], "from")) != NULL) {
+      if (!parse_time_ms(value, filter.fromMs)) {
+        printf("\n%s is not a valid time\n\n", value);
+        print_usage(InvokedAs::unknown);
+      }
+    }
+    else if ((value = long_option_value(argv[n], "to")) != NULL) {
+      if (!parse_time_ms(value, filter.toMs)) {
+        printf("\n%s is not a valid time\n\n", value);
+        print_usage(InvokedAs::unknown);
+      }
+    }
+    else if ((value = long_option_value(argv[n], "eid")) != NULL) {
+      if (decode_event_list((char *)value, event_list) != 0) {
+        print_usage(InvokedAs::unknown);
+      }
+      for (int e = 0; event_list[e] != -1; e++) {
+        filter.eids.push_back(event_list[e]);
+      }
+    }
+    else {
+      printf("\nUnknown option: %s\n\n", argv[n]);
+      print_usage(InvokedAs::unknown);
+    }
+  }
+
+  string in_name  = OUTPUT_DIRECTORY + argv[2];
+  string out_name = OUTPUT_DIRECTORY + argv[3];
+  struct stat st;
+
+  if (stat(out_name.c_str(), &st) != -1) {
+    printf("\n/%s%s already exists.\n\n", DESTINATION_DIRECTORY.c_str(),
+           argv[3]);
+    exit(1);
+  }
+
+  printf("\nExtracting from /%s%s...", DESTINATION_DIRECTORY.c_str(), argv[2]);
+  fflush(stdout);
+
+  ExtractResult result;
+
+  if (extract_frames(in_name, out_name, filter, result) == false) {
+    printf("failed\n");
+    if (errno == EINVAL) {
+      printf("Reason: Not a log file written with --format=v2\n\n");
+    }
+    else {
+      printf("Reason: %s\n\n", strerror(errno));
+    }
+    exit(1);
+  }
+  printf("done\n\n");
+  printf("Blocks read: %u of %u  Frames: %lu  Size: %lu KB\n",
+         result.blocksRead, result.blocks, result.frames, result.bytes/1000);
+  if (!result.indexed) {
+    printf("\nNote: The file has no index, it was not closed properly.\n");
+  }
+  printf("\n");
+
+  return 0;
+}
+
+//===============================================================================
+//      Capture from several BSCs listed in a target file, each to its own
+//      log file
+//
+//===============================================================================
+int multi_command(int argc, char *argv[])
+{
+  if (argc < 3) {
+    printf("\nMissing arguments...\n\n");
+    print_usage(InvokedAs::unknown);
+  }
+
+  for (int n = 3; n < argc; n++) {
+    if ((argv[n][0] != '-') || (argc == n+1)) {
+      printf("\nUnknown option: %s\n\n", argv[n]);
+      print_usage(InvokedAs::unknown);
+    }
+
+    if (argv[n][1] == 's') {
+      // Log file size option, for each file
+      n++;
+      maxFileSize = ((uint64_t)(atoi((char *)argv[n])) * 1000000ULL);
+      if (maxFileSize > MAX_FILE_SIZE) {
+        printf("\nMax supported output file size is 10000 megabytes.\n");
+        print_usage(InvokedAs::unknown);
+      }
+    }
+    else if (argv[n][1] == 'b') {
+      // Write buffer size option, shared by all files
+      n++;
+      writeBufferMb = atoi((char *)argv[n]);
+      if ((writeBufferMb == 0) || (writeBufferMb > MAX_WRITE_BUFFER_MB)) {
+        printf("\nWrite buffer size must be between 1 and %u megabytes.\n",
+               MAX_WRITE_BUFFER_MB);
+        print_usage(InvokedAs::unknown);
+      }
+    }
+    else if (argv[n][1] == 'h') {
+      // Maximum time for logging option
+      n++;
+      maxLoggingTime = (atoi((char *)argv[n]) * 60);
+      if (maxLoggingTime > MAX_LOGGING_TIME) {
+        printf("\nMax supported logging time is 60 minutes.\n");
+        print_usage(InvokedAs::unknown);
+      }
+    }
+    else {
+      printf("\nUnknown option: %s\n\n", argv[n]);
+      print_usage(InvokedAs::unknown);
+    }
+  }
+
+  string target_file = OUTPUT_DIRECTORY + argv[2];
+  FILE  *targets     = fopen(target_file.c_str(), "r");
+
+  if (targets == NULL) {
+    printf("\nUnable to open the file /%s%s\n", DESTINATION_DIRECTORY.c_str(),
+           argv[2]);
+    printf("Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+
+  MultiCapture  capture(BUFFER_SIZE, (size_t)writeBufferMb * 1024 * 1024,
+                        maxFileSize, maxLoggingTime);
+  vector<string> filenames;
+  char           line[1024];
+  int            line_number = 0;
+
+  while (fgets(line, sizeof(line), targets) != NULL) {
+    CaptureTarget target;
+
+    line_number++;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    const char *first = line + strspn(line, " \t");
+    if ((*first == '\0') || (*first == '#')) {
+      continue;
+    }
+
+    parse_capture_target(line, line_number, target);
+
+    for (size_t n = 0; n < filenames.size(); n++) {
+      if (filenames[n] == target.filename) {
+        printf("\nLine %d: %s is already used by another BSC\n\n",
+               line_number, target.displayName.c_str());
+        exit(1);
+      }
+    }
+    if (filenames.size() == MAX_CAPTURE_TARGETS) {
+      printf("\nLine %d: Too many BSCs; max is %u.\n\n", line_number,
+             MAX_CAPTURE_TARGETS);
+      exit(1);
+    }
+    filenames.push_back(target.filename);
+    capture.add_target(target);
+  }
+  fclose(targets);
+
+  if (filenames.empty()) {
+    printf("\nNo BSCs given in /%s%s\n\n", DESTINATION_DIRECTORY.c_str(),
+           argv[2]);
+    exit(1);
+  }
+
+  // Some sessions may have failed while others captured, the summary
+  // shows which
+  if (capture.run() != 0) {
+    exit(1);
+  }
+
+  return 0;
+}
+
+//===============================================================================
+//      Parse one line of a multi capture target file:
+//      gmlog|rpmo <ip> <port> <eid,eid,...> -c <cells>|-i <imsi>|-t <tlli>
+//      [-f <file>]
+//
+//===============================================================================
+void parse_capture_target(char *line, int line_number, CaptureTarget& target)
+{
+  vector<char*> words;
+  int           event_list[MAX_EVENT_IDS];
+  int           cell_list[MAX_CELLS];
+  string        name;
+
+  // Split the whole line first, the event and cell lists are decoded
+  // with strtok as well
+  for (char *word = strtok(line, " \t"); word != NULL;
+       word = strtok(NULL, " \t")) {
+    words.push_back(word);
+  }
+
+  if (words.size() < 4) {
+    printf("\nLine %d: Missing arguments...\n\n", line_number);
+    exit(1);
+  }
+
+  if (GMLOG_COMMAND_NAME == words[0]) {
+    target.cmd = InvokedAs::GMLog;
+  }
+  else if (RPMO_COMMAND_NAME == words[0]) {
+    target.cmd = InvokedAs::RPMO;
+  }
+  else {
+    printf("\nLine %d: Unknown application name %s\n\n", line_number,
+           words[0]);
+    exit(1);
+  }
+
+  target.ip   = words[1];
+  target.port = atoi(words[2]);
+  if (inet_addr(words[1]) == INADDR_NONE) {
+    printf("\nLine %d: %s is not a valid IP address\n\n", line_number,
+           words[1]);
+    exit(1);
+  }
+  if ((target.port <= 0) || (target.port > 65535)) {
+    printf("\nLine %d: %s is not a valid port\n\n", line_number, words[2]);
+    exit(1);
+  }
+
+  if (decode_event_list(words[3], event_list) != 0) {
+    printf("Line %d: Invalid Event IDs\n\n", line_number);
+    exit(1);
+  }
+  for (int e = 0; event_list[e] != -1; e++) {
+    target.events.push_back(event_list[e]);
+  }
+
+  target.msId  = MsId::none;
+  cell_list[0] = -1;
+
+  for (size_t n = 4; n < words.size(); n++) {
+    if ((words[n][0] != '-') || (words[n][1] == '\0') ||
+        (words[n][2] != '\0') || (n+1 == words.size())) {
+      printf("\nLine %d: Unknown option: %s\n\n", line_number, words[n]);
+      exit(1);
+    }
+
+    char *value = words[++n];
+
+    switch (words[n-1][1]) {
+    case 'c':
+    case 'i':
+    case 't':
+      if ((target.msId != MsId::none) || (cell_list[0] != -1)) {
+        printf("\nLine %d: One and only one of options: -t, -i, -c shall be "
+               "given.\n\n", line_number);
+        exit(1);
+      }
+      if ((words[n-1][1] != 'c') && (target.cmd != InvokedAs::GMLog)) {
+        printf("\nLine %d: IMSI and TLLI only allowed for GMLog.\n\n",
+               line_number);
+        exit(1);
+      }
+      if (words[n-1][1] == 'c') {
+        if (decode_cell_list(value, cell_list) != 0) {
+          printf("\nLine %d: Too many cells specified in the cell list; max "
+                 "is %d.\n\n", line_number, MAX_CELLS);
+          exit(1);
+        }
+      }
+      else if (words[n-1][1] == 'i') {
+        int length = strlen(value);
+
+        if ((length < 14) || (length > 15)) {
+          printf("\nLine %d: %d digits in given IMSI value. 14 or 15 digits "
+                 "shall be used.\n\n", line_number, length);
+          exit(1);
+        }
+        target.msId = MsId::IMSI;
+        assemble_imsi(target.msIdBuff, value);
+      }
+      else {
+        if (strlen(value) > 10) {
+          printf("\nLine %d: Too many digits in given TLLI value. Up to 10 "
+                 "digits shall be used.\n\n", line_number);
+          exit(1);
+        }
+        target.msId = MsId::TLLI;
+        assemble_tlli(target.msIdBuff, value);
+      }
+      break;
+
+    case 'f':
+      name = value;
+      break;
+
+    default:
+      printf("\nLine %d: Unknown option: %s\n\n", line_number, words[n-1]);
+      exit(1);
+    }
+  }
+
+  if ((target.cmd == InvokedAs::RPMO) && (cell_list[0] == -1)) {
+    printf("\nLine %d: Cell option -c is mandatory for RPMO\n\n",
+           line_number);
+    exit(1);
+  }
+  if ((target.cmd == InvokedAs::GMLog) && (target.msId == MsId::none) &&
+      (cell_list[0] == -1)) {
+    printf("\nLine %d: One and only one of options: -t, -i, -c shall be "
+           "given.\n\n", line_number);
+    exit(1);
+  }
+  for (int c = 0; ; c++) {
+    target.cells.push_back(cell_list[c]);
+    if (cell_list[c] == -1) {
+      break;
+    }
+  }
+
+  string suffix = (target.cmd == InvokedAs::GMLog) ? GMLOG_SUFFIX : RPMO_SUFFIX;
+
+  if (name.empty()) {
+    name = "logfile_" + string(words[0]) + "_" + target.ip + "_" +
+           words[2] + suffix;
+  }
+  else if ((name.length() <= suffix.length()) ||
+           (name.compare(name.length() - suffix.length(), suffix.length(),
+                         suffix) != 0)) {
+    printf("\nLine %d: /%s%s must end with %s\n\n", line_number,
+           DESTINATION_DIRECTORY.c_str(), name.c_str(), suffix.c_str());
+    exit(1);
+  }
+
+  target.filename    = OUTPUT_DIRECTORY + name;
+  target.displayName = "/" + DESTINATION_DIRECTORY + name;
+
+  struct stat st;
+  if (stat(target.filename.c_str(), &st) != -1) {
+    printf("\nLine %d: %s already exists.\n\n", line_number,
+           target.displayName.c_str());
+    exit(1);
+  }
+}
+
+//===============================================================================
+//      Print frame statistics per channel, Event ID and control message of
+//      a raw log file, i.e. a .gml or .rpm file
+//
+//===============================================================================
+int analyze_command(int argc, char *argv[])
+{
+  uint32_t threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (argc < 3) {
+    printf("\nMissing arguments...\n\n");
+    print_usage(InvokedAs::unknown);
+  }
+
+  for (int n = 3; n < argc; n++) {
+    const char *value;
+
+    if ((value = long_option_value(argv[n], "threads")) != NULL) {
+      threads = atoi(value);
+      if ((threads == 0) || (threads > MAX_ANALYZE_THREADS)) {
+        printf("\nNumber of threads must be between 1 and %u.\n\n",
+               MAX_ANALYZE_THREADS);
+        print_usage(InvokedAs::unknown);
+      }
+    }
+    else {
+      printf("\nUnknown option: %s\n\n", argv[n]);
+      print_usage(InvokedAs::unknown);
+    }
+  }
+
+  // Compressed and v2 files have blocks between the frames
+  string name   = argv[2];
+  size_t length = name.length();
+  if (((length <= GMLOG_SUFFIX.length()) ||
+       (name.compare(length - GMLOG_SUFFIX.length(), GMLOG_SUFFIX.length(),
+                     GMLOG_SUFFIX) != 0)) &&
+      ((length <= RPMO_SUFFIX.length()) ||
+       (name.compare(length - RPMO_SUFFIX.length(), RPMO_SUFFIX.length(),
+                     RPMO_SUFFIX) != 0))) {
+    printf("\n%s must end with %s or %s\n\n", argv[2], GMLOG_SUFFIX.c_str(),
+           RPMO_SUFFIX.c_str());
+    print_usage(InvokedAs::unknown);
+  }
+
+  printf("\nAnalyzing /%s%s...", DESTINATION_DIRECTORY.c_str(), argv[2]);
+  fflush(stdout);
+
+  struct timespec start, stop;
+  AnalyzeResult   result;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (analyze_file(OUTPUT_DIRECTORY + name, BUFFER_SIZE, threads,
+                   result) == false) {
+    printf("failed\n");
+    printf("Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+
+  printf("done\n\n");
+  printf("Size: %lu KB  Frames: %lu  Threads: %u  Time: %.2f s\n",
+         result.fileSize/1000, result.total.frames, result.threads,
+         (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9);
+
+  printf("\nChannel        Frames          KB\n");
+  for (map<int, FrameCount>::const_iterator it = result.channels.begin();
+       it != result.channels.end(); ++it) {
+    printf("%7d  %12lu  %10lu  %s\n", it->first, it->second.frames,
+           it->second.bytes/1000,
+           (it->first == CONTROL_CHANNEL) ? "Control" :
+           (it->first == EVENT_CHANNEL) ? "Event" : "");
+  }
+
+  printf("\nEvent ID       Frames          KB  Avg octets\n");
+  for (uint32_t eid = 0; eid < EVENT_ID_COUNT; eid++) {
+    const FrameCount& count = result.events[eid];
+
+    if (count.frames > 0) {
+      printf("%8u  %11lu  %10lu  %10lu\n", eid, count.frames,
+             count.bytes/1000, count.bytes/count.frames);
+    }
+  }
+
+  if (!result.controlMessages.empty()) {
+    printf("\nCMN  Result       Frames\n");
+    for (map<pair<int, int>, uint64_t>::const_iterator it =
+           result.controlMessages.begin();
+         it != result.controlMessages.end(); ++it) {
+      int         cmn    = it->first.first;
+      int         code   = it->first.second;
+      const char *text   = "";
+
+      if (code == -1) {
+        text = "Request";
+      }
+      else if (code == 0) {
+        text = "Accepted";
+      }
+      else if (cmn == CMN_CONNECT) {
+        text = connection_result_text(code & 0xFF);
+      }
+      else if (cmn == CMN_SUBSCRIBE) {
+        text = subscription_result_text(code & 0xFF);
+      }
+
+      if (code == -1) {
+        printf("%3d  %6s  %11lu  %s\n", cmn, "-", it->second, text);
+      }
+      else {
+        printf("%3d  %6d  %11lu  %s\n", cmn, code, it->second, text);
+      }
+    }
+  }
+
+  if (result.invalidOffset < result.fileSize) {
+    printf("\nWARNING: Invalid frame header at offset %lu, the rest of the "
+           "file was not analyzed.\n", result.invalidOffset);
+  }
+  if (result.truncatedBytes > 0) {
+    printf("\nWARNING: The last frame is truncated, %lu octets.\n",
+           result.truncatedBytes);
+  }
+  printf("\n");
+
+  return 0;
+}
+
+//===============================================================================
+//      Convert a local time YYYY-MM-DDTHH:MM:SS to ms since the Epoch
+//
+//===============================================================================
+bool parse_time_ms(const char *value, uint64_t& time_ms)
+{
+  struct tm   tm;
+  const char *end;
+
+  memset(&tm, 0, sizeof(tm));
+  end = strptime(value, "%Y-%m-%dT%H:%M:%S", &tm);
+  if ((end == NULL) || (*end != '\0')) {
+    return false;
+  }
+
+  tm.tm_isdst = -1;  // Let mktime decide on daylight saving time
+  time_t seconds = mktime(&tm);
+  if (seconds == (time_t)-1) {
+    return false;
+  }
+
+  time_ms = (uint64_t)seconds * 1000ULL;
+  return true;
+}
+
+//===============================================================================
+//      Return the value of a long option given as --<name>=<value>
+//
+//===============================================================================
+const char* long_option_value(const char *arg, const char *name)
+{
+  size_t length = strlen(name);
+
+  if ((strncmp(arg, "--", 2) == 0) &&
+      (strncmp(arg + 2, name, length) == 0) &&
+      (arg[2 + length] == '=')) {
+    return arg + 2 + length + 1;
+  }
+  return NULL;
+}
+
+//===============================================================================
+//      Prints usage text
+//
+//===============================================================================
+void print_usage(int cmd)
+{
+  // String literals are automatically concatenated
+  printf("Event Handling Client version: " VERSION "\n\n");
+
+  if (cmd == InvokedAs::GMLog){
+    print_gmlog_help_txt();
+  }
+  else if (cmd == InvokedAs::RPMO){
     print_rpmo_help_txt();
   }
   else {
     printf("Event Handling Client invoked using unknown application name\n\n");
     printf("Please use one of:\n");
     printf("evhandlclient gmlog <options>\n");
-    printf("evhandlclient rpmo <options>\n\n");
+    printf("evhandlclient rpmo <options>\n");
+    printf("evhandlclient decompress <file>\n");
+    printf("evhandlclient extract <file> <outFile> [--from=<time>] [--to=<time>]\n"
+           "                      [--eid=<eid,eid,...>]\n\n");
+    printf("evhandlclient multi <targetFile> [-s <maxFileSize>] "
+           "[-h <maxLoggingTime>]\n"
+           "                    [-b <writeBuffer>]\n");
+    printf("evhandlclient analyze <file> [--threads=<threads>]\n\n");
+    printf("<time>            Local time as YYYY-MM-DDTHH:MM:SS\n");
+    printf("<targetFile>      One BSC per line, as\n"
+           "                  gmlog|rpmo <ip> <port> <eid,eid,...> "
+           "-c <cells>|-i <imsi>|-t <tlli> [-f <file>]\n"
+           "                  Empty lines and lines starting with # are "
+           "ignored.\n"
+           "                  <maxFileSize> applies to each file.\n");
+    printf("<threads>         Threads used to analyze the file, default is one\n"
+           "                  per CPU (max %u)\n\n", MAX_ANALYZE_THREADS);
   }
 
   exit(1);
@@ -1347,11 +2610,35 @@ void print_usage(int cmd)
 void print_gmlog_help_txt()
 {
   printf("gmlog <ip> <port> <eid,eid,...> -c <cellind>\n"
-         "      [-f <file>] [-s <maxFileSize>] [-h <maxLoggingTime>]\n");
+         "      [-f <file>] [-s <maxFileSize>] [-h <maxLoggingTime>]\n"
+         "      [-b <writeBuffer>] [--engine=<engine>] [--writer=<writer>]\n"
+         "      [--segments=<segments>] [--format=<format>]\n"
+         "      [--fanout=<socket>] [--shm=<name>] [--filter=<filter>]\n"
+         "      [--watchlist=<watchlist>] [--watchlist-output=<output>]\n"
+         "      [--metrics=<endpoint>] [--metrics-json=<json>]\n"
+         "      [--timestamps=<timestamps>] [--writeback=<window>]\n"
+         "      [--fdatasync=<syncInterval>] [--tune=<profile>]\n"
+         "      [--pin=<cpus>] [--sched=<sched>] [--ioprio=<ioprio>]\n");
   printf("gmlog <ip> <port> <eid,eid,...> -i <imsi>\n"
-         "      [-f <file>] [-s <maxFileSize>] [-h <maxLoggingTime>]\n");
+         "      [-f <file>] [-s <maxFileSize>] [-h <maxLoggingTime>]\n"
+         "      [-b <writeBuffer>] [--engine=<engine>] [--writer=<writer>]\n"
+         "      [--segments=<segments>] [--format=<format>]\n"
+         "      [--fanout=<socket>] [--shm=<name>] [--filter=<filter>]\n"
+         "      [--watchlist=<watchlist>] [--watchlist-output=<output>]\n"
+         "      [--metrics=<endpoint>] [--metrics-json=<json>]\n"
+         "      [--timestamps=<timestamps>] [--writeback=<window>]\n"
+         "      [--fdatasync=<syncInterval>] [--tune=<profile>]\n"
+         "      [--pin=<cpus>] [--sched=<sched>] [--ioprio=<ioprio>]\n");
   printf("gmlog <ip> <port> <eid,eid,...> -t <tlli>\n"
-         "      [-f <file>] [-s <maxFileSize>] [-h <maxLoggingTime>]\n");
+         "      [-f <file>] [-s <maxFileSize>] [-h <maxLoggingTime>]\n"
+         "      [-b <writeBuffer>] [--engine=<engine>] [--writer=<writer>]\n"
+         "      [--segments=<segments>] [--format=<format>]\n"
+         "      [--fanout=<socket>] [--shm=<name>] [--filter=<filter>]\n"
+         "      [--watchlist=<watchlist>] [--watchlist-output=<output>]\n"
+         "      [--metrics=<endpoint>] [--metrics-json=<json>]\n"
+         "      [--timestamps=<timestamps>] [--writeback=<window>]\n"
+         "      [--fdatasync=<syncInterval>] [--tune=<profile>]\n"
+         "      [--pin=<cpus>] [--sched=<sched>] [--ioprio=<ioprio>]\n");
   printf("\n");
   printf("<ip>              IP address is found with BSC MML command: RRAPP:APL=GML\n");
   printf("<port>            Port is found with BSC MML command: RRPPP:APL=GML\n");
@@ -1362,12 +2649,15 @@ void print_gmlog_help_txt()
          "                  max is 1000 MB\n");
   printf("<maxLoggingTime>  Automatically stop after specified amount of minutes,\n"
          "                  max is 60 minutes\n");
+  print_capture_options_help_txt();
   printf("<cellind>         Cell indicator to subscribe to.\n");
   printf("<imsi>            IMSI to subscribe to (14 or 15 digits)\n");
   printf("<tlli>            TLLI to subscribe to\n");
   printf("\n");
-  printf("file, maxFileSize (MB) and maxLoggingTime (Minutes) are optional\n");
-  printf("Default values are logfile_gmlog.gml, 10GB, 1Hour, respectively\n");
+  printf("file, maxFileSize (MB), maxLoggingTime (Minutes) and writeBuffer (MB)\n"
+         "are optional\n");
+  printf("Default values are logfile_gmlog.gml, 10GB, 1Hour, %uMB, respectively\n",
+         DEFAULT_WRITE_BUFFER_MB);
   printf("\n");
   printf("Output file located in /%s\n", DESTINATION_DIRECTORY.c_str());
   printf("\n");
@@ -1380,6 +2670,87 @@ void print_gmlog_help_txt()
   printf("\n");
   printf("For Event ID list information, please see GMLog IWD\n\n");
 }
+//===============================================================================
+//      Prints help text for the options tuning the capture
+//
+//===============================================================================
+void print_capture_options_help_txt()
+{
+  printf("<writeBuffer>     Memory in MB used to absorb disk stalls, max is %u MB\n",
+         MAX_WRITE_BUFFER_MB);
+  printf("<engine>          Capture engine, default, uring or splice. uring uses\n"
+         "                  Linux io_uring, splice moves the data to the file\n"
+         "                  without copying it (best for large events). Falls back\n"
+         "                  to default if not supported\n");
+  printf("<writer>          File writer used with the default engine, default,\n"
+         "                  direct or mmap. direct preallocates maxFileSize and\n"
+         "                  writes with O_DIRECT, bypassing the page cache. mmap\n"
+         "                  copies into a mapping of the file, 64 MB at a time\n");
+  printf("<segments>        Log to numbered segment files, starting a new segment\n"
+         "                  at maxFileSize or maxLoggingTime and keeping only the\n"
+         "                  newest <segments> files (max %u). Logging then goes on\n"
+         "                  until stopped by the user\n", MAX_SEGMENTS);
+  printf("<format>          Log file format, raw, compressed or v2. compressed\n"
+         "                  writes independently compressed blocks to <file>.z,\n"
+         "                  use evhandlclient decompress <file>.z to get <file>.\n"
+         "                  v2 writes <file>.v2 with a time and Event ID index,\n"
+         "                  use evhandlclient extract to get frames from it\n");
+  printf("<socket>          Name of a Unix domain socket created in the output\n"
+         "                  directory. Local consumers connecting to it receive\n"
+         "                  the event frames as written to the file. Frames are\n"
+         "                  dropped for a consumer not keeping up, the capture\n"
+         "                  is never slowed down\n");
+  printf("<name>            Publish the event frames in a shared memory ring\n"
+         "                  /dev/shm/<name> for local readers using\n"
+         "                  evhandl_shm_reader.h. The oldest frames are\n"
+         "                  overwritten, readers detect missed frames from\n"
+         "                  the frame sequence numbers\n");
+  printf("<filter>          Only write event frames matching the filter, e.g.\n"
+         "                  --filter=\"eid in 1,2 and word[3] in 10-12 and len >= 64\"\n"
+         "                  Fields are eid, len (octets), channel and word[N]\n"
+         "                  (data word N, word[0] is the Event ID). Operators\n"
+         "                  are == != < <= > >= and in, combined with and, or,\n"
+         "                  not and parentheses\n");
+  printf("<watchlist>       Only write event frames carrying one of the IMSIs\n"
+         "                  (14 or 15 digits) or TLLIs (up to 10 digits) listed\n"
+         "                  one per line in the file <watchlist>. Subscribe with\n"
+         "                  -c to get the events of all subscribers in the cells\n");
+  printf("<output>          Watchlist output, merged or split. split writes the\n"
+         "                  events of each subscriber to a file of its own, e.g.\n"
+         "                  logfile_gmlog.<IMSI>.gml\n");
+  printf("<endpoint>        Serve live metrics over HTTP in the Prometheus text\n"
+         "                  format on [<address>:]<port>, e.g. --metrics=9100\n"
+         "                  for http://127.0.0.1:9100/metrics. Frames, octets\n"
+         "                  and rates per Event ID and channel, write and flush\n"
+         "                  latencies and the values shown in the statistics\n");
+  printf("<json>            Write the metrics as JSON to the file <json> in the\n"
+         "                  output directory when the capture ends\n");
+  printf("<timestamps>      Write the kernel receive time and stream offset of\n"
+         "                  each frame written to the file <timestamps> in the\n"
+         "                  output directory, see evhandl_timestamps.h\n");
+  printf("<window>          Start writing each <window> MB of the log file to\n"
+         "                  disk as soon as written, and drop it from the page\n"
+         "                  cache once on disk (max %u MB)\n",
+         MAX_WRITEBACK_WINDOW_MB);
+  printf("<syncInterval>    Call fdatasync() on the log file every <syncInterval>\n"
+         "                  seconds, from a thread of its own\n");
+  printf("<profile>         Socket tuning, none, throughput or latency.\n"
+         "                  throughput sets a %u MB receive buffer and\n"
+         "                  TCP_QUICKACK, so that the BSC is not held back by\n"
+         "                  the TCP window (High load). latency also busy\n"
+         "                  polls for data for %d us\n",
+         TUNED_RECEIVE_BUFFER / (1024 * 1024), TUNED_BUSY_POLL_US);
+  printf("<cpus>            CPUs to run the receive loop, the writer and the\n"
+         "                  statistics on, e.g. 2,3,1. - leaves a thread free\n"
+         "                  to migrate, e.g. -,3\n");
+  printf("<sched>           Scheduling of the receive loop and the writer,\n"
+         "                  fifo:<priority>, rr:<priority> or nice:<value>.\n"
+         "                  fifo and rr need the CAP_SYS_NICE capability\n");
+  printf("<ioprio>          I/O priority of the writer, rt:<level>, be:<level>\n"
+         "                  or idle, e.g. be:7 to leave the disk to the AP\n"
+         "                  services first\n");
+}
+
 //===============================================================================
 //      Prints R-PMO help text
 //
@@ -1387,9 +2758,25 @@ void print_gmlog_help_txt()
 void print_rpmo_help_txt()
 {
   printf("rpmo <ip> <port> <eid,eid,...> -c <cellind>\n"
-         "     [-f <file>] [-s <maxFileSize>] [-h <maxLoggingTime>]\n");
+         "     [-f <file>] [-s <maxFileSize>] [-h <maxLoggingTime>]\n"
+         "     [-b <writeBuffer>] [--engine=<engine>] [--writer=<writer>]\n"
+         "     [--segments=<segments>] [--format=<format>]\n"
+         "     [--fanout=<socket>] [--shm=<name>] [--filter=<filter>]\n"
+         "     [--watchlist=<watchlist>] [--watchlist-output=<output>]\n"
+         "     [--metrics=<endpoint>] [--metrics-json=<json>]\n"
+         "     [--timestamps=<timestamps>] [--writeback=<window>]\n"
+         "     [--fdatasync=<syncInterval>] [--tune=<profile>]\n"
+         "     [--pin=<cpus>] [--sched=<sched>] [--ioprio=<ioprio>]\n");
   printf("rpmo <ip> <port> <eid,eid,...> -c <all>\n"
-         "     [-f <file>] [-s <maxFileSize>] [-h <maxLoggingTime>]\n");
+         "     [-f <file>] [-s <maxFileSize>] [-h <maxLoggingTime>]\n"
+         "     [-b <writeBuffer>] [--engine=<engine>] [--writer=<writer>]\n"
+         "     [--segments=<segments>] [--format=<format>]\n"
+         "     [--fanout=<socket>] [--shm=<name>] [--filter=<filter>]\n"
+         "     [--watchlist=<watchlist>] [--watchlist-output=<output>]\n"
+         "     [--metrics=<endpoint>] [--metrics-json=<json>]\n"
+         "     [--timestamps=<timestamps>] [--writeback=<window>]\n"
+         "     [--fdatasync=<syncInterval>] [--tune=<profile>]\n"
+         "     [--pin=<cpus>] [--sched=<sched>] [--ioprio=<ioprio>]\n");
   printf("\n");
   printf("<ip>              IP address is found with BSC MML command: RRAPP:APL=RPM\n");
   printf("<port>            Port is found with BSC MML command: RRPPP:APL=RPM\n");
@@ -1400,12 +2787,15 @@ void print_rpmo_help_txt()
          "                  max is 1000 MB\n");
   printf("<maxLoggingTime>  Automatically stop after specified amount of minutes,\n"
          "                  max is 60 minutes\n");
+  print_capture_options_help_txt();
   printf("<cellind>         List of cell indicators to subscribe to (max %d)\n",
          MAX_CELLS);
   printf("<all>             Cell indicator 65535 used for selecting all cells\n");
   printf("\n");
-  printf("file, maxFileSize (MB) and maxLoggingTime (Minutes) are optional\n");
-  printf("Default values are logfile_rpmo.rpm, 10GB, and 1 Hour, respectively\n");
+  printf("file, maxFileSize (MB), maxLoggingTime (Minutes) and writeBuffer (MB)\n"
+         "are optional\n");
+  printf("Default values are logfile_rpmo.rpm, 10GB, 1 Hour, and %uMB, respectively\n",
+         DEFAULT_WRITE_BUFFER_MB);
   printf("\n");
   printf("Output file located in /%s\n", DESTINATION_DIRECTORY.c_str());
   printf("\n");
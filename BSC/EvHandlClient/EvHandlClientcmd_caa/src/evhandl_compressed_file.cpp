@@ -0,0 +1,228 @@
+/*
+ *
+ * NAME: evhandl_compressed_file.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Compressed log files, see evhandl_compressed_file.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "evhandl_compressed_file.h"
+#include "evhandl_little_endian.h"
+#include "evhandl_lz4.h"
+
+using namespace std;
+
+
+static const char  BLOCK_MAGIC[4] = { 'E', 'H', 'Z', '1' };
+
+//===============================================================================
+//      Adler-32 checksum
+//
+//===============================================================================
+static uint32_t adler32(const char *data, size_t length)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  uint32_t       a = 1;
+  uint32_t       b = 0;
+
+  while (length > 0) {
+    // Max octets before the sums must be reduced to avoid overflow
+    size_t chunk = (length < 5552) ? length : 5552;
+
+    length -= chunk;
+    while (chunk-- > 0) {
+      a += *p++;
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return (b << 16) | a;
+}
+
+
+//===============================================================================
+//      CompressedOutputFile
+//
+//===============================================================================
+CompressedOutputFile::CompressedOutputFile(OutputFile *file)
+  : file(file),
+    storedBytes(0)
+{
+}
+
+CompressedOutputFile::~CompressedOutputFile()
+{
+  delete file;
+}
+
+bool CompressedOutputFile::open(const string& name)
+{
+  return file->open(name);
+}
+
+//===============================================================================
+//      Compress the frames into one block. Frames that do not compress are
+//      stored as is.
+//
+//===============================================================================
+bool CompressedOutputFile::write(const char *data, size_t length)
+{
+  size_t needed = COMPRESSED_BLOCK_HEADER_LENGTH + lz4_compress_bound(length);
+
+  if (length == 0) {
+    return true;
+  }
+  if (block.size() < needed) {
+    block.resize(needed);
+  }
+
+  char   *stored = &block[COMPRESSED_BLOCK_HEADER_LENGTH];
+  size_t  stored_length = lz4_compress(data, length, stored, length - 1);
+
+  if (stored_length == 0) {
+    memcpy(stored, data, length);
+    stored_length = length;
+  }
+
+  memcpy(&block[0], BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+  put32(&block[4],  (uint32_t)length);
+  put32(&block[8],  (uint32_t)stored_length);
+  put32(&block[12], adler32(stored, stored_length));
+
+  storedBytes += COMPRESSED_BLOCK_HEADER_LENGTH + stored_length;
+
+  return file->write(&block[0], COMPRESSED_BLOCK_HEADER_LENGTH + stored_length);
+}
+
+bool CompressedOutputFile::flush()
+{
+  return file->flush();
+}
+
+bool CompressedOutputFile::close()
+{
+  return file->close();
+}
+
+
+//===============================================================================
+//      Decompress a file. The input file is mapped into memory, making it
+//      simple to search for the next block after a damaged one.
+//
+//===============================================================================
+bool decompress_file(const string& in_name, const string& out_name,
+                     DecompressResult& result)
+{
+  struct stat  st;
+  int          fd = open(in_name.c_str(), O_RDONLY);
+
+  memset(&result, 0, sizeof(result));
+
+  if (fd < 0) {
+    return false;
+  }
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+
+  size_t      size = st.st_size;
+  const char *in   = NULL;
+
+  if (size > 0) {
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    in = (const char *)mapped;
+    madvise(mapped, size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  StreamOutputFile  out;
+  vector<char>      raw;
+  bool              ok = out.open(out_name);
+  size_t            pos = 0;
+
+  while (ok && (pos + COMPRESSED_BLOCK_HEADER_LENGTH <= size)) {
+    const char *header        = in + pos;
+    uint32_t    raw_length    = get32(header + 4);
+    uint32_t    stored_length = get32(header + 8);
+    const char *stored        = header + COMPRESSED_BLOCK_HEADER_LENGTH;
+    bool        valid         =
+      (memcmp(header, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) == 0) &&
+      (raw_length <= MAX_COMPRESSED_BLOCK_RAW_LENGTH) &&
+      (stored_length <= raw_length) &&
+      (stored_length <= size - pos - COMPRESSED_BLOCK_HEADER_LENGTH) &&
+      (adler32(stored, stored_length) == get32(header + 12));
+
+    if (valid) {
+      if (stored_length == raw_length) {
+        ok = out.write(stored, raw_length);
+      }
+      else {
+        if (raw.size() < raw_length) {
+          raw.resize(raw_length);
+        }
+        valid = (lz4_decompress(stored, stored_length, &raw[0], raw_length) ==
+                 (long)raw_length);
+        if (valid) {
+          ok = out.write(&raw[0], raw_length);
+        }
+      }
+    }
+
+    if (valid) {
+      result.blocks++;
+      result.rawBytes += raw_length;
+      pos += COMPRESSED_BLOCK_HEADER_LENGTH + stored_length;
+      continue;
+    }
+
+    // Continue with the next block found
+    const char *next = (const char *)memmem(in + pos + 1, size - pos - 1,
+                                            BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+    size_t      next_pos = (next != NULL) ? (size_t)(next - in) : size;
+
+    result.damagedBlocks++;
+    result.skippedBytes += next_pos - pos;
+    pos = next_pos;
+  }
+  result.skippedBytes += size - pos;
+
+  if (size > 0) {
+    munmap((void *)in, size);
+  }
+
+  if (!ok) {
+    int saved_errno = errno;
+
+    out.close();
+    errno = saved_errno;
+    return false;
+  }
+  return out.close();
+}
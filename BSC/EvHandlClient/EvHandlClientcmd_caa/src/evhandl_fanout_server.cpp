@@ -0,0 +1,521 @@
+/*
+ *
+ * NAME: evhandl_fanout_server.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Local fan-out of the received frames, see evhandl_fanout_server.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "evhandl_fanout_server.h"
+#include "evhandl_frame.h"
+
+using namespace std;
+
+
+// Time allowed for sending what is queued to the consumers when stopping
+const time_t  FANOUT_DRAIN_TIME_SEC = 2;
+
+const int     MAX_FANOUT_EPOLL_EVENTS = 16;
+
+struct FanoutSubscriber {
+  uint32_t           id;          // Order of connection, starting at 1
+  int                fd;          // -1 when disconnected
+  bool               wantOutput;  // EPOLLOUT requested
+  std::vector<char>  queue;
+  size_t             queueHead;   // Next octet to send
+  size_t             queueTail;   // Next octet to fill in
+  uint64_t           frames;      // Frames queued
+  uint64_t           dropped;     // Frames dropped, queue full
+};
+
+// Copy into a ring of a power of two size, wrapping at the end
+static void ring_copy_in(vector<char>& ring, size_t pos, const char *src,
+                         size_t length)
+{
+  size_t start = pos & (ring.size() - 1);
+  size_t first = ring.size() - start;
+
+  if (first >= length) {
+    memcpy(&ring[start], src, length);
+  }
+  else {
+    memcpy(&ring[start], src, first);
+    memcpy(&ring[0], src + first, length - first);
+  }
+}
+
+// Copy from one ring into another, both of a power of two size
+static void ring_copy(vector<char>& to, size_t to_pos,
+                      const vector<char>& from, size_t from_pos,
+                      size_t length)
+{
+  size_t start = from_pos & (from.size() - 1);
+  size_t first = from.size() - start;
+
+  if (first >= length) {
+    ring_copy_in(to, to_pos, &from[start], length);
+  }
+  else {
+    ring_copy_in(to, to_pos, &from[start], first);
+    ring_copy_in(to, to_pos + first, &from[0], length - first);
+  }
+}
+
+
+FanoutServer::FanoutServer()
+  : listenFd(-1),
+    epollFd(-1),
+    wakeFd(-1),
+    started(false),
+    ring(FANOUT_HANDOFF_SIZE),
+    mask(FANOUT_HANDOFF_SIZE - 1),
+    head(0),
+    tail(0),
+    sleeping(false),
+    stopping(false),
+    subscriberCount(0),
+    droppedFrames(0),
+    handoffDrops(0)
+{
+}
+
+FanoutServer::~FanoutServer()
+{
+  for (size_t n = 0; n < subscriberList.size(); n++) {
+    delete subscriberList[n];
+  }
+}
+
+//===============================================================================
+//      Create the listening Unix domain socket
+//
+//===============================================================================
+bool FanoutServer::open(const string& socket_path)
+{
+  struct sockaddr_un address;
+  struct stat        st;
+
+  if (socket_path.length() >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+
+  // Only replace a socket, never a log file given by mistake
+  if (lstat(socket_path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      errno = EEXIST;
+      return false;
+    }
+    unlink(socket_path.c_str());
+  }
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenFd < 0) {
+    return false;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path.c_str());
+
+  if ((bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0) ||
+      (listen(listenFd, MAX_FANOUT_SUBSCRIBERS) != 0)) {
+    return false;
+  }
+  path = socket_path;
+
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  wakeFd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if ((epollFd < 0) || (wakeFd < 0)) {
+    return false;
+  }
+
+  // The listening socket and the eventfd are told apart from the
+  // consumers by pointing at the descriptor members
+  struct epoll_event event;
+  event.events   = EPOLLIN;
+  event.data.ptr = &listenFd;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) != 0) {
+    return false;
+  }
+  event.data.ptr = &wakeFd;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) != 0) {
+    return false;
+  }
+
+  return true;
+}
+
+void FanoutServer::start()
+{
+  if (pthread_create(&thread, NULL, &fanout_thread, this) != 0) {
+    printf("\nERROR: Failed to start the fan-out thread\n"
+           "Reason: %s\n\n", strerror(errno));
+    return;
+  }
+  started = true;
+}
+
+//===============================================================================
+//      Hand a frame over to the fan-out thread. Called by the receive
+//      thread, never blocks.
+//
+//===============================================================================
+void FanoutServer::publish(const char *frame, size_t length)
+{
+  if (subscriberCount.load(memory_order_relaxed) == 0) {
+    return;
+  }
+
+  size_t t = tail.load(memory_order_relaxed);
+  if (t + length - head.load(memory_order_acquire) > ring.size()) {
+    // The fan-out thread is behind, the frame is lost for all consumers
+    handoffDrops++;
+    return;
+  }
+  ring_copy_in(ring, t, frame, length);
+
+  // Sequentially consistent store and load, pairs with wait_for_work()
+  tail.store(t + length);
+  if (sleeping.load() && sleeping.exchange(false)) {
+    uint64_t one = 1;
+    ssize_t  result = write(wakeFd, &one, sizeof(one));
+    (void)result;
+  }
+}
+
+//===============================================================================
+//      Stop the fan-out thread and close all connections
+//
+//===============================================================================
+void FanoutServer::stop()
+{
+  if (started) {
+    uint64_t one = 1;
+
+    stopping.store(true);
+    ssize_t result = write(wakeFd, &one, sizeof(one));
+    (void)result;
+    pthread_join(thread, NULL);
+    started = false;
+  }
+
+  for (size_t n = 0; n < subscriberList.size(); n++) {
+    if (subscriberList[n]->fd >= 0) {
+      close_subscriber(subscriberList[n]);
+    }
+  }
+  if (listenFd >= 0) {
+    close(listenFd);
+    listenFd = -1;
+  }
+  if (epollFd >= 0) {
+    close(epollFd);
+    epollFd = -1;
+  }
+  if (wakeFd >= 0) {
+    close(wakeFd);
+    wakeFd = -1;
+  }
+  if (!path.empty()) {
+    unlink(path.c_str());
+    path.clear();
+  }
+}
+
+//===============================================================================
+//      Print the frames queued for and dropped for each consumer
+//
+//===============================================================================
+void FanoutServer::print_summary() const
+{
+  if (subscriberList.empty()) {
+    printf("\nFan-out: No consumers connected\n");
+    return;
+  }
+
+  printf("\nFan-out consumer      Queued     Dropped\n");
+  for (size_t n = 0; n < subscriberList.size(); n++) {
+    printf("%16u  %10lu  %10lu\n", subscriberList[n]->id,
+           subscriberList[n]->frames, subscriberList[n]->dropped);
+  }
+  if (handoffDrops.load() > 0) {
+    printf("%lu frames dropped for all consumers, the fan-out thread was "
+           "behind\n", handoffDrops.load());
+  }
+}
+
+void* FanoutServer::fanout_thread(void *pParams)
+{
+  static_cast<FanoutServer*>(pParams)->run();
+  return NULL;
+}
+
+//===============================================================================
+//      Fan-out thread. Moves frames from the hand-off ring to the queues
+//      of the consumers and serves the sockets.
+//
+//===============================================================================
+void FanoutServer::run()
+{
+  while (true) {
+    size_t h = head.load(memory_order_relaxed);
+    size_t t = tail.load(memory_order_acquire);
+
+    if (h != t) {
+      distribute(h, t);
+      head.store(t, memory_order_release);
+    }
+    else if (stopping.load()) {
+      break;
+    }
+    wait_for_work();
+  }
+
+  // Give the consumers a moment to read what is still queued
+  time_t deadline = time(NULL) + FANOUT_DRAIN_TIME_SEC;
+  while (time(NULL) < deadline) {
+    bool pending = false;
+
+    for (size_t n = 0; n < subscriberList.size(); n++) {
+      FanoutSubscriber *subscriber = subscriberList[n];
+
+      if ((subscriber->fd >= 0) &&
+          (subscriber->queueTail != subscriber->queueHead)) {
+        pending = true;
+      }
+    }
+    if (!pending) {
+      break;
+    }
+    wait_for_work();
+  }
+}
+
+//===============================================================================
+//      Wait for frames from the receive thread or socket events and
+//      serve the sockets
+//
+//===============================================================================
+void FanoutServer::wait_for_work()
+{
+  int timeout_ms = 100;
+
+  if (!stopping.load()) {
+    // Sequentially consistent store and load, pairs with publish()
+    sleeping.store(true);
+    if (tail.load() != head.load(memory_order_relaxed)) {
+      timeout_ms = 0;
+    }
+    else {
+      timeout_ms = 1000;
+    }
+  }
+
+  struct epoll_event events[MAX_FANOUT_EPOLL_EVENTS];
+  int n = epoll_wait(epollFd, events, MAX_FANOUT_EPOLL_EVENTS, timeout_ms);
+  sleeping.store(false);
+
+  for (int i = 0; i < n; i++) {
+    void *ptr = events[i].data.ptr;
+
+    if (ptr == &wakeFd) {
+      uint64_t count;
+      ssize_t  result = read(wakeFd, &count, sizeof(count));
+      (void)result;
+    }
+    else if (ptr == &listenFd) {
+      accept_subscribers();
+    }
+    else {
+      FanoutSubscriber *subscriber = static_cast<FanoutSubscriber*>(ptr);
+
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        close_subscriber(subscriber);
+        continue;
+      }
+      if (events[i].events & EPOLLIN) {
+        // Consumers are not expected to send anything, it is discarded
+        char    discard[256];
+        ssize_t length = recv(subscriber->fd, discard, sizeof(discard), 0);
+
+        if ((length == 0) ||
+            ((length < 0) && (errno != EAGAIN) && (errno != EINTR))) {
+          close_subscriber(subscriber);
+          continue;
+        }
+      }
+      if (events[i].events & EPOLLOUT) {
+        send_queued(subscriber);
+      }
+    }
+  }
+}
+
+void FanoutServer::accept_subscribers()
+{
+  while (true) {
+    int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd < 0) {
+      return;
+    }
+    if (subscriberCount.load() >= MAX_FANOUT_SUBSCRIBERS) {
+      close(fd);
+      continue;
+    }
+
+    FanoutSubscriber *subscriber = new FanoutSubscriber();
+    subscriber->id         = subscriberList.size() + 1;
+    subscriber->fd         = fd;
+    subscriber->wantOutput = false;
+    subscriber->queue.resize(FANOUT_QUEUE_SIZE);
+    subscriber->queueHead  = 0;
+    subscriber->queueTail  = 0;
+    subscriber->frames     = 0;
+    subscriber->dropped    = 0;
+
+    struct epoll_event event;
+    event.events   = EPOLLIN;
+    event.data.ptr = subscriber;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      close(fd);
+      delete subscriber;
+      continue;
+    }
+    subscriberList.push_back(subscriber);
+    subscriberCount++;
+  }
+}
+
+//===============================================================================
+//      Queue the frames of the hand-off ring between from and to for each
+//      connected consumer, then send as much as the sockets accept
+//
+//===============================================================================
+void FanoutServer::distribute(size_t from, size_t to)
+{
+  while (from < to) {
+    char header[FRAME_HEADER_LENGTH];
+
+    for (int i = 0; i < FRAME_HEADER_LENGTH; i++) {
+      header[i] = ring[(from + i) & mask];
+    }
+    size_t length = FRAME_HEADER_LENGTH + frame_data_length(header);
+
+    for (size_t n = 0; n < subscriberList.size(); n++) {
+      FanoutSubscriber *subscriber = subscriberList[n];
+
+      if (subscriber->fd < 0) {
+        continue;
+      }
+      if (subscriber->queueTail + length - subscriber->queueHead >
+          subscriber->queue.size()) {
+        subscriber->dropped++;
+        droppedFrames++;
+        continue;
+      }
+      ring_copy(subscriber->queue, subscriber->queueTail, ring, from, length);
+      subscriber->queueTail += length;
+      subscriber->frames++;
+    }
+    from += length;
+  }
+
+  for (size_t n = 0; n < subscriberList.size(); n++) {
+    FanoutSubscriber *subscriber = subscriberList[n];
+
+    // Consumers waiting for EPOLLOUT are served when writable
+    if ((subscriber->fd >= 0) && !subscriber->wantOutput) {
+      send_queued(subscriber);
+    }
+  }
+}
+
+void FanoutServer::send_queued(FanoutSubscriber *subscriber)
+{
+  size_t size = subscriber->queue.size();
+
+  while (subscriber->queueTail != subscriber->queueHead) {
+    size_t pending = subscriber->queueTail - subscriber->queueHead;
+    size_t start   = subscriber->queueHead & (size - 1);
+    size_t first   = size - start;
+
+    struct iovec iov[2];
+    iov[0].iov_base = &subscriber->queue[start];
+    iov[0].iov_len  = (first < pending) ? first : pending;
+    iov[1].iov_base = &subscriber->queue[0];
+    iov[1].iov_len  = pending - iov[0].iov_len;
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov    = iov;
+    message.msg_iovlen = (iov[1].iov_len > 0) ? 2 : 1;
+
+    ssize_t length = sendmsg(subscriber->fd, &message, MSG_NOSIGNAL);
+    if (length < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        if (!subscriber->wantOutput) {
+          struct epoll_event event;
+          event.events   = EPOLLIN | EPOLLOUT;
+          event.data.ptr = subscriber;
+          epoll_ctl(epollFd, EPOLL_CTL_MOD, subscriber->fd, &event);
+          subscriber->wantOutput = true;
+        }
+        return;
+      }
+      close_subscriber(subscriber);
+      return;
+    }
+    subscriber->queueHead += length;
+  }
+
+  if (subscriber->wantOutput) {
+    struct epoll_event event;
+    event.events   = EPOLLIN;
+    event.data.ptr = subscriber;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, subscriber->fd, &event);
+    subscriber->wantOutput = false;
+  }
+}
+
+void FanoutServer::close_subscriber(FanoutSubscriber *subscriber)
+{
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, subscriber->fd, NULL);
+  close(subscriber->fd);
+  subscriber->fd = -1;
+
+  // Free the queue memory, the counters are kept for the summary
+  vector<char>().swap(subscriber->queue);
+  subscriber->queueHead = 0;
+  subscriber->queueTail = 0;
+  subscriberCount--;
+}
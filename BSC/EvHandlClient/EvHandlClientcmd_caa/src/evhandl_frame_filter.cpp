@@ -0,0 +1,398 @@
+/*
+ *
+ * NAME: evhandl_frame_filter.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Compiler and evaluator of frame filters, see evhandl_frame_filter.h
+ */
+
+
+// Module Include Files
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "evhandl_frame.h"
+#include "evhandl_frame_filter.h"
+
+using namespace std;
+
+
+// Enumerations
+struct FilterOp {
+  // compare and in set the result, jumps test it
+  enum { compare, in, negate, jumpIfFalse, jumpIfTrue };
+};
+
+struct FilterField {
+  enum { eid, length, channel, word };
+};
+
+struct FilterCompare {
+  enum { eq, ne, lt, le, gt, ge };
+};
+
+// Max frame length is 4 + 2*65535 octets, all field values fit in a set
+// of this many bits
+const uint32_t  FILTER_SET_BITS = 1 << 18;
+
+// Max data word index, the largest frame has 65535 data words
+const int       MAX_FILTER_WORD = 65534;
+
+
+// Recursive descent parser emitting the program while parsing
+struct FrameFilter::Parser {
+  FrameFilter&   filter;
+  const char    *text;
+  size_t         pos;
+  string         error;
+
+  Parser(FrameFilter& f, const string& expression)
+    : filter(f), text(expression.c_str()), pos(0)
+  {
+  }
+
+  void skip_space()
+  {
+    while (isspace((unsigned char)text[pos])) {
+      pos++;
+    }
+  }
+
+  bool fail(const char *what)
+  {
+    if (error.empty()) {
+      char description[128];
+
+      skip_space();
+      if (text[pos] == '\0') {
+        snprintf(description, sizeof(description), "%s at end of filter",
+                 what);
+      }
+      else {
+        snprintf(description, sizeof(description), "%s at position %lu",
+                 what, pos + 1);
+      }
+      error = description;
+    }
+    return false;
+  }
+
+  // Accept a keyword or symbol if it is next
+  bool accept(const char *token)
+  {
+    size_t length = strlen(token);
+
+    skip_space();
+    if (strncmp(text + pos, token, length) != 0) {
+      return false;
+    }
+    // Keywords must not run into a following name
+    if (isalpha((unsigned char)token[length - 1]) &&
+        (isalnum((unsigned char)text[pos + length]) ||
+         (text[pos + length] == '_'))) {
+      return false;
+    }
+    pos += length;
+    return true;
+  }
+
+  bool number(uint32_t& value)
+  {
+    char          *end;
+    unsigned long  result;
+
+    skip_space();
+    if (!isdigit((unsigned char)text[pos])) {
+      return fail("Number expected");
+    }
+    // Hexadecimal only with 0x, a leading zero does not make it octal
+    int base = ((text[pos] == '0') &&
+                ((text[pos + 1] == 'x') || (text[pos + 1] == 'X'))) ? 16 : 10;
+
+    errno  = 0;
+    result = strtoul(text + pos, &end, base);
+    if ((errno != 0) || (result >= FILTER_SET_BITS)) {
+      return fail("Number too large");
+    }
+    pos   = end - text;
+    value = result;
+    return true;
+  }
+
+  size_t emit(int op, uint32_t value = 0)
+  {
+    FilterInstruction instruction;
+
+    instruction.op      = op;
+    instruction.field   = FilterField::eid;
+    instruction.word    = 0;
+    instruction.compare = FilterCompare::eq;
+    instruction.value   = value;
+    filter.program.push_back(instruction);
+    return filter.program.size() - 1;
+  }
+
+  bool expr()
+  {
+    if (!term()) {
+      return false;
+    }
+    while (accept("or")) {
+      // The right side is only evaluated if the left side is false
+      size_t jump = emit(FilterOp::jumpIfTrue);
+      if (!term()) {
+        return false;
+      }
+      filter.program[jump].value = filter.program.size();
+    }
+    return true;
+  }
+
+  bool term()
+  {
+    if (!factor()) {
+      return false;
+    }
+    while (accept("and")) {
+      size_t jump = emit(FilterOp::jumpIfFalse);
+      if (!factor()) {
+        return false;
+      }
+      filter.program[jump].value = filter.program.size();
+    }
+    return true;
+  }
+
+  bool factor()
+  {
+    if (accept("not")) {
+      if (!factor()) {
+        return false;
+      }
+      emit(FilterOp::negate);
+      return true;
+    }
+    if (accept("(")) {
+      if (!expr()) {
+        return false;
+      }
+      if (!accept(")")) {
+        return fail("')' expected");
+      }
+      return true;
+    }
+    return comparison();
+  }
+
+  bool comparison()
+  {
+    FilterInstruction instruction;
+
+    instruction.word = 0;
+    if (accept("eid")) {
+      instruction.field = FilterField::eid;
+    }
+    else if (accept("len")) {
+      instruction.field = FilterField::length;
+    }
+    else if (accept("channel")) {
+      instruction.field = FilterField::channel;
+    }
+    else if (accept("word[")) {
+      uint32_t index;
+
+      if (!number(index)) {
+        return false;
+      }
+      if (index > (uint32_t)MAX_FILTER_WORD) {
+        return fail("Word index too large");
+      }
+      if (!accept("]")) {
+        return fail("']' expected");
+      }
+      instruction.field = FilterField::word;
+      instruction.word  = index;
+    }
+    else {
+      return fail("Field expected");
+    }
+
+    if (accept("in")) {
+      instruction.op      = FilterOp::in;
+      instruction.compare = FilterCompare::eq;
+      instruction.value   = filter.sets.size();
+      filter.sets.push_back(vector<uint64_t>(FILTER_SET_BITS / 64, 0));
+
+      vector<uint64_t>& set = filter.sets.back();
+      do {
+        uint32_t first, last;
+
+        if (!number(first)) {
+          return false;
+        }
+        last = first;
+        if (accept("-") && !number(last)) {
+          return false;
+        }
+        if (last < first) {
+          return fail("Invalid range");
+        }
+        for (uint32_t value = first; value <= last; value++) {
+          set[value / 64] |= 1ULL << (value % 64);
+        }
+      } while (accept(","));
+    }
+    else {
+      // Two character operators first
+      if (accept("==")) {
+        instruction.compare = FilterCompare::eq;
+      }
+      else if (accept("!=")) {
+        instruction.compare = FilterCompare::ne;
+      }
+      else if (accept("<=")) {
+        instruction.compare = FilterCompare::le;
+      }
+      else if (accept(">=")) {
+        instruction.compare = FilterCompare::ge;
+      }
+      else if (accept("<")) {
+        instruction.compare = FilterCompare::lt;
+      }
+      else if (accept(">")) {
+        instruction.compare = FilterCompare::gt;
+      }
+      else {
+        return fail("Operator expected");
+      }
+      instruction.op = FilterOp::compare;
+      if (!number(instruction.value)) {
+        return false;
+      }
+    }
+
+    filter.program.push_back(instruction);
+    return true;
+  }
+};
+
+
+FrameFilter::FrameFilter()
+{
+}
+
+//===============================================================================
+//      Compile a filter expression
+//
+//===============================================================================
+bool FrameFilter::compile(const string& expression, string& error)
+{
+  Parser parser(*this, expression);
+
+  program.clear();
+  sets.clear();
+
+  if (!parser.expr()) {
+    error = parser.error;
+    return false;
+  }
+  parser.skip_space();
+  if (expression[parser.pos] != '\0') {
+    parser.fail("Unexpected text");
+    error = parser.error;
+    return false;
+  }
+  return true;
+}
+
+//===============================================================================
+//      Run the filter program on a frame
+//
+//===============================================================================
+bool FrameFilter::accept(const char *frame) const
+{
+  const FilterInstruction *code   = &program[0];
+  size_t                   size   = program.size();
+  int                      words  = frame_data_length(frame) / 2;
+  bool                     result = false;
+
+  for (size_t pc = 0; pc < size; pc++) {
+    const FilterInstruction& instruction = code[pc];
+    uint32_t                 value;
+
+    switch (instruction.op) {
+    case FilterOp::jumpIfFalse:
+      if (!result) {
+        pc = instruction.value - 1;
+      }
+      continue;
+
+    case FilterOp::jumpIfTrue:
+      if (result) {
+        pc = instruction.value - 1;
+      }
+      continue;
+
+    case FilterOp::negate:
+      result = !result;
+      continue;
+    }
+
+    switch (instruction.field) {
+    case FilterField::eid:
+      if (words < 1) {
+        result = false;
+        continue;
+      }
+      value = frame_event_id(frame);
+      break;
+
+    case FilterField::length:
+      value = FRAME_HEADER_LENGTH + words * 2;
+      break;
+
+    case FilterField::channel:
+      value = frame_channel(frame);
+      break;
+
+    default:
+      if (instruction.word >= words) {
+        result = false;
+        continue;
+      }
+      value = (unsigned char)frame[FRAME_HEADER_LENGTH + 2*instruction.word] * 256 +
+              (unsigned char)frame[FRAME_HEADER_LENGTH + 2*instruction.word + 1];
+      break;
+    }
+
+    if (instruction.op == FilterOp::in) {
+      const vector<uint64_t>& set = sets[instruction.value];
+      result = (set[value / 64] >> (value % 64)) & 1;
+      continue;
+    }
+
+    switch (instruction.compare) {
+    case FilterCompare::eq: result = (value == instruction.value); break;
+    case FilterCompare::ne: result = (value != instruction.value); break;
+    case FilterCompare::lt: result = (value <  instruction.value); break;
+    case FilterCompare::le: result = (value <= instruction.value); break;
+    case FilterCompare::gt: result = (value >  instruction.value); break;
+    case FilterCompare::ge: result = (value >= instruction.value); break;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,230 @@
+/*
+ *
+ * NAME: evhandl_frame_receiver.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Batched receive path for the event stream, see evhandl_frame_receiver.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "evhandl_frame.h"
+#include "evhandl_frame_receiver.h"
+
+
+FrameReceiver::FrameReceiver(int socket_fd, int max_data_length,
+                             size_t ring_size)
+  : socketFd(socket_fd),
+    recvFlags(0),
+    maxFrameLength(FRAME_HEADER_LENGTH + max_data_length),
+    ring(NULL),
+    ringSize(ring_size),
+    readPos(0),
+    writePos(0),
+    recvCalls(0),
+    framesReceived(0),
+    bytesReceived(0),
+    endOfStream(false),
+    timestamps(false),
+    readTimeNs(0),
+    receiveTimeNs(0)
+{
+  // The ring must at least be able to hold one frame of max length
+  if (ringSize < (size_t)maxFrameLength) {
+    ringSize = maxFrameLength;
+  }
+
+  ring = (char *)malloc(ringSize);
+  if (ring == NULL) {
+    printf("\nOut of memory, aborting!\n\n");
+    exit(1);
+  }
+}
+
+FrameReceiver::~FrameReceiver()
+{
+  free(ring);
+}
+
+//===============================================================================
+//      Return the next complete frame. Frames are parsed in place in the
+//      ring and the socket is only read when no complete frame is buffered.
+//
+//===============================================================================
+char* FrameReceiver::next_frame(int& frame_length)
+{
+  while (true) {
+    char *frame = buffered_frame(frame_length);
+
+    if (frame != NULL) {
+      return frame;
+    }
+    if (!fill()) {
+      return NULL;
+    }
+  }
+}
+
+//===============================================================================
+//      Return the next frame if it is complete in the ring
+//
+//===============================================================================
+char* FrameReceiver::buffered_frame(int& frame_length)
+{
+  size_t available = writePos - readPos;
+
+  if (available < (size_t)FRAME_HEADER_LENGTH) {
+    return NULL;
+  }
+
+  int data_length = frame_data_length(ring + readPos);
+
+  if (data_length > maxFrameLength - FRAME_HEADER_LENGTH) {
+    printf("\nERROR: Reading from socket event length too long.\n"
+           "%10d bytes stated in received event, expected max %d bytes.\n",
+           data_length, maxFrameLength - FRAME_HEADER_LENGTH);
+    exit(1);
+  }
+
+  if (available < (size_t)(FRAME_HEADER_LENGTH + data_length)) {
+    return NULL;
+  }
+
+  char *frame = ring + readPos;
+
+  frame_length = FRAME_HEADER_LENGTH + data_length;
+  readPos += frame_length;
+  framesReceived++;
+
+  if (timestamps) {
+    // The kernel clock may step backwards
+    if (receiveTimeNs != 0) {
+      interArrival.add((readTimeNs > receiveTimeNs) ?
+                       readTimeNs - receiveTimeNs : 0);
+    }
+    receiveTimeNs = readTimeNs;
+  }
+  return frame;
+}
+
+//===============================================================================
+//      Read as much as fits into the ring from the socket. The ring wraps by
+//      moving the (partial) frame at the read position back to the start
+//      when there is not room for a full frame after it.
+//
+//===============================================================================
+bool FrameReceiver::fill()
+{
+  if (readPos == writePos) {
+    readPos  = 0;
+    writePos = 0;
+  }
+  else if (ringSize - readPos < (size_t)maxFrameLength) {
+    memmove(ring, ring + readPos, writePos - readPos);
+    writePos -= readPos;
+    readPos   = 0;
+  }
+
+  while (true) {
+    ssize_t bytes_read;
+
+    if (timestamps) {
+      bytes_read = receive_with_timestamp();
+    }
+    else {
+      bytes_read = recv(socketFd, ring + writePos, ringSize - writePos,
+                        recvFlags);
+    }
+
+    recvCalls++;
+    if (bytes_read > 0) {
+      writePos      += bytes_read;
+      bytesReceived += bytes_read;
+      return true;
+    }
+    else if (bytes_read == 0) {
+      // Connection closed by the remote side
+      endOfStream = true;
+      return false;
+    }
+    else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+      // Nothing more to read until the socket is readable again
+      return false;
+    }
+    else if (errno != EINTR) {
+      printf("\nERROR: Reading from socket.\n"
+             "Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+  }
+}
+
+bool FrameReceiver::enable_timestamps()
+{
+  int flag = 1;
+
+  timestamps = true;
+  return (setsockopt(socketFd, SOL_SOCKET, SO_TIMESTAMPNS, &flag,
+                     sizeof(flag)) == 0);
+}
+
+//===============================================================================
+//      Read from the socket and take the receive timestamp of the data
+//      from the control message, or the current time if there is none
+//
+//===============================================================================
+ssize_t FrameReceiver::receive_with_timestamp()
+{
+  struct iovec   iov;
+  struct msghdr  message;
+  char           control[CMSG_SPACE(sizeof(struct timespec))];
+
+  iov.iov_base = ring + writePos;
+  iov.iov_len  = ringSize - writePos;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov        = &iov;
+  message.msg_iovlen     = 1;
+  message.msg_control    = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t bytes_read = recvmsg(socketFd, &message, recvFlags);
+  if (bytes_read <= 0) {
+    return bytes_read;
+  }
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(&message, cmsg)) {
+    if ((cmsg->cmsg_level == SOL_SOCKET) &&
+        (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+      struct timespec ts;
+
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      readTimeNs = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+      return bytes_read;
+    }
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  readTimeNs = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+  return bytes_read;
+}
@@ -0,0 +1,359 @@
+/*
+ *
+ * NAME: evhandl_indexed_file.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Log file format v2, see evhandl_indexed_file.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "evhandl_frame.h"
+#include "evhandl_indexed_file.h"
+#include "evhandl_little_endian.h"
+
+using namespace std;
+
+
+static const char  MARKER_MAGIC[4]  = { 'E', 'H', 'B', '2' };
+static const char  TRAILER_MAGIC[4] = { 'E', 'H', 'X', '2' };
+
+// Read exactly length octets at offset, false at end of file or error
+static bool pread_all(int fd, char *data, size_t length, uint64_t offset)
+{
+  while (length > 0) {
+    ssize_t n = pread(fd, data, length, offset);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (n == 0) {
+      errno = EINVAL;
+      return false;
+    }
+    data   += n;
+    length -= n;
+    offset += n;
+  }
+  return true;
+}
+
+
+//===============================================================================
+//      IndexedOutputFile
+//
+//===============================================================================
+IndexedOutputFile::IndexedOutputFile(OutputFile *file)
+  : file(file),
+    offset(0),
+    firstTimeMs(0),
+    lastTimeMs(0)
+{
+}
+
+IndexedOutputFile::~IndexedOutputFile()
+{
+  delete file;
+}
+
+bool IndexedOutputFile::open(const string& name)
+{
+  index.clear();
+  offset = 0;
+  return file->open(name);
+}
+
+void IndexedOutputFile::set_capture_time(uint64_t first_ms, uint64_t last_ms)
+{
+  firstTimeMs = first_ms;
+  lastTimeMs  = last_ms;
+}
+
+//===============================================================================
+//      Write the frames as one block preceded by its marker
+//
+//===============================================================================
+bool IndexedOutputFile::write(const char *data, size_t length)
+{
+  BlockIndexEntry  entry;
+  char             marker[BLOCK_MARKER_LENGTH];
+
+  if (length == 0) {
+    return true;
+  }
+
+  entry.offset      = offset;
+  entry.firstTimeMs = firstTimeMs;
+  entry.lastTimeMs  = lastTimeMs;
+  entry.eventMask   = 0;
+  entry.length      = (uint32_t)length;
+  entry.frames      = 0;
+
+  for (size_t pos = 0; pos + FRAME_HEADER_LENGTH <= length; ) {
+    const char *frame       = data + pos;
+    int         data_length = frame_data_length(frame);
+
+    if ((frame_channel(frame) == EVENT_CHANNEL) && (data_length >= 2)) {
+      entry.eventMask |= event_mask_bit(frame_event_id(frame));
+    }
+    entry.frames++;
+    pos += FRAME_HEADER_LENGTH + data_length;
+  }
+
+  memcpy(marker, MARKER_MAGIC, sizeof(MARKER_MAGIC));
+  put32(marker + 4,  entry.length);
+  put32(marker + 8,  entry.frames);
+  put32(marker + 12, 0);
+  put64(marker + 16, entry.firstTimeMs);
+  put64(marker + 24, entry.lastTimeMs);
+  put64(marker + 32, entry.eventMask);
+
+  if (!file->write(marker, BLOCK_MARKER_LENGTH) ||
+      !file->write(data, length)) {
+    return false;
+  }
+
+  offset += BLOCK_MARKER_LENGTH + length;
+  index.push_back(entry);
+
+  return true;
+}
+
+bool IndexedOutputFile::flush()
+{
+  return file->flush();
+}
+
+//===============================================================================
+//      Write the index and trailer and close the file
+//
+//===============================================================================
+bool IndexedOutputFile::close()
+{
+  vector<char>  buffer(index.size() * INDEX_ENTRY_LENGTH + INDEX_TRAILER_LENGTH);
+  char         *p = &buffer[0];
+
+  for (size_t n = 0; n < index.size(); n++) {
+    put64(p,      index[n].offset);
+    put64(p + 8,  index[n].firstTimeMs);
+    put64(p + 16, index[n].lastTimeMs);
+    put64(p + 24, index[n].eventMask);
+    put32(p + 32, index[n].length);
+    put32(p + 36, index[n].frames);
+    p += INDEX_ENTRY_LENGTH;
+  }
+  memcpy(p, TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+  put32(p + 4, (uint32_t)index.size());
+  put64(p + 8, offset);
+
+  bool result = file->write(&buffer[0], buffer.size());
+
+  if (!file->close()) {
+    result = false;
+  }
+  return result;
+}
+
+
+//===============================================================================
+//      Read the index of a v2 file, either from the end of the file or, if
+//      the file was not closed properly, by hopping over the blocks.
+//
+//===============================================================================
+static bool read_index(int fd, uint64_t size, vector<BlockIndexEntry>& index,
+                       bool& indexed)
+{
+  char  buffer[BLOCK_MARKER_LENGTH];
+
+  index.clear();
+  indexed = false;
+
+  if ((size >= INDEX_TRAILER_LENGTH) &&
+      pread_all(fd, buffer, INDEX_TRAILER_LENGTH, size - INDEX_TRAILER_LENGTH) &&
+      (memcmp(buffer, TRAILER_MAGIC, sizeof(TRAILER_MAGIC)) == 0)) {
+    uint32_t  entries      = get32(buffer + 4);
+    uint64_t  index_offset = get64(buffer + 8);
+
+    if (index_offset + (uint64_t)entries * INDEX_ENTRY_LENGTH +
+        INDEX_TRAILER_LENGTH == size) {
+      vector<char>  raw((size_t)entries * INDEX_ENTRY_LENGTH + 1);
+
+      if (!pread_all(fd, &raw[0], raw.size() - 1, index_offset)) {
+        return false;
+      }
+      index.resize(entries);
+      for (uint32_t n = 0; n < entries; n++) {
+        const char *p = &raw[n * INDEX_ENTRY_LENGTH];
+
+        index[n].offset      = get64(p);
+        index[n].firstTimeMs = get64(p + 8);
+        index[n].lastTimeMs  = get64(p + 16);
+        index[n].eventMask   = get64(p + 24);
+        index[n].length      = get32(p + 32);
+        index[n].frames      = get32(p + 36);
+      }
+      indexed = true;
+      return true;
+    }
+  }
+
+  // No index, a truncated last block is left out
+  uint64_t  pos = 0;
+
+  while (pos + BLOCK_MARKER_LENGTH <= size) {
+    BlockIndexEntry  entry;
+
+    if (!pread_all(fd, buffer, BLOCK_MARKER_LENGTH, pos)) {
+      return false;
+    }
+    if (memcmp(buffer, MARKER_MAGIC, sizeof(MARKER_MAGIC)) != 0) {
+      break;
+    }
+
+    entry.offset      = pos;
+    entry.length      = get32(buffer + 4);
+    entry.frames      = get32(buffer + 8);
+    entry.firstTimeMs = get64(buffer + 16);
+    entry.lastTimeMs  = get64(buffer + 24);
+    entry.eventMask   = get64(buffer + 32);
+
+    if (pos + BLOCK_MARKER_LENGTH + entry.length > size) {
+      break;
+    }
+    index.push_back(entry);
+    pos += BLOCK_MARKER_LENGTH + entry.length;
+  }
+
+  if (index.empty() && (size > 0)) {
+    errno = EINVAL;
+    return false;
+  }
+  return true;
+}
+
+//===============================================================================
+//      Extract the frames matching the filter, reading only the blocks that
+//      may contain such frames
+//
+//===============================================================================
+bool extract_frames(const string& in_name, const string& out_name,
+                    const ExtractFilter& filter, ExtractResult& result)
+{
+  struct stat              st;
+  vector<BlockIndexEntry>  index;
+  uint64_t                 wanted_mask = 0;
+  int                      fd = open(in_name.c_str(), O_RDONLY);
+
+  memset(&result, 0, sizeof(result));
+
+  if (fd < 0) {
+    return false;
+  }
+  if ((fstat(fd, &st) != 0) ||
+      !read_index(fd, st.st_size, index, result.indexed)) {
+    int saved_errno = errno;
+
+    close(fd);
+    errno = saved_errno;
+    return false;
+  }
+  result.blocks = index.size();
+
+  for (size_t n = 0; n < filter.eids.size(); n++) {
+    wanted_mask |= event_mask_bit(filter.eids[n]);
+  }
+
+  StreamOutputFile  out;
+  vector<char>      block;
+  bool              ok = out.open(out_name);
+
+  for (size_t n = 0; ok && (n < index.size()); n++) {
+    const BlockIndexEntry& entry = index[n];
+
+    if ((entry.lastTimeMs < filter.fromMs) ||
+        (entry.firstTimeMs > filter.toMs) ||
+        (!filter.eids.empty() && ((entry.eventMask & wanted_mask) == 0))) {
+      continue;
+    }
+
+    if (block.size() < entry.length) {
+      block.resize(entry.length);
+    }
+    ok = pread_all(fd, &block[0], entry.length,
+                   entry.offset + BLOCK_MARKER_LENGTH);
+    result.blocksRead++;
+
+    // Consecutive frames to keep are written together
+    size_t  pos       = 0;
+    size_t  run_start = 0;
+
+    while (ok && (pos + FRAME_HEADER_LENGTH <= entry.length)) {
+      const char *frame        = &block[pos];
+      size_t      frame_length = FRAME_HEADER_LENGTH + frame_data_length(frame);
+      bool        keep         = true;
+
+      if (pos + frame_length > entry.length) {
+        break;
+      }
+
+      if (!filter.eids.empty() && (frame_channel(frame) == EVENT_CHANNEL)) {
+        keep = false;
+        if (frame_length >= FRAME_HEADER_LENGTH + 2) {
+          int eid = frame_event_id(frame);
+
+          for (size_t e = 0; e < filter.eids.size(); e++) {
+            if (filter.eids[e] == eid) {
+              keep = true;
+              break;
+            }
+          }
+        }
+      }
+
+      if (keep) {
+        result.frames++;
+        result.bytes += frame_length;
+      }
+      else {
+        if (pos > run_start) {
+          ok = out.write(&block[run_start], pos - run_start);
+        }
+        run_start = pos + frame_length;
+      }
+      pos += frame_length;
+    }
+    if (ok && (pos > run_start)) {
+      ok = out.write(&block[run_start], pos - run_start);
+    }
+  }
+
+  int saved_errno = errno;
+
+  close(fd);
+  if (!ok) {
+    out.close();
+    errno = saved_errno;
+    return false;
+  }
+  return out.close();
+}
@@ -0,0 +1,277 @@
+/*
+ *
+ * NAME: evhandl_lz4.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  LZ4 block format compression, see evhandl_lz4.h
+ *
+ *  A compressed block is a sequence of sequences, each made up of
+ *    token            high nibble literal length, low nibble match
+ *                     length - 4 (15 means more length octets follow)
+ *    [literal length] 255 + 255 + ... + last octet (< 255)
+ *    literals
+ *    offset           2 octets, little endian, back from the match
+ *    [match length]   as literal length
+ *  The last sequence has literals only. The last 5 octets are always
+ *  literals and no match starts within the last 12 octets.
+ */
+
+
+// Module Include Files
+#include <stdint.h>
+#include <string.h>
+
+#include "evhandl_lz4.h"
+
+
+const int     HASH_LOG       = 12;
+const int     MIN_MATCH      = 4;
+const size_t  LAST_LITERALS  = 5;
+const size_t  MATCH_LIMIT    = 12;  // No match starts within the last octets
+const size_t  MAX_OFFSET     = 65535;
+
+// Speeds up passing incompressible data: the step grows by one for
+// each 64 octets without a match
+const int     SKIP_SHIFT     = 6;
+
+static inline uint32_t read32(const uint8_t *p)
+{
+  uint32_t value;
+
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint32_t hash4(uint32_t value)
+{
+  return (value * 2654435761U) >> (32 - HASH_LOG);
+}
+
+// Write a length continuation, i.e. the part of the length above 15
+static inline uint8_t* put_length(uint8_t *op, size_t length)
+{
+  while (length >= 255) {
+    *op++   = 255;
+    length -= 255;
+  }
+  *op++ = (uint8_t)length;
+  return op;
+}
+
+//===============================================================================
+//      Write a sequence of literals and an optional match. Returns NULL if
+//      it does not fit.
+//
+//===============================================================================
+static uint8_t* put_sequence(uint8_t *op, uint8_t *oend,
+                             const uint8_t *literals, size_t literal_length,
+                             size_t offset, size_t match_length)
+{
+  // Worst case length of token, lengths and offset
+  size_t needed = 1 + (literal_length / 255) + 1 + literal_length +
+                  2 + (match_length / 255) + 1;
+
+  if ((size_t)(oend - op) < needed) {
+    return NULL;
+  }
+
+  uint8_t *token = op++;
+
+  if (literal_length >= 15) {
+    *token = 15 << 4;
+    op     = put_length(op, literal_length - 15);
+  }
+  else {
+    *token = (uint8_t)(literal_length << 4);
+  }
+  memcpy(op, literals, literal_length);
+  op += literal_length;
+
+  if (match_length == 0) {
+    return op;
+  }
+
+  *op++ = (uint8_t)(offset & 0xff);
+  *op++ = (uint8_t)(offset >> 8);
+
+  match_length -= MIN_MATCH;
+  if (match_length >= 15) {
+    *token |= 15;
+    op      = put_length(op, match_length - 15);
+  }
+  else {
+    *token |= (uint8_t)match_length;
+  }
+
+  return op;
+}
+
+//===============================================================================
+//      Compress a block
+//
+//===============================================================================
+size_t lz4_compress(const char *src, size_t length, char *dst, size_t capacity)
+{
+  const uint8_t *base   = (const uint8_t *)src;
+  const uint8_t *ip     = base;
+  const uint8_t *anchor = base;
+  const uint8_t *end    = base + length;
+  uint8_t       *op     = (uint8_t *)dst;
+  uint8_t       *oend   = op + capacity;
+
+  if (length > MATCH_LIMIT) {
+    const uint8_t *match_limit = end - LAST_LITERALS;
+    const uint8_t *mf_limit    = end - MATCH_LIMIT;
+    uint32_t       table[1 << HASH_LOG];
+
+    memset(table, 0, sizeof(table));
+    ip++;
+
+    while (ip < mf_limit) {
+      uint32_t       sequence = read32(ip);
+      uint32_t       h        = hash4(sequence);
+      const uint8_t *ref      = base + table[h];
+
+      table[h] = (uint32_t)(ip - base);
+
+      if ((ref >= ip) || ((size_t)(ip - ref) > MAX_OFFSET) ||
+          (read32(ref) != sequence)) {
+        ip += 1 + ((ip - anchor) >> SKIP_SHIFT);
+        continue;
+      }
+
+      // Extend the match backwards over the pending literals
+      while ((ip > anchor) && (ref > base) && (ip[-1] == ref[-1])) {
+        ip--;
+        ref--;
+      }
+
+      const uint8_t *mp = ip + MIN_MATCH;
+      const uint8_t *rp = ref + MIN_MATCH;
+
+      while ((mp < match_limit) && (*mp == *rp)) {
+        mp++;
+        rp++;
+      }
+
+      op = put_sequence(op, oend, anchor, ip - anchor, ip - ref, mp - ip);
+      if (op == NULL) {
+        return 0;
+      }
+
+      ip     = mp;
+      anchor = ip;
+
+      // Let later data match the end of this match as well
+      if (ip < mf_limit) {
+        table[hash4(read32(ip - 2))] = (uint32_t)(ip - 2 - base);
+      }
+    }
+  }
+
+  op = put_sequence(op, oend, anchor, end - anchor, 0, 0);
+  if (op == NULL) {
+    return 0;
+  }
+
+  return op - (uint8_t *)dst;
+}
+
+//===============================================================================
+//      Decompress a block. All lengths and offsets are checked, i.e. corrupt
+//      data is detected rather than causing reads or writes out of bounds.
+//
+//===============================================================================
+long lz4_decompress(const char *src, size_t length, char *dst, size_t capacity)
+{
+  const uint8_t *ip   = (const uint8_t *)src;
+  const uint8_t *iend = ip + length;
+  uint8_t       *op   = (uint8_t *)dst;
+  uint8_t       *oend = op + capacity;
+
+  while (ip < iend) {
+    unsigned token          = *ip++;
+    size_t   literal_length = token >> 4;
+
+    if (literal_length == 15) {
+      uint8_t octet;
+
+      do {
+        if (ip >= iend) {
+          return -1;
+        }
+        octet           = *ip++;
+        literal_length += octet;
+      } while (octet == 255);
+    }
+
+    if ((literal_length > (size_t)(iend - ip)) ||
+        (literal_length > (size_t)(oend - op))) {
+      return -1;
+    }
+    memcpy(op, ip, literal_length);
+    ip += literal_length;
+    op += literal_length;
+
+    // The last sequence has literals only
+    if (ip == iend) {
+      break;
+    }
+
+    if (iend - ip < 2) {
+      return -1;
+    }
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+
+    if ((offset == 0) || (offset > (size_t)(op - (uint8_t *)dst))) {
+      return -1;
+    }
+
+    size_t match_length = token & 15;
+
+    if (match_length == 15) {
+      uint8_t octet;
+
+      do {
+        if (ip >= iend) {
+          return -1;
+        }
+        octet         = *ip++;
+        match_length += octet;
+      } while (octet == 255);
+    }
+    match_length += MIN_MATCH;
+
+    if (match_length > (size_t)(oend - op)) {
+      return -1;
+    }
+
+    // The match may overlap the data it produces, e.g. offset 1 repeats
+    // the previous octet, so it is copied octet by octet in that case
+    const uint8_t *match = op - offset;
+
+    if (offset >= match_length) {
+      memcpy(op, match, match_length);
+      op += match_length;
+    }
+    else {
+      while (match_length-- > 0) {
+        *op++ = *match++;
+      }
+    }
+  }
+
+  return op - (uint8_t *)dst;
+}
@@ -0,0 +1,583 @@
+/*
+ *
+ * NAME: evhandl_metrics.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Live metrics of a capture, see evhandl_metrics.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "evhandl_metrics.h"
+
+using namespace std;
+
+
+// Time a client gets to send its request and read the response
+const int       METRICS_CLIENT_TIMEOUT_SEC = 1;
+
+// Rates are computed over this interval
+const uint64_t  METRICS_RATE_INTERVAL_NS = 1000000000ULL;
+
+// Append printf style formatted text
+static void append_format(string& text, const char *format, ...)
+{
+  char    line[256];
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  text += line;
+}
+
+// Percentiles shown for the latency histograms
+static const double  PERCENTILES[]      = { 0.5, 0.9, 0.99, 0.999 };
+static const char   *PERCENTILE_NAMES[] = { "p50", "p90", "p99", "p999" };
+const int            PERCENTILE_COUNT   = 4;
+
+// Label of a channel, frames on high channels are counted together
+static string channel_label(int channel)
+{
+  char label[16];
+
+  if (channel == METRICS_CHANNELS) {
+    snprintf(label, sizeof(label), "other");
+  }
+  else {
+    snprintf(label, sizeof(label), "%d", channel);
+  }
+  return label;
+}
+
+
+LatencyHistogram::LatencyHistogram()
+  : sumNs(0),
+    maxNs(0)
+{
+  for (int n = 0; n < LATENCY_BUCKETS; n++) {
+    buckets[n].store(0);
+  }
+}
+
+uint64_t LatencyHistogram::count() const
+{
+  uint64_t total = 0;
+
+  for (int n = 0; n < LATENCY_BUCKETS; n++) {
+    total += buckets[n].load(memory_order_relaxed);
+  }
+  return total;
+}
+
+// Upper bound of a bucket in ns, the last bucket has none
+uint64_t LatencyHistogram::upper_bound(int bucket)
+{
+  if (bucket < LATENCY_SUB_BUCKETS) {
+    return (uint64_t)(bucket + 1) << (LATENCY_MIN_POWER - 3);
+  }
+  if (bucket == LATENCY_BUCKETS - 1) {
+    return UINT64_MAX;
+  }
+
+  int power = bucket / LATENCY_SUB_BUCKETS + LATENCY_MIN_POWER - 1;
+  int sub   = bucket % LATENCY_SUB_BUCKETS;
+
+  return (uint64_t)(LATENCY_SUB_BUCKETS + sub + 1) << (power - 3);
+}
+
+uint64_t LatencyHistogram::percentile_ns(double fraction) const
+{
+  uint64_t counts[LATENCY_BUCKETS];
+  uint64_t total = 0;
+
+  for (int n = 0; n < LATENCY_BUCKETS; n++) {
+    counts[n] = buckets[n].load(memory_order_relaxed);
+    total    += counts[n];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  uint64_t rank = (uint64_t)(fraction * total + 0.5);
+  uint64_t seen = 0;
+  if (rank == 0) {
+    rank = 1;
+  }
+  for (int n = 0; n < LATENCY_BUCKETS; n++) {
+    seen += counts[n];
+    if (seen >= rank) {
+      // The max is closer than the bucket bound in the highest bucket
+      uint64_t bound = upper_bound(n);
+      return (bound < max_ns()) ? bound : max_ns();
+    }
+  }
+  return max_ns();
+}
+
+//===============================================================================
+//      Print count, percentiles and max on one line
+//
+//===============================================================================
+void LatencyHistogram::print_summary(const char *title) const
+{
+  printf("%-22s %10lu", title, count());
+  for (int n = 0; n < PERCENTILE_COUNT; n++) {
+    printf("  %s: %9.3f", PERCENTILE_NAMES[n],
+           percentile_ns(PERCENTILES[n]) / 1e6);
+  }
+  printf("  max: %9.3f ms\n", max_ns() / 1e6);
+}
+
+//===============================================================================
+//      Append the histogram in the Prometheus text format. The buckets
+//      are cumulative and only the powers of two are shown.
+//
+//===============================================================================
+void LatencyHistogram::write_prometheus(string& text, const char *name,
+                                        const char *help) const
+{
+  uint64_t total = 0;
+
+  append_format(text, "# HELP %s %s\n", name, help);
+  append_format(text, "# TYPE %s histogram\n", name);
+  for (int n = 0; n < LATENCY_BUCKETS - 1; n++) {
+    total += buckets[n].load(memory_order_relaxed);
+    if ((n % LATENCY_SUB_BUCKETS) == LATENCY_SUB_BUCKETS - 1) {
+      append_format(text, "%s_bucket{le=\"%.9g\"} %lu\n", name,
+                    upper_bound(n) / 1e9, total);
+    }
+  }
+  total += buckets[LATENCY_BUCKETS - 1].load(memory_order_relaxed);
+  append_format(text, "%s_bucket{le=\"+Inf\"} %lu\n", name, total);
+  append_format(text, "%s_sum %.9f\n", name,
+                sumNs.load(memory_order_relaxed) / 1e9);
+  append_format(text, "%s_count %lu\n", name, total);
+}
+
+void LatencyHistogram::write_json(string& text) const
+{
+  append_format(text, "{\"count\": %lu, \"sumSeconds\": %.9f",
+                count(), sumNs.load(memory_order_relaxed) / 1e9);
+  for (int n = 0; n < PERCENTILE_COUNT; n++) {
+    append_format(text, ", \"%sSeconds\": %.9f", PERCENTILE_NAMES[n],
+                  percentile_ns(PERCENTILES[n]) / 1e9);
+  }
+  append_format(text, ", \"maxSeconds\": %.9f}", max_ns() / 1e9);
+}
+
+
+CaptureMetrics::CaptureMetrics(MetricsCollector metrics_collector)
+  : events(EVENT_ID_COUNT),
+    collector(metrics_collector),
+    startNs(monotonic_ns()),
+    listenFd(-1),
+    wakeFd(-1),
+    tuning(NO_THREAD_TUNING),
+    started(false),
+    lastRateNs(startNs),
+    lastEventFrames(EVENT_ID_COUNT, 0),
+    eventRates(EVENT_ID_COUNT, 0.0)
+{
+  for (uint32_t eid = 0; eid < EVENT_ID_COUNT; eid++) {
+    events[eid].frames.store(0);
+    events[eid].bytes.store(0);
+  }
+  for (int channel = 0; channel <= METRICS_CHANNELS; channel++) {
+    channels[channel].frames.store(0);
+    channels[channel].bytes.store(0);
+    lastChannelFrames[channel] = 0;
+    channelRates[channel]      = 0.0;
+  }
+}
+
+CaptureMetrics::~CaptureMetrics()
+{
+  stop();
+}
+
+void CaptureMetrics::add_histogram(const char *name, const char *help,
+                                   const LatencyHistogram *histogram)
+{
+  NamedHistogram named = { name, help, histogram };
+
+  histograms.push_back(named);
+}
+
+//===============================================================================
+//      Create the listening socket
+//
+//===============================================================================
+bool CaptureMetrics::listen(const string& address_port)
+{
+  struct sockaddr_in address;
+  string             host  = "127.0.0.1";
+  string             port  = address_port;
+  size_t             colon = address_port.rfind(':');
+  char              *end;
+
+  if (colon != string::npos) {
+    host = address_port.substr(0, colon);
+    port = address_port.substr(colon + 1);
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  unsigned long number = strtoul(port.c_str(), &end, 10);
+  if (port.empty() || (*end != '\0') || (number == 0) || (number > 65535) ||
+      (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1)) {
+    errno = EINVAL;
+    return false;
+  }
+  address.sin_port = htons(number);
+
+  listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenFd < 0) {
+    return false;
+  }
+
+  int flag = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+  if ((bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0) ||
+      (::listen(listenFd, 16) != 0)) {
+    return false;
+  }
+
+  wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  return (wakeFd >= 0);
+}
+
+void CaptureMetrics::start(const ThreadTuning& tuning)
+{
+  this->tuning = tuning;
+  if (pthread_create(&thread, NULL, &metrics_thread, this) != 0) {
+    printf("\nERROR: Failed to start the metrics thread\n"
+           "Reason: %s\n\n", strerror(errno));
+    return;
+  }
+  started = true;
+}
+
+void CaptureMetrics::stop()
+{
+  if (started) {
+    uint64_t one = 1;
+    ssize_t  result = write(wakeFd, &one, sizeof(one));
+    (void)result;
+    pthread_join(thread, NULL);
+    started = false;
+  }
+  if (listenFd >= 0) {
+    close(listenFd);
+    listenFd = -1;
+  }
+  if (wakeFd >= 0) {
+    close(wakeFd);
+    wakeFd = -1;
+  }
+}
+
+void* CaptureMetrics::metrics_thread(void *pParams)
+{
+  static_cast<CaptureMetrics*>(pParams)->run();
+  return NULL;
+}
+
+//===============================================================================
+//      Metrics thread. Serves one request at a time and updates the
+//      rates every second.
+//
+//===============================================================================
+void CaptureMetrics::run()
+{
+  tune_thread(tuning, "metrics");
+
+  while (true) {
+    struct pollfd fds[2];
+    uint64_t      now     = monotonic_ns();
+    int           timeout = 0;
+
+    if (now - lastRateNs >= METRICS_RATE_INTERVAL_NS) {
+      update_rates();
+    }
+    else {
+      timeout = (METRICS_RATE_INTERVAL_NS - (now - lastRateNs)) / 1000000 + 1;
+    }
+
+    fds[0].fd     = listenFd;
+    fds[0].events = POLLIN;
+    fds[1].fd     = wakeFd;
+    fds[1].events = POLLIN;
+    if (poll(fds, 2, timeout) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[1].revents != 0) {
+      break;
+    }
+    if (fds[0].revents != 0) {
+      int fd;
+
+      while ((fd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+        serve(fd);
+        close(fd);
+      }
+    }
+  }
+}
+
+void CaptureMetrics::update_rates()
+{
+  uint64_t now     = monotonic_ns();
+  double   seconds = (now - lastRateNs) / 1e9;
+
+  for (uint32_t eid = 0; eid < EVENT_ID_COUNT; eid++) {
+    uint64_t frames = events[eid].frames.load(memory_order_relaxed);
+
+    eventRates[eid]      = (frames - lastEventFrames[eid]) / seconds;
+    lastEventFrames[eid] = frames;
+  }
+  for (int channel = 0; channel <= METRICS_CHANNELS; channel++) {
+    uint64_t frames = channels[channel].frames.load(memory_order_relaxed);
+
+    channelRates[channel]      = (frames - lastChannelFrames[channel]) / seconds;
+    lastChannelFrames[channel] = frames;
+  }
+  lastRateNs = now;
+}
+
+//===============================================================================
+//      Answer an HTTP request. Only GET of / and /metrics is supported.
+//
+//===============================================================================
+void CaptureMetrics::serve(int fd)
+{
+  struct timeval timeout = { METRICS_CLIENT_TIMEOUT_SEC, 0 };
+  string         request;
+  string         body;
+  const char    *status;
+
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  while ((request.find("\r\n\r\n") == string::npos) &&
+         (request.size() < MAX_METRICS_REQUEST_SIZE)) {
+    char    data[1024];
+    ssize_t received = recv(fd, data, sizeof(data), 0);
+
+    if (received <= 0) {
+      return;
+    }
+    request.append(data, received);
+  }
+
+  if ((request.compare(0, 13, "GET /metrics ") == 0) ||
+      (request.compare(0, 6, "GET / ") == 0)) {
+    status = "200 OK";
+    write_prometheus(body);
+  }
+  else if (request.compare(0, 4, "GET ") == 0) {
+    status = "404 Not Found";
+    body   = "Not found, use /metrics\n";
+  }
+  else {
+    status = "405 Method Not Allowed";
+    body   = "Only GET is supported\n";
+  }
+
+  string response;
+  append_format(response, "HTTP/1.0 %s\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: %lu\r\n"
+                "Connection: close\r\n\r\n", status, body.size());
+  response += body;
+
+  size_t sent = 0;
+  while (sent < response.size()) {
+    ssize_t result = send(fd, response.data() + sent, response.size() - sent,
+                          MSG_NOSIGNAL);
+    if (result <= 0) {
+      return;
+    }
+    sent += result;
+  }
+}
+
+//===============================================================================
+//      Append all metrics in the Prometheus text format
+//
+//===============================================================================
+void CaptureMetrics::write_prometheus(string& text) const
+{
+  append_format(text, "# HELP evhandl_capture_seconds Time since the capture "
+                "started\n# TYPE evhandl_capture_seconds gauge\n"
+                "evhandl_capture_seconds %.3f\n",
+                (monotonic_ns() - startNs) / 1e9);
+
+  text += "# HELP evhandl_frames_total Frames received per channel\n"
+          "# TYPE evhandl_frames_total counter\n";
+  for (int channel = 0; channel <= METRICS_CHANNELS; channel++) {
+    uint64_t frames = channels[channel].frames.load(memory_order_relaxed);
+    if (frames > 0) {
+      append_format(text, "evhandl_frames_total{channel=\"%s\"} %lu\n",
+                    channel_label(channel).c_str(), frames);
+    }
+  }
+  text += "# HELP evhandl_frame_bytes_total Octets received per channel, "
+          "headers included\n# TYPE evhandl_frame_bytes_total counter\n";
+  for (int channel = 0; channel <= METRICS_CHANNELS; channel++) {
+    if (channels[channel].frames.load(memory_order_relaxed) > 0) {
+      append_format(text, "evhandl_frame_bytes_total{channel=\"%s\"} %lu\n",
+                    channel_label(channel).c_str(),
+                    channels[channel].bytes.load(memory_order_relaxed));
+    }
+  }
+  text += "# HELP evhandl_frame_rate Frames per second received per "
+          "channel during the last second\n# TYPE evhandl_frame_rate gauge\n";
+  for (int channel = 0; channel <= METRICS_CHANNELS; channel++) {
+    if (channels[channel].frames.load(memory_order_relaxed) > 0) {
+      append_format(text, "evhandl_frame_rate{channel=\"%s\"} %.1f\n",
+                    channel_label(channel).c_str(), channelRates[channel]);
+    }
+  }
+
+  text += "# HELP evhandl_events_total Event frames received per Event ID\n"
+          "# TYPE evhandl_events_total counter\n";
+  for (uint32_t eid = 0; eid < EVENT_ID_COUNT; eid++) {
+    uint64_t frames = events[eid].frames.load(memory_order_relaxed);
+    if (frames > 0) {
+      append_format(text, "evhandl_events_total{eid=\"%u\"} %lu\n", eid,
+                    frames);
+    }
+  }
+  text += "# HELP evhandl_event_bytes_total Octets received per Event ID, "
+          "headers included\n# TYPE evhandl_event_bytes_total counter\n";
+  for (uint32_t eid = 0; eid < EVENT_ID_COUNT; eid++) {
+    if (events[eid].frames.load(memory_order_relaxed) > 0) {
+      append_format(text, "evhandl_event_bytes_total{eid=\"%u\"} %lu\n", eid,
+                    events[eid].bytes.load(memory_order_relaxed));
+    }
+  }
+  text += "# HELP evhandl_event_rate Event frames per second received per "
+          "Event ID during the last second\n"
+          "# TYPE evhandl_event_rate gauge\n";
+  for (uint32_t eid = 0; eid < EVENT_ID_COUNT; eid++) {
+    if (events[eid].frames.load(memory_order_relaxed) > 0) {
+      append_format(text, "evhandl_event_rate{eid=\"%u\"} %.1f\n", eid,
+                    eventRates[eid]);
+    }
+  }
+
+  frameHandling.write_prometheus(text, "evhandl_frame_handling_seconds",
+                                 "Time spent on a frame in the receive loop, "
+                                 "measured for a sample of the frames");
+  for (size_t n = 0; n < histograms.size(); n++) {
+    histograms[n].histogram->write_prometheus(text, histograms[n].name,
+                                              histograms[n].help);
+  }
+
+  if (collector != NULL) {
+    vector<MetricValue> values;
+
+    collector(values);
+    for (size_t n = 0; n < values.size(); n++) {
+      append_format(text, "# HELP %s %s\n# TYPE %s %s\n%s %.15g\n",
+                    values[n].name, values[n].help, values[n].name,
+                    values[n].type, values[n].name, values[n].value);
+    }
+  }
+}
+
+//===============================================================================
+//      Write all metrics as JSON. Rates are averages over the capture.
+//
+//===============================================================================
+bool CaptureMetrics::write_json(const string& name) const
+{
+  double seconds = (monotonic_ns() - startNs) / 1e9;
+  string text;
+  bool   first;
+
+  append_format(text, "{\n  \"captureSeconds\": %.3f,\n  \"channels\": [",
+                seconds);
+  first = true;
+  for (int channel = 0; channel <= METRICS_CHANNELS; channel++) {
+    uint64_t frames = channels[channel].frames.load(memory_order_relaxed);
+    if (frames > 0) {
+      append_format(text, "%s\n    {\"channel\": \"%s\", \"frames\": %lu, "
+                    "\"bytes\": %lu, \"rate\": %.1f}", first ? "" : ",",
+                    channel_label(channel).c_str(), frames,
+                    channels[channel].bytes.load(memory_order_relaxed),
+                    (seconds > 0) ? frames / seconds : 0.0);
+      first = false;
+    }
+  }
+  text += "\n  ],\n  \"events\": [";
+  first = true;
+  for (uint32_t eid = 0; eid < EVENT_ID_COUNT; eid++) {
+    uint64_t frames = events[eid].frames.load(memory_order_relaxed);
+    if (frames > 0) {
+      append_format(text, "%s\n    {\"eid\": %u, \"frames\": %lu, "
+                    "\"bytes\": %lu, \"rate\": %.1f}", first ? "" : ",", eid,
+                    frames, events[eid].bytes.load(memory_order_relaxed),
+                    (seconds > 0) ? frames / seconds : 0.0);
+      first = false;
+    }
+  }
+  text += "\n  ],\n  \"histograms\": {\n    \"evhandl_frame_handling_seconds\": ";
+  frameHandling.write_json(text);
+  for (size_t n = 0; n < histograms.size(); n++) {
+    append_format(text, ",\n    \"%s\": ", histograms[n].name);
+    histograms[n].histogram->write_json(text);
+  }
+  text += "\n  },\n  \"values\": {";
+  if (collector != NULL) {
+    vector<MetricValue> values;
+
+    collector(values);
+    for (size_t n = 0; n < values.size(); n++) {
+      append_format(text, "%s\n    \"%s\": %.15g", (n == 0) ? "" : ",",
+                    values[n].name, values[n].value);
+    }
+  }
+  text += "\n  }\n}\n";
+
+  FILE *file = fopen(name.c_str(), "w");
+  if (file == NULL) {
+    return false;
+  }
+  size_t written = fwrite(text.data(), 1, text.size(), file);
+  int    error   = errno;
+  if ((fclose(file) != 0) || (written != text.size())) {
+    if (written != text.size()) {
+      errno = error;
+    }
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,616 @@
+/*
+ *
+ * NAME: evhandl_multi_capture.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Capture from several BSCs in one process, see evhandl_multi_capture.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "evhandl_frame.h"
+#include "evhandl_multi_capture.h"
+#include "evhandl_output_file.h"
+
+using namespace std;
+
+
+// Receive buffer of each session
+const size_t  SESSION_RECEIVE_SIZE = 256 * 1024;
+
+// Max number of receive calls for one session before serving the others
+const int     MAX_RECEIVES_PER_WAKEUP = 16;
+
+const int     MAX_EPOLL_EVENTS = 64;
+
+struct SessionState {
+  enum { connecting, connected, subscribing, capturing, ended };
+};
+
+struct Session {
+  CaptureTarget   target;
+  int             state;
+  bool            captured;     // Reached the capturing state
+  int             fd;
+  bool            wantOutput;   // EPOLLOUT requested
+  vector<char>    rx;
+  size_t          rxStart;      // First octet not yet parsed
+  size_t          rxEnd;        // End of received octets
+  string          tx;           // Octets not yet sent
+  size_t          nextEvent;    // Index of the event to subscribe to
+  OutputFile     *out;
+  WriteBlock     *block;
+  uint64_t        frames;
+  uint64_t        bytes;
+  string          result;
+};
+
+// Monotonic time in seconds
+static time_t monotonic_sec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+
+MultiCapture::MultiCapture(int max_data_length, size_t write_buffer_size,
+                           uint64_t max_file_size, uint32_t max_logging_time)
+  : maxDataLength(max_data_length),
+    writeBufferSize(write_buffer_size),
+    maxFileSize(max_file_size),
+    maxLoggingTime(max_logging_time),
+    writer(NULL),
+    epollFd(-1),
+    activeSessions(0),
+    inputOpen(false),
+    stopReason(NULL)
+{
+}
+
+MultiCapture::~MultiCapture()
+{
+  for (size_t n = 0; n < sessions.size(); n++) {
+    delete sessions[n]->out;
+    delete sessions[n];
+  }
+  delete writer;
+  if (epollFd >= 0) {
+    close(epollFd);
+  }
+}
+
+void MultiCapture::add_target(const CaptureTarget& target)
+{
+  Session *session = new Session();
+
+  session->target     = target;
+  session->state      = SessionState::connecting;
+  session->captured   = false;
+  session->fd         = -1;
+  session->wantOutput = false;
+  session->rxStart    = 0;
+  session->rxEnd      = 0;
+  session->nextEvent  = 0;
+  session->out        = NULL;
+  session->block      = NULL;
+  session->frames     = 0;
+  session->bytes      = 0;
+
+  sessions.push_back(session);
+}
+
+//===============================================================================
+//      Open all files and connections and serve them until all sessions
+//      have ended
+//
+//===============================================================================
+int MultiCapture::run()
+{
+  // Each session keeps one block while the writer needs a few more
+  size_t min_buffer_size = (2 * sessions.size() + 2) * WRITE_BLOCK_SIZE;
+
+  writer = new BlockWriter((writeBufferSize > min_buffer_size) ?
+                           writeBufferSize : min_buffer_size);
+
+  for (size_t n = 0; n < sessions.size(); n++) {
+    Session *session = sessions[n];
+
+    session->out = create_output_file(Writer::stream, maxFileSize);
+    if (session->out->open(session->target.filename) == false) {
+      printf("Unable to open the file %s\n",
+             session->target.displayName.c_str());
+      printf("Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+    session->block = writer->acquire(session->out,
+                                     session->target.displayName.c_str());
+  }
+  writer->start();
+
+  epollFd = epoll_create1(0);
+  if (epollFd < 0) {
+    printf("\nERROR: Failed to create epoll instance\n"
+           "Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+
+  // The user quits by entering 'q' on stdin
+  struct epoll_event input_event;
+  input_event.events   = EPOLLIN;
+  input_event.data.ptr = NULL;
+  inputOpen = (epoll_ctl(epollFd, EPOLL_CTL_ADD, STDIN_FILENO,
+                         &input_event) == 0);
+
+  printf("\nOpening connections to %lu BSCs\n", sessions.size());
+  for (size_t n = 0; n < sessions.size(); n++) {
+    start_session(sessions[n]);
+  }
+
+  printf("\nTo quit press: 'q' or 'Q' + <ENTER> or <RETRUN>\n\n\n");
+  fflush(stdout);
+
+  time_t start_sec = monotonic_sec();
+  time_t last_sec  = start_sec;
+
+  while (activeSessions > 0) {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int n = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, 1000);
+
+    if ((n < 0) && (errno != EINTR)) {
+      printf("\nERROR: Waiting for events failed\n"
+             "Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+
+    for (int i = 0; i < n; i++) {
+      Session *session = (Session *)events[i].data.ptr;
+
+      if (session == NULL) {
+        handle_input();
+        continue;
+      }
+      if ((session->state != SessionState::ended) &&
+          (events[i].events & EPOLLOUT)) {
+        handle_output(session);
+      }
+      if ((session->state != SessionState::ended) &&
+          (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        handle_receive(session);
+      }
+    }
+
+    // Housekeeping once a second, i.e. at no cost per frame
+    time_t now = monotonic_sec();
+    if (now != last_sec) {
+      last_sec = now;
+      flush_sessions();
+      print_statistics();
+
+      if ((stopReason == NULL) && (now - start_sec > (time_t)maxLoggingTime)) {
+        stopReason = "Max logging time exceeded. Logging Stopped";
+      }
+    }
+
+    if (stopReason != NULL) {
+      for (size_t s = 0; s < sessions.size(); s++) {
+        if (sessions[s]->state != SessionState::ended) {
+          end_session(sessions[s], stopReason);
+        }
+      }
+    }
+  }
+
+  // All files are closed by the writer thread after their last block
+  writer->stop();
+  print_statistics();
+  printf("\n");
+  if (stopReason != NULL) {
+    printf("\n%s\n", stopReason);
+  }
+  print_summary();
+
+  int failed = 0;
+  for (size_t n = 0; n < sessions.size(); n++) {
+    if (!sessions[n]->captured) {
+      failed++;
+    }
+  }
+  return failed;
+}
+
+//===============================================================================
+//      Start a non-blocking connect towards the BSC
+//
+//===============================================================================
+void MultiCapture::start_session(Session *session)
+{
+  struct sockaddr_in bsc_address;
+  int                flag = 1;
+
+  activeSessions++;
+
+  memset(&bsc_address, 0, sizeof(bsc_address));
+  bsc_address.sin_family      = AF_INET;
+  bsc_address.sin_port        = htons(session->target.port);
+  bsc_address.sin_addr.s_addr = inet_addr(session->target.ip.c_str());
+
+  session->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (session->fd < 0) {
+    end_session(session, string("Could not create a socket. ") +
+                strerror(errno));
+    return;
+  }
+  setsockopt(session->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+  session->rx.resize(SESSION_RECEIVE_SIZE);
+
+  if ((connect(session->fd, (struct sockaddr *)&bsc_address,
+               sizeof(bsc_address)) < 0) && (errno != EINPROGRESS)) {
+    end_session(session, string("Socket connection failed. ") +
+                strerror(errno));
+    return;
+  }
+
+  // Writable when connected
+  struct epoll_event event;
+  event.events   = EPOLLIN | EPOLLOUT;
+  event.data.ptr = session;
+  session->wantOutput = true;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, session->fd, &event) != 0) {
+    end_session(session, string("Could not watch the socket. ") +
+                strerror(errno));
+  }
+}
+
+//===============================================================================
+//      End a session. The file is closed by the writer thread once the
+//      last block has been written.
+//
+//===============================================================================
+void MultiCapture::end_session(Session *session, const string& result)
+{
+  if (session->fd >= 0) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, session->fd, NULL);
+    shutdown(session->fd, SHUT_RDWR);
+    close(session->fd);
+    session->fd = -1;
+  }
+
+  writer->submit(session->block, true, true);
+  session->block  = NULL;
+  session->state  = SessionState::ended;
+  session->result = result;
+  session->rx.clear();
+  session->tx.clear();
+
+  activeSessions--;
+}
+
+//===============================================================================
+//      Stop all sessions when the user enters 'q' or 'Q'
+//
+//===============================================================================
+void MultiCapture::handle_input()
+{
+  char    input[64];
+  ssize_t n = read(STDIN_FILENO, input, sizeof(input));
+
+  if (n <= 0) {
+    // No more input, e.g. stdin redirected from /dev/null
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+    inputOpen = false;
+    return;
+  }
+
+  for (ssize_t i = 0; i < n; i++) {
+    if ((input[i] | (char)0x20) == 'q') {
+      stopReason = "Logging stopped by user";
+    }
+  }
+}
+
+//===============================================================================
+//      The socket is writable, i.e. connected or with room for more of a
+//      pending request
+//
+//===============================================================================
+void MultiCapture::handle_output(Session *session)
+{
+  if (session->state == SessionState::connecting) {
+    int       error  = 0;
+    socklen_t length = sizeof(error);
+
+    getsockopt(session->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error != 0) {
+      end_session(session, string("Socket connection failed. ") +
+                  strerror(error));
+      return;
+    }
+
+    char request[CONNECT_REQUEST_LENGTH];
+    int  request_length = build_connect_request(request);
+
+    // The connect request is logged like in the single BSC capture. It
+    // is logged before it is sent, as a failed send ends the session
+    // and releases its block.
+    session->state = SessionState::connected;
+    write_frame(session, request, request_length);
+    send_message(session, request, request_length);
+    return;
+  }
+
+  while (!session->tx.empty()) {
+    ssize_t n = send(session->fd, session->tx.data(), session->tx.size(),
+                     MSG_NOSIGNAL);
+
+    if (n < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        return;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      end_session(session, string("Writing to socket failed. ") +
+                  strerror(errno));
+      return;
+    }
+    session->tx.erase(0, n);
+  }
+
+  struct epoll_event event;
+  event.events   = EPOLLIN;
+  event.data.ptr = session;
+  session->wantOutput = false;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, session->fd, &event);
+}
+
+//===============================================================================
+//      Send a request, queueing what does not fit in the socket until it is
+//      writable again
+//
+//===============================================================================
+void MultiCapture::send_message(Session *session, const char *message,
+                                int length)
+{
+  session->tx.append(message, length);
+  handle_output(session);
+}
+
+//===============================================================================
+//      Receive what is available and handle all complete frames
+//
+//===============================================================================
+void MultiCapture::handle_receive(Session *session)
+{
+  for (int calls = 0; calls < MAX_RECEIVES_PER_WAKEUP; calls++) {
+    // Make room for a complete frame after the unparsed octets
+    if (session->rx.size() - session->rxEnd <
+        (size_t)(FRAME_HEADER_LENGTH + maxDataLength)) {
+      memmove(&session->rx[0], &session->rx[session->rxStart],
+              session->rxEnd - session->rxStart);
+      session->rxEnd  -= session->rxStart;
+      session->rxStart = 0;
+    }
+
+    ssize_t n = recv(session->fd, &session->rx[session->rxEnd],
+                     session->rx.size() - session->rxEnd, 0);
+
+    if (n == 0) {
+      end_session(session, "Connection closed by BSC");
+      return;
+    }
+    if (n < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        return;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      end_session(session, string("Reading from socket failed. ") +
+                  strerror(errno));
+      return;
+    }
+    session->rxEnd += n;
+
+    while (session->rxEnd - session->rxStart >= (size_t)FRAME_HEADER_LENGTH) {
+      const char *frame       = &session->rx[session->rxStart];
+      int         data_length = frame_data_length(frame);
+
+      if (data_length > maxDataLength) {
+        char reason[128];
+
+        snprintf(reason, sizeof(reason),
+                 "Event length too long, %d bytes stated", data_length);
+        end_session(session, reason);
+        return;
+      }
+      if (session->rxEnd - session->rxStart <
+          (size_t)(FRAME_HEADER_LENGTH + data_length)) {
+        break;
+      }
+
+      session->rxStart += FRAME_HEADER_LENGTH + data_length;
+      handle_frame(session, frame, FRAME_HEADER_LENGTH + data_length);
+      if (session->state == SessionState::ended) {
+        return;
+      }
+    }
+    if (session->rxStart == session->rxEnd) {
+      session->rxStart = 0;
+      session->rxEnd   = 0;
+    }
+  }
+}
+
+//===============================================================================
+//      Handle a complete frame depending on the state of the session. Event
+//      data received during the subscriptions is written as well.
+//
+//===============================================================================
+void MultiCapture::handle_frame(Session *session, const char *frame,
+                                int length)
+{
+  bool control = (frame_channel(frame) == CONTROL_CHANNEL);
+
+  switch (session->state) {
+  case SessionState::connected:
+    if (length < CONNECT_REPLY_LENGTH) {
+      end_session(session, "Connection failed. Invalid reply.");
+      return;
+    }
+    if (frame[CONNECT_RESULT_INDEX] != 0) {
+      end_session(session, string("Connection failed. ") +
+                  connection_result_text(frame[CONNECT_RESULT_INDEX]));
+      return;
+    }
+    write_frame(session, frame, length);
+    session->state = SessionState::subscribing;
+    send_next_subscription(session);
+    break;
+
+  case SessionState::subscribing:
+    if (!control) {
+      write_frame(session, frame, length);
+    }
+    else if ((length >= FRAME_HEADER_LENGTH + 4) &&
+             ((frame[FRAME_HEADER_LENGTH + 2] != 0) ||
+              (frame[FRAME_HEADER_LENGTH + 3] != 0))) {
+      char reason[64];
+
+      snprintf(reason, sizeof(reason), "Subscription of event %d failed. ",
+               session->target.events[session->nextEvent - 1]);
+      end_session(session, reason +
+                  string(subscription_result_text(frame[FRAME_HEADER_LENGTH + 3])));
+    }
+    else {
+      send_next_subscription(session);
+    }
+    break;
+
+  case SessionState::capturing:
+    write_frame(session, frame, length);
+    if (session->bytes > maxFileSize) {
+      end_session(session, "Maximum file size reached");
+    }
+    break;
+  }
+}
+
+//===============================================================================
+//      Subscribe to the next event, or start capturing when subscribed to
+//      all events
+//
+//===============================================================================
+void MultiCapture::send_next_subscription(Session *session)
+{
+  if (session->nextEvent == session->target.events.size()) {
+    session->state    = SessionState::capturing;
+    session->captured = true;
+    return;
+  }
+
+  char request[MAX_SUBSCRIPTION_REQUEST_LENGTH];
+  int  length = build_subscription_request(request,
+                                           session->target.events[session->nextEvent],
+                                           &session->target.cells[0],
+                                           session->target.msIdBuff,
+                                           session->target.msId,
+                                           session->target.cmd);
+  session->nextEvent++;
+  send_message(session, request, length);
+}
+
+void MultiCapture::write_frame(Session *session, const char *frame, int length)
+{
+  session->block = writer->append(session->block, frame, length);
+  session->frames++;
+  session->bytes += length;
+}
+
+//===============================================================================
+//      Let the writer thread flush all files max every second
+//
+//===============================================================================
+void MultiCapture::flush_sessions()
+{
+  for (size_t n = 0; n < sessions.size(); n++) {
+    Session *session = sessions[n];
+
+    if ((session->state != SessionState::ended) && (session->block->used > 0)) {
+      writer->submit(session->block, true);
+      session->block = writer->acquire(session->out,
+                                       session->target.displayName.c_str());
+    }
+  }
+}
+
+//===============================================================================
+//      Print the statistics of all sessions together
+//
+//===============================================================================
+void MultiCapture::print_statistics()
+{
+  uint32_t capturing = 0;
+  uint64_t frames    = 0;
+  uint64_t bytes     = 0;
+
+  for (size_t n = 0; n < sessions.size(); n++) {
+    if (sessions[n]->state == SessionState::capturing) {
+      capturing++;
+    }
+    frames += sessions[n]->frames;
+    bytes  += sessions[n]->bytes;
+  }
+
+  printf("Capturing: %3u/%-3lu  Events: %10lu  FileSize: %8lu KB  "
+         "BufHWM: %3lu%%  Stall: %6lu ms\r",
+         capturing, sessions.size(), frames, bytes/1000,
+         writer->high_water_mark() * 100 / writer->capacity(),
+         writer->stall_time_ms());
+  fflush(stdout);
+}
+
+//===============================================================================
+//      Print the result of each session
+//
+//===============================================================================
+void MultiCapture::print_summary()
+{
+  printf("\n%-21s %10s %11s  %s\n", "BSC", "Events", "FileSize", "Result");
+
+  for (size_t n = 0; n < sessions.size(); n++) {
+    Session *session = sessions[n];
+    char     address[64];
+
+    snprintf(address, sizeof(address), "%s:%d", session->target.ip.c_str(),
+             session->target.port);
+    printf("%-21s %10lu %8lu KB  %s\n", address, session->frames,
+           session->bytes/1000, session->result.c_str());
+  }
+  printf("\n");
+  fflush(stdout);
+}
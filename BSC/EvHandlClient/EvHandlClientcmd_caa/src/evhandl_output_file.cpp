@@ -0,0 +1,530 @@
+/*
+ *
+ * NAME: evhandl_output_file.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Log file writers, see evhandl_output_file.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "evhandl_output_file.h"
+#include "evhandl_writeback.h"
+
+using namespace std;
+
+
+// Alignment of buffers, file offsets and lengths used with O_DIRECT
+const size_t  DIRECT_IO_ALIGNMENT = 4096;
+
+// Size of the staging buffer, i.e. the size of each direct write
+const size_t  DIRECT_IO_STAGING_SIZE = 1024 * 1024;
+
+// Size of the part of the file mapped at a time by MappedOutputFile, a
+// multiple of the page size
+const size_t  MAPPED_WINDOW_SIZE = 64 * 1024 * 1024;
+
+// Not defined by older headers, see linux/mman.h
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+// Write all octets at the given offset
+static bool pwrite_all(int fd, const char *data, size_t length, uint64_t offset)
+{
+  while (length > 0) {
+    ssize_t n = pwrite(fd, data, length, offset);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data   += n;
+    length -= n;
+    offset += n;
+  }
+  return true;
+}
+
+
+//===============================================================================
+//      StreamOutputFile
+//
+//===============================================================================
+bool StreamOutputFile::open(const string& name)
+{
+  out.open(name.c_str(), ios::out|ios::binary);
+  return out.is_open();
+}
+
+bool StreamOutputFile::write(const char *data, size_t length)
+{
+  out.write(data, length);
+  return !out.bad();
+}
+
+bool StreamOutputFile::flush()
+{
+  out.flush();
+  return !out.bad();
+}
+
+bool StreamOutputFile::close()
+{
+  out.close();
+  return !out.fail();
+}
+
+
+//===============================================================================
+//      DirectOutputFile
+//
+//===============================================================================
+DirectOutputFile::DirectOutputFile(uint64_t preallocate_size)
+  : preallocateSize(preallocate_size),
+    fd(-1),
+    staging(NULL),
+    stagingUsed(0),
+    fileOffset(0)
+{
+}
+
+DirectOutputFile::~DirectOutputFile()
+{
+  if (fd >= 0) {
+    close();
+  }
+  free(staging);
+}
+
+bool DirectOutputFile::open(const string& name)
+{
+  void *buffer;
+
+  if (posix_memalign(&buffer, DIRECT_IO_ALIGNMENT, DIRECT_IO_STAGING_SIZE) != 0) {
+    errno = ENOMEM;
+    return false;
+  }
+  staging = (char *)buffer;
+
+  fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+  if (fd < 0) {
+    return false;
+  }
+
+  preallocate(true);
+  return true;
+}
+
+//===============================================================================
+//      Allocate the rest of the file up front. The file size is not
+//      changed, the file only grows as written. Failing to preallocate
+//      (e.g. not supported, or more than the quota) is not fatal; the
+//      file then gets its blocks as it is written.
+//
+//===============================================================================
+void DirectOutputFile::preallocate(bool note_failure)
+{
+  uint64_t end = fileOffset + stagingUsed;
+
+  if (preallocateSize <= end) {
+    return;
+  }
+  if ((fallocate(fd, FALLOC_FL_KEEP_SIZE, end, preallocateSize - end) != 0) &&
+      note_failure) {
+    printf("\nNote: Could not preallocate the log file.\n"
+           "Reason: %s\n", strerror(errno));
+  }
+}
+
+//===============================================================================
+//      Stage the data and write each time a full staging buffer has been
+//      collected
+//
+//===============================================================================
+bool DirectOutputFile::write(const char *data, size_t length)
+{
+  while (length > 0) {
+    size_t chunk = DIRECT_IO_STAGING_SIZE - stagingUsed;
+
+    if (chunk > length) {
+      chunk = length;
+    }
+    memcpy(staging + stagingUsed, data, chunk);
+    stagingUsed += chunk;
+    data        += chunk;
+    length      -= chunk;
+
+    if (stagingUsed == DIRECT_IO_STAGING_SIZE) {
+      if (!pwrite_all(fd, staging, DIRECT_IO_STAGING_SIZE, fileOffset)) {
+        return false;
+      }
+      fileOffset  += DIRECT_IO_STAGING_SIZE;
+      stagingUsed  = 0;
+    }
+  }
+  return true;
+}
+
+//===============================================================================
+//      The staged tail is written padded to the alignment. It stays in the
+//      staging buffer and is written again, completed, by later writes.
+//      The padding is cut off at once, so that the file never ends with
+//      zeros, which would be read as empty frames by a reader of the
+//      file or after a crash.
+//
+//===============================================================================
+bool DirectOutputFile::write_staged_tail()
+{
+  if (stagingUsed == 0) {
+    return true;
+  }
+
+  size_t padded = (stagingUsed + DIRECT_IO_ALIGNMENT - 1) &
+                  ~(DIRECT_IO_ALIGNMENT - 1);
+
+  memset(staging + stagingUsed, 0, padded - stagingUsed);
+  return (pwrite_all(fd, staging, padded, fileOffset) &&
+          (ftruncate(fd, fileOffset + stagingUsed) == 0));
+}
+
+//===============================================================================
+//      Cutting the padding also frees the space preallocated beyond it,
+//      which is allocated again
+//
+//===============================================================================
+bool DirectOutputFile::flush()
+{
+  if (stagingUsed == 0) {
+    return true;
+  }
+  if (!write_staged_tail()) {
+    return false;
+  }
+  preallocate(false);
+  return true;
+}
+
+bool DirectOutputFile::close()
+{
+  bool result = write_staged_tail();
+
+  // Free any preallocated space beyond the real length
+  if (result && (ftruncate(fd, fileOffset + stagingUsed) != 0)) {
+    result = false;
+  }
+
+  if ((::close(fd) != 0) && result) {
+    result = false;
+  }
+  fd = -1;
+
+  return result;
+}
+
+
+//===============================================================================
+//      MappedOutputFile
+//
+//===============================================================================
+MappedOutputFile::MappedOutputFile()
+  : fd(-1),
+    window(NULL),
+    windowOffset(0),
+    windowUsed(0)
+{
+}
+
+MappedOutputFile::~MappedOutputFile()
+{
+  if (fd >= 0) {
+    close();
+  }
+}
+
+bool MappedOutputFile::open(const string& name)
+{
+  fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+  return (fd >= 0);
+}
+
+//===============================================================================
+//      Allocate a window beyond the end of the file and map it. Mapping the
+//      next window instead of growing the mapping with mremap() keeps the
+//      address space used constant however long the capture runs.
+//
+//===============================================================================
+bool MappedOutputFile::map_next_window()
+{
+  if (window != NULL) {
+    msync(window, MAPPED_WINDOW_SIZE, MS_ASYNC);
+    munmap(window, MAPPED_WINDOW_SIZE);
+    window        = NULL;
+    windowOffset += MAPPED_WINDOW_SIZE;
+    windowUsed    = 0;
+  }
+
+  // Allocate the blocks of the window without changing the file size.
+  // A file system that cannot allocate up front gets the blocks as the
+  // pages are written back instead.
+  if ((fallocate(fd, FALLOC_FL_KEEP_SIZE, windowOffset,
+                 MAPPED_WINDOW_SIZE) != 0) && (errno != EOPNOTSUPP)) {
+    return false;
+  }
+
+  // Pages beyond the end of the file can not be touched, they are
+  // faulted in as the file grows, see grow()
+  void *address = mmap(NULL, MAPPED_WINDOW_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, windowOffset);
+  if (address == MAP_FAILED) {
+    return false;
+  }
+  window = (char *)address;
+  madvise(window, MAPPED_WINDOW_SIZE, MADV_SEQUENTIAL);
+  return true;
+}
+
+//===============================================================================
+//      Grow the file to cover the octets about to be copied. Their pages
+//      are faulted in with one call instead of a page fault per page, the
+//      call is not supported before Linux 5.14 and then skipped.
+//
+//===============================================================================
+bool MappedOutputFile::grow(size_t length)
+{
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+  if (ftruncate(fd, windowOffset + windowUsed + length) != 0) {
+    return false;
+  }
+
+  size_t first = windowUsed & ~(page_size - 1);
+
+  madvise(window + first, windowUsed + length - first, MADV_POPULATE_WRITE);
+  return true;
+}
+
+bool MappedOutputFile::write(const char *data, size_t length)
+{
+  while (length > 0) {
+    if ((window == NULL) || (windowUsed == MAPPED_WINDOW_SIZE)) {
+      if (!map_next_window()) {
+        return false;
+      }
+    }
+
+    size_t chunk = MAPPED_WINDOW_SIZE - windowUsed;
+
+    if (chunk > length) {
+      chunk = length;
+    }
+    if (!grow(chunk)) {
+      return false;
+    }
+    memcpy(window + windowUsed, data, chunk);
+    windowUsed += chunk;
+    data       += chunk;
+    length     -= chunk;
+  }
+  return true;
+}
+
+//===============================================================================
+//      The copied data is already in the page cache, only start the
+//      write back of the window
+//
+//===============================================================================
+bool MappedOutputFile::flush()
+{
+  if (window == NULL) {
+    return true;
+  }
+  return (msync(window, MAPPED_WINDOW_SIZE, MS_ASYNC) == 0);
+}
+
+bool MappedOutputFile::close()
+{
+  bool result = true;
+
+  if (window != NULL) {
+    munmap(window, MAPPED_WINDOW_SIZE);
+    window = NULL;
+  }
+
+  // Free the unused part of the last window
+  if (ftruncate(fd, windowOffset + windowUsed) != 0) {
+    result = false;
+  }
+
+  if ((::close(fd) != 0) && result) {
+    result = false;
+  }
+  fd = -1;
+
+  return result;
+}
+
+
+//===============================================================================
+//      SegmentedOutputFile
+//
+//===============================================================================
+SegmentedOutputFile::SegmentedOutputFile(int writer_type,
+                                         uint64_t segment_size,
+                                         uint32_t segment_time,
+                                         uint32_t max_segments,
+                                         Writeback *writeback)
+  : writerType(writer_type),
+    writeback(writeback),
+    segmentSize(segment_size),
+    segmentTime(segment_time),
+    maxSegments(max_segments),
+    segmentNumber(0),
+    segment(NULL),
+    segmentBytes(0),
+    segmentStart(0)
+{
+}
+
+SegmentedOutputFile::~SegmentedOutputFile()
+{
+  delete segment;
+}
+
+bool SegmentedOutputFile::open(const string& name)
+{
+  baseName = name;
+  return open_next_segment();
+}
+
+//===============================================================================
+//      Close the current segment, open the next one and remove the oldest
+//      segments beyond the number to keep
+//
+//===============================================================================
+bool SegmentedOutputFile::open_next_segment()
+{
+  if (segment != NULL) {
+    bool closed = segment->close();
+
+    delete segment;
+    segment = NULL;
+    if (!closed) {
+      return false;
+    }
+  }
+
+  segmentNumber++;
+  string name = segment_file_name(baseName, segmentNumber);
+
+  segment = create_output_file(writerType, segmentSize, writeback);
+  if (!segment->open(name)) {
+    return false;
+  }
+  segmentBytes = 0;
+  segmentStart = time(NULL);
+
+  segments.push_back(name);
+  while (segments.size() > maxSegments) {
+    unlink(segments.front().c_str());
+    segments.pop_front();
+  }
+
+  return true;
+}
+
+bool SegmentedOutputFile::write(const char *data, size_t length)
+{
+  if ((segmentBytes > 0) &&
+      ((segmentBytes + length > segmentSize) ||
+       (time(NULL) >= segmentStart + (time_t)segmentTime))) {
+    if (!open_next_segment()) {
+      return false;
+    }
+  }
+
+  segmentBytes += length;
+  return segment->write(data, length);
+}
+
+bool SegmentedOutputFile::flush()
+{
+  return segment->flush();
+}
+
+bool SegmentedOutputFile::close()
+{
+  bool result = segment->close();
+
+  delete segment;
+  segment = NULL;
+
+  return result;
+}
+
+
+//===============================================================================
+//      Create a file writer
+//
+//===============================================================================
+OutputFile* create_output_file(int writer_type, uint64_t max_file_size,
+                               Writeback *writeback)
+{
+  OutputFile *file;
+
+  if (writer_type == Writer::direct) {
+    file = new DirectOutputFile(max_file_size);
+  }
+  else if (writer_type == Writer::mapped) {
+    file = new MappedOutputFile();
+  }
+  else {
+    file = new StreamOutputFile();
+  }
+
+  if (writeback != NULL) {
+    file = new WritebackOutputFile(file, *writeback);
+  }
+  return file;
+}
+
+//===============================================================================
+//      Name of a segment, e.g. logfile_rpmo.rpm -> logfile_rpmo.0001.rpm
+//
+//===============================================================================
+string segment_file_name(const string& name, uint32_t number)
+{
+  char   number_str[16];
+  size_t dot   = name.rfind('.');
+  size_t slash = name.rfind('/');
+
+  snprintf(number_str, sizeof(number_str), ".%04u", number);
+
+  if ((dot == string::npos) || ((slash != string::npos) && (dot < slash))) {
+    return name + number_str;
+  }
+  return name.substr(0, dot) + number_str + name.substr(dot);
+}
@@ -0,0 +1,389 @@
+/*
+ *
+ * NAME: evhandl_protocol.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  BSC Event Handler control messages, see evhandl_protocol.h
+ */
+
+
+// Module Include Files
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "evhandl_protocol.h"
+
+
+//===============================================================================
+//      Build a connect request
+//
+//===============================================================================
+int build_connect_request(char *buffer)
+{
+  buffer[0] = 0; // Length of the data
+  buffer[1] = 1; // Length of the data
+  buffer[2] = 0; // Channel
+  buffer[3] = 0; // Channel
+  buffer[4] = 0; // CMN = Connect
+  buffer[5] = CMN_CONNECT;
+
+  return CONNECT_REQUEST_LENGTH;
+}
+
+//===============================================================================
+//      Build a subscription request for one event with the given cell and
+//      MS filters
+//
+//===============================================================================
+int build_subscription_request(char *buffer, int eid, const int *cell_list,
+                               const char *msFlt, int msId, int cmd)
+{
+  int buffPos = 0;
+
+  // Assemble a Subscribe request
+  buffer[0] = 0;   // Length.msb
+  buffer[1] = 0;   // Length.lsb will be set later
+  buffer[2] = 0;   // Channel.msb
+  buffer[3] = 0;   // Channel.lsb
+  buffer[4] = 0;   // CMN, subscribe on events.msb
+  buffer[5] = CMN_SUBSCRIBE; // CMN, subscribe on events.lsb
+  buffer[6] = (uint8_t)((eid & 0xFF00) >> 8); // EID, msb
+  buffer[7] = (uint8_t)(eid & 0xFF); // EID, lsb
+  
+  // If the EID is one of the System Events, then filtering is not allowed.
+  // System Events are defined as EID between 0xFF00 and 0xFFFF, this is
+  // captured in the EID_SYSTEM_EVENT_MASK constant.
+  //
+  // But there are a also two special cases when GMLog application is used
+  // that we must check for (the trouble-shooting events for RP and CP)
+  if ((eid & EID_SYSTEM_EVENT_MASK) ||
+      ((cmd == InvokedAs::GMLog) &&
+       ((eid == GMLOG_EID_TROUBLE_SHOOTING_RP) ||
+        (eid == GMLOG_EID_TROUBLE_SHOOTING_CP)))) {
+    // This eid does not support any filter
+    buffer[8] = 0;   // cell pointer list len.msb
+    buffer[9] = 0;   // cell pointer list len.lsb
+    buffPos = 10;
+    buffer[buffPos++] = 0;  // filterlength.msb
+    buffer[buffPos++] = 0;  // filterlength.lsb
+  }
+  else {
+    // Check cell option and add cells into message
+    if (cell_list[0] == -1) {
+      // No cells, set cell pointer list length to zero.
+      // Option only available for GMLog
+      buffer[8] = 0; // msb
+      buffer[9] = 0; // lsb
+      buffPos = 10;
+    }
+    else if (cell_list[0] == 0xFFFF) {
+      // All cells. Option only available for RPMO
+      buffer[8] = 0xFF;
+      buffer[9] = 0xFF;
+      buffPos = 10;
+    }
+    else if ((cell_list[0] != -1) && (cell_list[0] != 0xFFFF)){
+      // One or several cells. Several cells only available for RPMO
+      int cellIndex = 0;
+      buffPos       = 10;
+
+      while (cell_list[cellIndex] != -1) {
+        buffer[buffPos++] = (cell_list[cellIndex] & 0xFF00) >> 8; // Cellpointer.msb
+        buffer[buffPos++] = (cell_list[cellIndex] & 0xFF);      // Cellpointer.lsb
+        cellIndex++;
+      }
+      // Set cell pointer list length
+      buffer[8] = (cellIndex & 0xFF00) >> 8; // Cellpointer list length.msb
+      buffer[9] = (cellIndex & 0xFF);        // Cellpointer list length.lsb
+    }
+
+    //If any filter on MS id active
+    switch (msId) {
+    case MsId::IMSI:
+      buffer[buffPos++] = 0;                  //filter length.msb
+      buffer[buffPos++] = IMSI_FILTER_LENGTH; //filter length.lsb in words
+      buffer[buffPos++] = 0;                  //filterid.msb
+      buffer[buffPos++] = IMSI_FILTER_ID;     //filterid.lsb,
+
+      // Copy filter into buffer
+      for (int i = 0; i < IMSI_LENGTH; i++) {
+        buffer[buffPos++] = msFlt[i];
+      }
+      break;
+    case MsId::TLLI:
+      buffer[buffPos++] = 0;                  //filter length.msb
+      buffer[buffPos++] = TLLI_FILTER_LENGTH; //filter length.lsb
+      buffer[buffPos++] = 0;                  //filterid.msb
+      buffer[buffPos++] = TLLI_FILTER_ID;     //filterid.lsb
+
+      // Copy filter into buffer
+      for (int i = 0; i < TLLI_LENGTH; i++) {
+        buffer[buffPos++] = msFlt[i];
+      }
+      break;
+    case MsId::none:
+      buffer[buffPos++] = 0;
+      buffer[buffPos++] = 0;
+      break;
+    }
+  }
+
+  // Set length of message in words, more than 255 words with many cells
+  buffer[0] = (uint8_t)((((buffPos/2)-2) & 0xFF00) >> 8);
+  buffer[1] = (uint8_t)(((buffPos/2)-2) & 0xFF);
+
+  return buffPos;
+}
+
+//===============================================================================
+//      Reason for a failed connect request
+//
+//===============================================================================
+const char* connection_result_text(int result)
+{
+  switch (result) {
+  case 2:
+    return "The client is not authorised to connect.";
+  case 3:
+    return "The BSC can not handle the request. Try again later.";
+  case 4:
+    return "The CMN is invalid.";
+  case 5:
+    return "The client is already connected.";
+  }
+  return "";
+}
+
+//===============================================================================
+//      Reason for a failed subscription request
+//
+//===============================================================================
+const char* subscription_result_text(int result)
+{
+  switch (result) {
+  case 1:
+    return "The subscription failed for the following cells.";
+  case 3:
+    return "The BSC can not handle the request. Try again later.";
+  case 4:
+    return "The CMN is invalid.";
+  case 6:
+    return "The client is not connected.";
+  case 7:
+    return "Submitted EID is invalid.";
+  case 8:
+    return "Submitted Cell Pointer List is invalid.";
+  case 9:
+    return "The subscription failed. The reason is unknown.";
+  case 10:
+    return "It is not allowed to subscribe to the EID.";
+  case 11:
+    return "Submitted filter is invalid.";
+  case 13:
+    return "High load.";
+  }
+  return "";
+}
+
+//===============================================================================
+//      Assemble TLLI as coded in the GMLog IWD
+//
+//===============================================================================
+void assemble_tlli(char *tlli_buff, char *tlli) {
+  uint32_t  tlli_int = atoi(tlli);
+
+  tlli_buff[0] = (tlli_int & 0xff00) >> 8;
+  tlli_buff[1] =  tlli_int & 0xff;
+  tlli_buff[2] = (tlli_int & 0xff000000) >> 24;
+  tlli_buff[3] = (tlli_int & 0xff0000) >> 16;
+}
+
+//===============================================================================
+//      Assemble IMSI as coded in the GMLog IWD
+//
+//===============================================================================
+void assemble_imsi(char *imsi_buff, const char *imsi) {
+  const int imsi_length = strlen(imsi);
+  
+  // IWD specifies contents using DW16 and here we use octets, i.e.
+  //
+  // |    DW0    |     DW1     |     DW2     |     DW3     |     DW4     |
+  // +-----+-----+------+------+------+------+------+------+------+------+
+  // |  0  |  1  |   2  |   3  |   4  |   5  |   6  |   7  |   8  |   9  |
+  // +-----+-----+------+------+------+------+------+------+------+------+
+  // | b15 - b00 | b15  -  b00 | b15  -  b00 | b15  -  b00 | b15  -  b00 |
+  //             | d3 d2  d1 --| d7 d6  d5 d4|d11 d10 d9 d8|d12d13 d14d15|
+  //             | n3 n2  n1 --| n3 n2  n1 n0| n3 n2  n1 n0| n3 n2  n1 n0|
+  //
+  // DWx == Data Word x
+  // bxx == bit xx
+  // dxx == digit xx
+  // nxx == nibble xx in Data Word (nibble == 4 bit section of octet)
+
+  imsi_buff[0] = 0; // DW0, b08-b15; spare
+  imsi_buff[1] = 8; // DW0, b00-b07; length in octets
+
+  // DW1, b00-b02; type of identity to "1", i.e. IMSI
+  // DW1,     b03; odd/even flag (even = 0, odd = 1)
+  switch (imsi_length) {
+  case 14:
+    /**  Digit #1 -+        even -+       ID -+
+    //   __________|_________     |     ______|_______
+    //  /                    \    |    /              \
+    // +-----+-----+-----+-----+-----+-----+-----+-----+
+    // |  0  |  0  |  0  |  0  |  0  |  0  |  0  |  1  |
+    // +-----+-----+-----+-----+-----+-----+-----+-----+
+    //   b07   b06   b05   b04   b03   b02   b01   b00
+    **/
+    imsi_buff[3] = 0x01;
+    break;
+  case 15:
+    /**  Digit #1 -+         odd -+       ID -+
+    //   __________|_________     |     ______|______
+    //  /                    \    |    /             \
+    // +-----+-----+-----+-----+-----+-----+-----+-----+
+    // |  0  |  0  |  0  |  0  |  1  |  0  |  0  |  1  |
+    // +-----+-----+-----+-----+-----+-----+-----+-----+
+    //   b07   b06   b05   b04   b03   b02   b01   b00
+    **/
+    imsi_buff[3] = 0x09;
+    break;
+  default:
+    printf("\nERROR: Illegal IMSI length, %d characters.\n", imsi_length);
+    exit(1);
+  }
+    
+  // IMSI value encoded using BCD, i.e. each digit stored as
+  // a nibble, where first BCD digit should be put in DW1, b04-b07.
+  // This translates to b04-b07 of index 3 in the buffer.
+  
+  const int32_t IMSI_OFFSET = 3; // Octet where IMSI starts in imsi_buff
+  
+  for (int offset=0, nibble=0, word=0, i=1, digit=0; i<=imsi_length; i++) {
+    word   = i/4; // Data word relative to IMSI part in buffer
+    nibble = i%4; // Nibble within word in IMSI part in buffer
+    offset = word*2 - nibble/2 + IMSI_OFFSET;
+    
+    digit = imsi[i-1]-'0'; // Convert ASCII-encoded digit to integer
+    if ((digit<0) || (digit>9)) {
+      // A non-digit character has been found; only 0-9 are valid digits
+      // in an IMSI value
+      printf("\nERROR: Position %d in IMSI contains illegal character '%c'\n\n",
+             i, imsi[i-1]);
+      exit(1);
+    }
+
+    // BCD-encode the digit and store it within the correct nibble in
+    // the octet located at the offset in the IMSI buffer.
+    if (i%2) {
+      // We should store in MSB part of octet (b04 - b07)
+      // Due to that storing the nibble in the LSB part of the octet
+      // automatically cleared any bits in the MSB part, we just need
+      // to shift and do a logical OR to store the bits. Thus the code
+      // below is an optimized version of this code in combination with
+      // LSB part:
+      // 
+      //imsi_buff[offset] &= 0x0F; // Clear previous contents
+      //imsi_buff[offset] |= (uint8_t)(digit<<4); // Store value
+      
+      imsi_buff[offset] |= (uint8_t)(digit<<4); // Store value
+    }
+    else {
+      // We should store in LSB part of octet (b00 - b03)
+      // Due to that we store the nibble in the LSB part of the octet
+      // before the nibble in the MSB part we do not need to consider
+      // any value stored in the MSB part. As a side effect we also
+      // automatically clear the bits in the MSB part of the octet,
+      // i.e. the code below is an optimized version of this code in
+      // combination with optimization done for MSB part:
+      //
+      // imsi_buff[offset] &= 0xF0; // Clear previous contents
+      // imsi_buff[offset] |= (uint8_t)(digit); // Store value
+      
+      imsi_buff[offset] = digit; // Store value
+    }
+  }
+}
+
+//===============================================================================
+//      Decode the events id arguments. Comma separated to a array of int.
+//
+//===============================================================================
+int decode_event_list(char *events, int *event_list)
+{
+  int index = 0;
+  char * pch;
+
+  pch = strtok(events," ,");
+  while (pch != NULL) {
+    // The atoi function below will return 0 if presented with a
+    // non-integer, and due to this we need to verify that the given
+    // event ID is an integer number
+    for (int i=0, len=strlen(pch); i<len; i++) {
+      if (!isdigit(pch[i])) {
+        // We found a non-digit number, return an error code
+        printf("\n%s is not a valid Event ID\n\n", pch);
+        return -1;
+      }
+    }
+    event_list[index] = atoi(pch);
+    index++;
+    if (index == 64) {
+      printf("\nToo many Event IDs specified; max is %d.\n\n", MAX_EVENT_IDS);
+      return -1;
+    }
+    pch = strtok (NULL, ",");
+  }
+  event_list[index] = -1; //End of list indication
+  
+  return 0;
+}
+
+//===============================================================================
+//      Decode the cellpointer arguments. Comma separated to a array of int.
+//
+//===============================================================================
+int decode_cell_list(char *cells, int *cell_list)
+{
+  int index = 0;
+  char * pch;
+
+  pch = strtok (cells," ,");
+  while (pch != NULL) {
+    cell_list[index] = atoi(pch);
+    index++;
+    if (index == MAX_CELLS) {
+      return -1;
+    }
+    pch = strtok(NULL, ",");
+  }
+  cell_list[index] = -1; //End of list indication
+
+  return 0;
+}
+
+//===============================================================================
+//      Print Hex buffer
+//
+//===============================================================================
+void printBuffer(char * buff, int len)
+{
+  printf("Buffer: ");
+  for ( int i = 0; i < len ; i++ ) {
+    printf("%.2x ", (unsigned char)buff[i]);
+  }
+  fflush(stdout);
+}
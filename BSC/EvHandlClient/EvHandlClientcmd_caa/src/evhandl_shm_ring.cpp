@@ -0,0 +1,147 @@
+/*
+ *
+ * NAME: evhandl_shm_ring.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Writer of the shared memory ring, see evhandl_shm_ring.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "evhandl_shm_ring.h"
+
+using namespace std;
+
+
+ShmRingWriter::ShmRingWriter()
+  : header(NULL),
+    data(NULL),
+    mapSize(0)
+{
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+  close();
+}
+
+//===============================================================================
+//      Create and map the ring
+//
+//===============================================================================
+bool ShmRingWriter::open(const string& ring_name)
+{
+  string path = "/" + ring_name;
+
+  // A ring left by a capture that did not stop properly is replaced, a
+  // reader still attached to it keeps the old ring
+  shm_unlink(path.c_str());
+
+  int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  mapSize = SHM_RING_HEADER_SIZE + SHM_RING_DATA_SIZE;
+  if (ftruncate(fd, mapSize) != 0) {
+    int error = errno;
+    ::close(fd);
+    shm_unlink(path.c_str());
+    errno = error;
+    return false;
+  }
+
+  void *map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int error = errno;
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(path.c_str());
+    errno = error;
+    return false;
+  }
+
+  // The new object is zero filled, i.e. all positions start at 0
+  header = static_cast<ShmRingHeader*>(map);
+  data   = static_cast<char*>(map) + SHM_RING_HEADER_SIZE;
+  header->headerSize = SHM_RING_HEADER_SIZE;
+  header->dataSize   = SHM_RING_DATA_SIZE;
+  header->writerPid  = getpid();
+  name = path;
+
+  // Readers check the magic last
+  atomic_thread_fence(memory_order_release);
+  header->magic = SHM_RING_MAGIC;
+
+  return true;
+}
+
+//===============================================================================
+//      Publish a frame, overwriting the oldest records
+//
+//===============================================================================
+void ShmRingWriter::publish(const char *frame, size_t length)
+{
+  uint64_t pos     = header->writePos.load(memory_order_relaxed);
+  uint64_t seq     = header->frames.load(memory_order_relaxed);
+  size_t   offset  = pos & (SHM_RING_DATA_SIZE - 1);
+  size_t   size    = shm_record_size(length);
+  size_t   padding = 0;
+
+  // Records do not wrap, pad the rest of the data area instead
+  if (offset + size > SHM_RING_DATA_SIZE) {
+    padding = SHM_RING_DATA_SIZE - offset;
+  }
+
+  // Announce the octets about to be overwritten before touching them
+  header->reservePos.store(pos + padding + size, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if (padding > 0) {
+    ShmRecordHeader *pad = reinterpret_cast<ShmRecordHeader*>(data + offset);
+
+    pad->sequence = seq;
+    pad->length   = SHM_RECORD_PADDING;
+    offset = 0;
+  }
+
+  ShmRecordHeader *record = reinterpret_cast<ShmRecordHeader*>(data + offset);
+  record->sequence = seq;
+  record->length   = length;
+  memcpy(data + offset + sizeof(ShmRecordHeader), frame, length);
+
+  header->frames.store(seq + 1, memory_order_relaxed);
+  header->writePos.store(pos + padding + size, memory_order_release);
+}
+
+void ShmRingWriter::close()
+{
+  if (header != NULL) {
+    header->closed.store(1, memory_order_release);
+    munmap(header, mapSize);
+    shm_unlink(name.c_str());
+    header = NULL;
+  }
+}
+
+uint64_t ShmRingWriter::frames() const
+{
+  return (header != NULL) ? header->frames.load(memory_order_relaxed) : 0;
+}
@@ -0,0 +1,126 @@
+/*
+ *
+ * NAME: evhandl_socket_monitor.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Tuning and monitoring of the BSC socket, see evhandl_socket_monitor.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+
+#include "evhandl_socket_monitor.h"
+
+
+// Set an integer socket option, noting a failure
+static void set_option(int socket_fd, int level, int option, int value,
+                       const char *name)
+{
+  if (setsockopt(socket_fd, level, option, &value, sizeof(value)) != 0) {
+    printf("\nNote: Could not set %s on the socket.\n"
+           "Reason: %s\n", name, strerror(errno));
+  }
+}
+
+//===============================================================================
+//      Set the socket options of a tuning profile
+//
+//===============================================================================
+void tune_socket(int socket_fd, int profile)
+{
+  if (profile == Tuning::none) {
+    return;
+  }
+
+  // Beyond net.core.rmem_max only with CAP_NET_ADMIN, otherwise the
+  // buffer is silently limited to rmem_max
+  int size = TUNED_RECEIVE_BUFFER;
+
+  if (setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUFFORCE, &size,
+                 sizeof(size)) != 0) {
+    set_option(socket_fd, SOL_SOCKET, SO_RCVBUF, TUNED_RECEIVE_BUFFER,
+               "SO_RCVBUF");
+  }
+
+  // Acknowledge at once, so that the BSC sees the window open as soon as
+  // data has been read
+  set_option(socket_fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+
+  if (profile == Tuning::latency) {
+    set_option(socket_fd, SOL_SOCKET, SO_BUSY_POLL, TUNED_BUSY_POLL_US,
+               "SO_BUSY_POLL");
+  }
+}
+
+
+//===============================================================================
+//      SocketMonitor
+//
+//===============================================================================
+SocketMonitor::SocketMonitor(int socket_fd, bool quick_ack)
+  : socketFd(socket_fd),
+    quickAck(quick_ack),
+    queuedBytes(0),
+    maxQueuedBytes(0),
+    zeroWindows(0),
+    rttUs(0),
+    receiveBuffer(0)
+{
+}
+
+void SocketMonitor::sample()
+{
+  int             queued = 0;
+  int             buffer = 0;
+  socklen_t       length = sizeof(buffer);
+  struct tcp_info info;
+
+  if (ioctl(socketFd, SIOCINQ, &queued) != 0) {
+    return;
+  }
+  getsockopt(socketFd, SOL_SOCKET, SO_RCVBUF, &buffer, &length);
+
+  memset(&info, 0, sizeof(info));
+  length = sizeof(info);
+  getsockopt(socketFd, IPPROTO_TCP, TCP_INFO, &info, &length);
+
+  queuedBytes.store(queued, std::memory_order_relaxed);
+  if ((uint32_t)queued > maxQueuedBytes.load(std::memory_order_relaxed)) {
+    maxQueuedBytes.store(queued, std::memory_order_relaxed);
+  }
+  rttUs.store(info.tcpi_rtt, std::memory_order_relaxed);
+  receiveBuffer.store(buffer, std::memory_order_relaxed);
+
+  // The kernel reports twice the buffer asked for, the other half being
+  // its bookkeeping overhead, i.e. about half is available for data
+  if ((queued > 0) &&
+      ((uint32_t)queued + info.tcpi_rcv_mss >= (uint32_t)buffer / 2)) {
+    zeroWindows.store(zeroWindows.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+  }
+
+  if (quickAck) {
+    int flag = 1;
+
+    setsockopt(socketFd, IPPROTO_TCP, TCP_QUICKACK, &flag, sizeof(flag));
+  }
+}
@@ -0,0 +1,327 @@
+/*
+ *
+ * NAME: evhandl_splice_engine.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  splice() based raw capture engine, see evhandl_splice_engine.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "evhandl_frame.h"
+#include "evhandl_splice_engine.h"
+
+
+// Requested pipe size. The default pipe size (64 KB) is used if the
+// kernel does not allow a larger one.
+const int  SPLICE_PIPE_SIZE = 1024 * 1024;
+
+
+SpliceEngine::SpliceEngine()
+  : pipeSize(0),
+    pipeFill(0),
+    pipeComplete(0),
+    maxFrameLength(0),
+    socketFd(-1),
+    fileFd(-1),
+    fileOffset(0),
+    receiveCalls(0)
+{
+  pipeFds[0] = -1;
+  pipeFds[1] = -1;
+}
+
+SpliceEngine::~SpliceEngine()
+{
+  if (pipeFds[0] >= 0) {
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+  }
+}
+
+int SpliceEngine::init(int max_data_length)
+{
+  maxFrameLength = FRAME_HEADER_LENGTH + max_data_length;
+
+  if (pipe(pipeFds) != 0) {
+    return errno;
+  }
+
+  fcntl(pipeFds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+
+  int size = fcntl(pipeFds[1], F_GETPIPE_SZ);
+  if (size < 0) {
+    return errno;
+  }
+  pipeSize = size;
+
+  // A frame must always fit in the pipe
+  if (pipeSize < (size_t)maxFrameLength) {
+    return EINVAL;
+  }
+
+  return 0;
+}
+
+//===============================================================================
+//      Peek at the header of the next frame without removing it from the
+//      socket
+//
+//===============================================================================
+bool SpliceEngine::peek_header(char *header)
+{
+  while (true) {
+    ssize_t n = recv(socketFd, header, FRAME_HEADER_LENGTH,
+                     MSG_PEEK | MSG_WAITALL);
+
+    receiveCalls++;
+    if (n == FRAME_HEADER_LENGTH) {
+      return true;
+    }
+    else if (n == 0) {
+      return false;
+    }
+    else if ((n < 0) && (errno != EINTR)) {
+      printf("\nERROR: Reading from socket.\n"
+             "Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+  }
+}
+
+//===============================================================================
+//      Move octets from the pipe to the file
+//
+//===============================================================================
+void SpliceEngine::drain_pipe(size_t octets)
+{
+  while (octets > 0) {
+    ssize_t n = splice(pipeFds[0], NULL, fileFd, &fileOffset, octets,
+                       SPLICE_F_MOVE);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("\nERROR: Write operation to log file failed.\n"
+             "Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+    octets   -= n;
+    pipeFill -= n;
+    pipeComplete = (pipeComplete > (size_t)n) ? pipeComplete - n : 0;
+  }
+}
+
+//===============================================================================
+//      Write octets read into user space to the pipe. The pipe is empty
+//      at this point and can hold a frame, i.e. this does not block.
+//
+//===============================================================================
+void SpliceEngine::fill_pipe(const char *data, size_t length)
+{
+  while (length > 0) {
+    ssize_t n = write(pipeFds[1], data, length);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("\nERROR: Writing to pipe.\n"
+             "Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+    data     += n;
+    length   -= n;
+    pipeFill += n;
+  }
+}
+
+//===============================================================================
+//      Read the rest of a partly received frame header from the socket
+//
+//===============================================================================
+bool SpliceEngine::receive_header(char *header, size_t received)
+{
+  while (received < (size_t)FRAME_HEADER_LENGTH) {
+    ssize_t n = recv(socketFd, header + received,
+                     FRAME_HEADER_LENGTH - received, 0);
+
+    receiveCalls++;
+    if (n > 0) {
+      fill_pipe(header + received, n);
+      received += n;
+    }
+    else if (n == 0) {
+      return false;
+    }
+    else if (errno != EINTR) {
+      printf("\nERROR: Reading from socket.\n"
+             "Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+  }
+  return true;
+}
+
+//===============================================================================
+//      Capture loop
+//
+//===============================================================================
+int SpliceEngine::run(int socket_fd, int file_fd, const char *partial,
+                      size_t partial_length, CaptureState& state)
+{
+  int    end             = CaptureEnd::connectionClosed;
+  size_t frame_remaining = 0; // Octets of the current frame not yet in the pipe
+  size_t frame_length    = 0;
+
+  socketFd   = socket_fd;
+  fileFd     = file_fd;
+  fileOffset = state.bytesWritten;
+
+  if (partial_length > 0) {
+    // Continue the frame already started, through the pipe as the rest
+    char header[FRAME_HEADER_LENGTH];
+
+    fill_pipe(partial, partial_length);
+    memcpy(header, partial, (partial_length < (size_t)FRAME_HEADER_LENGTH) ?
+           partial_length : FRAME_HEADER_LENGTH);
+    if (!receive_header(header, partial_length)) {
+      return (state.stopReason != NULL) ?
+        CaptureEnd::stopped : CaptureEnd::connectionClosed;
+    }
+
+    int data_length = frame_data_length(header);
+    if (data_length > maxFrameLength - FRAME_HEADER_LENGTH) {
+      printf("\nERROR: Reading from socket event length too long.\n"
+             "%10d bytes stated in received event, expected max %d bytes.\n",
+             data_length, maxFrameLength - FRAME_HEADER_LENGTH);
+      exit(1);
+    }
+
+    frame_length    = FRAME_HEADER_LENGTH + data_length;
+    frame_remaining = frame_length -
+      ((partial_length > (size_t)FRAME_HEADER_LENGTH) ?
+       partial_length : FRAME_HEADER_LENGTH);
+    if (frame_remaining == 0) {
+      // A frame without data, complete with its header
+      pipeComplete = pipeFill;
+      state.numberOfEvents++;
+      state.bytesWritten += frame_length;
+    }
+  }
+
+  while (true) {
+    if (frame_remaining == 0) {
+      // At a frame boundary
+      if (state.flushDue) {
+        // Write what has been received on every housekeeping tick
+        state.flushDue = false;
+        drain_pipe(pipeComplete);
+
+        if (state.bytesWritten > state.maxFileSize) {
+          end = CaptureEnd::maxFileSize;
+          break;
+        }
+      }
+
+      if (state.stopReason != NULL) {
+        end = CaptureEnd::stopped;
+        break;
+      }
+
+      char header[FRAME_HEADER_LENGTH];
+      if (!peek_header(header)) {
+        end = (state.stopReason != NULL) ?
+          CaptureEnd::stopped : CaptureEnd::connectionClosed;
+        break;
+      }
+
+      int data_length = frame_data_length(header);
+      if (data_length > maxFrameLength - FRAME_HEADER_LENGTH) {
+        printf("\nERROR: Reading from socket event length too long.\n"
+               "%10d bytes stated in received event, expected max %d bytes.\n",
+               data_length, maxFrameLength - FRAME_HEADER_LENGTH);
+        exit(1);
+      }
+
+      frame_length    = FRAME_HEADER_LENGTH + data_length;
+      frame_remaining = frame_length;
+
+      // Make room for the whole frame in the pipe
+      if (pipeSize - pipeFill < frame_length) {
+        drain_pipe(pipeComplete);
+      }
+    }
+
+    // The pipe capacity is counted in buffers rather than octets and
+    // every splice from the socket uses at least one buffer, i.e. the
+    // pipe may be full long before pipeSize octets are in it. The pipe
+    // side is therefore non-blocking and the pipe is drained when full.
+    ssize_t n = splice(socketFd, NULL, pipeFds[1], NULL, frame_remaining,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+    receiveCalls++;
+    if (n > 0) {
+      pipeFill        += n;
+      frame_remaining -= n;
+
+      if (frame_remaining == 0) {
+        pipeComplete = pipeFill;
+        state.numberOfEvents++;
+        state.bytesWritten += frame_length;
+
+        if (pipeComplete >= pipeSize / 2) {
+          drain_pipe(pipeComplete);
+        }
+      }
+    }
+    else if ((n < 0) && (errno == EAGAIN)) {
+      if (pipeFill > 0) {
+        // Pipe full. If it only holds the start of the current frame,
+        // that part is written as well; the rest of the frame follows.
+        drain_pipe((pipeComplete > 0) ? pipeComplete : pipeFill);
+      }
+      else {
+        // Older kernels apply SPLICE_F_NONBLOCK to the socket as well
+        struct pollfd pfd = { socketFd, POLLIN, 0 };
+        poll(&pfd, 1, -1);
+      }
+    }
+    else if (n == 0) {
+      end = (state.stopReason != NULL) ?
+        CaptureEnd::stopped : CaptureEnd::connectionClosed;
+      break;
+    }
+    else if (errno != EINTR) {
+      printf("\nERROR: Reading from socket.\n"
+             "Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+  }
+
+  // A partial frame left in the pipe is not written
+  drain_pipe(pipeComplete);
+
+  return end;
+}
@@ -0,0 +1,190 @@
+/*
+ *
+ * NAME: evhandl_thread_tuning.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Scheduling of the capture threads, see evhandl_thread_tuning.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "evhandl_thread_tuning.h"
+
+
+// ioprio_set() has no glibc wrapper, see linux/ioprio.h
+const int  IOPRIO_WHO_PROCESS = 1;
+const int  IOPRIO_CLASS_SHIFT = 13;
+const int  IOPRIO_CLASS_RT    = 1;
+const int  IOPRIO_CLASS_BE    = 2;
+const int  IOPRIO_CLASS_IDLE  = 3;
+const int  IOPRIO_MAX_LEVEL   = 7;
+
+const ThreadTuning  NO_THREAD_TUNING = {
+  -1, SCHED_OTHER, 0, NICE_UNCHANGED, IOPRIO_UNCHANGED
+};
+
+// Parse a whole decimal number
+static bool parse_int(const char *value, int& number)
+{
+  char *end;
+
+  errno  = 0;
+  number = (int)strtol(value, &end, 10);
+  return ((errno == 0) && (end != value) && (*end == '\0'));
+}
+
+//===============================================================================
+//      Apply the settings to the calling thread. pid 0 is the calling
+//      thread for setpriority() and ioprio_set().
+//
+//===============================================================================
+void tune_thread(const ThreadTuning& tuning, const char *name)
+{
+  if (tuning.cpu >= 0) {
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(tuning.cpu, &cpus);
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (result != 0) {
+      printf("\nNote: Could not pin the %s thread to CPU %d.\n"
+             "Reason: %s\n", name, tuning.cpu, strerror(result));
+    }
+  }
+
+  if (tuning.policy != SCHED_OTHER) {
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = tuning.priority;
+    int result = pthread_setschedparam(pthread_self(), tuning.policy, &param);
+    if (result != 0) {
+      printf("\nNote: Could not set the scheduling policy of the %s thread.\n"
+             "Reason: %s\n", name, strerror(result));
+    }
+  }
+  else if (tuning.nice != NICE_UNCHANGED) {
+    if (setpriority(PRIO_PROCESS, 0, tuning.nice) != 0) {
+      printf("\nNote: Could not set the nice value of the %s thread.\n"
+             "Reason: %s\n", name, strerror(errno));
+    }
+  }
+
+  if (tuning.ioprio != IOPRIO_UNCHANGED) {
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, tuning.ioprio) != 0) {
+      printf("\nNote: Could not set the I/O priority of the %s thread.\n"
+             "Reason: %s\n", name, strerror(errno));
+    }
+  }
+}
+
+//===============================================================================
+//      Parse <cpu>,<cpu>,... e.g. 2,3 or -,3
+//
+//===============================================================================
+bool parse_cpu_list(const char *value, int cpus[], int count)
+{
+  char  list[64];
+  char *save = NULL;
+  int   n    = 0;
+
+  if (strlen(value) >= sizeof(list)) {
+    return false;
+  }
+  strcpy(list, value);
+
+  for (char *cpu = strtok_r(list, ",", &save); cpu != NULL;
+       cpu = strtok_r(NULL, ",", &save)) {
+    if (n == count) {
+      return false;
+    }
+    if (strcmp(cpu, "-") == 0) {
+      cpus[n] = -1;
+    }
+    else if (!parse_int(cpu, cpus[n]) || (cpus[n] < 0) ||
+             (cpus[n] >= CPU_SETSIZE)) {
+      return false;
+    }
+    n++;
+  }
+  return (n > 0);
+}
+
+//===============================================================================
+//      Parse fifo:<priority>, rr:<priority> or nice:<value>
+//
+//===============================================================================
+bool parse_sched(const char *value, ThreadTuning& tuning)
+{
+  const char *colon = strchr(value, ':');
+  int         number;
+
+  if ((colon == NULL) || !parse_int(colon + 1, number)) {
+    return false;
+  }
+
+  if ((strncmp(value, "fifo:", 5) == 0) || (strncmp(value, "rr:", 3) == 0)) {
+    int policy = (value[0] == 'f') ? SCHED_FIFO : SCHED_RR;
+
+    if ((number < sched_get_priority_min(policy)) ||
+        (number > sched_get_priority_max(policy))) {
+      return false;
+    }
+    tuning.policy   = policy;
+    tuning.priority = number;
+    return true;
+  }
+  if (strncmp(value, "nice:", 5) == 0) {
+    if ((number < -20) || (number > 19)) {
+      return false;
+    }
+    tuning.nice = number;
+    return true;
+  }
+  return false;
+}
+
+//===============================================================================
+//      Parse rt:<level>, be:<level> or idle
+//
+//===============================================================================
+bool parse_ioprio(const char *value, int& ioprio)
+{
+  int level;
+
+  if (strcmp(value, "idle") == 0) {
+    ioprio = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+    return true;
+  }
+  if ((strncmp(value, "rt:", 3) == 0) || (strncmp(value, "be:", 3) == 0)) {
+    if (!parse_int(value + 3, level) || (level < 0) ||
+        (level > IOPRIO_MAX_LEVEL)) {
+      return false;
+    }
+    ioprio = (((value[0] == 'r') ? IOPRIO_CLASS_RT : IOPRIO_CLASS_BE) <<
+              IOPRIO_CLASS_SHIFT) | level;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,565 @@
+/*
+ *
+ * NAME: evhandl_uring_engine.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  io_uring capture engine, see evhandl_uring_engine.h
+ *
+ *  The raw system call interface is used so that no additional library
+ *  is needed on the APG. When built against kernel headers without
+ *  io_uring support the engine always reports ENOSYS, which makes the
+ *  client fall back to the default engine.
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "evhandl_frame.h"
+#include "evhandl_uring_engine.h"
+
+#if defined(IORING_OFF_SQ_RING) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING 1
+#endif
+
+
+// Number of submission queue entries
+const unsigned  URING_ENTRIES = 64;
+
+// Number and size of the registered blocks
+const int     URING_BLOCKS     = 16;
+const size_t  URING_BLOCK_SIZE = 256 * 1024;
+
+// user_data used for the socket receive, writes use the request address
+const uint64_t  RECEIVE_TAG = 0;
+
+
+UringEngine::UringEngine()
+  : ringFd(-1),
+    sqEntries(0),
+    sqRing(MAP_FAILED),
+    sqRingSize(0),
+    cqRing(MAP_FAILED),
+    cqRingSize(0),
+    sqes(NULL),
+    sqesSize(0),
+    queued(0),
+    socketFd(-1),
+    fileFd(-1),
+    maxFrameLength(0),
+    current(NULL),
+    fileOffset(0),
+    receivePending(false),
+    receiveResult(0),
+    pendingWrites(0),
+    enterCalls(0)
+{
+}
+
+#ifndef HAVE_IO_URING
+
+UringEngine::~UringEngine()
+{
+}
+
+int UringEngine::init(int /*max_data_length*/)
+{
+  return ENOSYS;
+}
+
+int UringEngine::run(int /*socket_fd*/, int /*file_fd*/,
+                     const char* /*partial*/, size_t /*partial_length*/,
+                     CaptureState& /*state*/)
+{
+  return CaptureEnd::connectionClosed;
+}
+
+#else
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags)
+{
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                 NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg,
+                                 unsigned nr_args)
+{
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+UringEngine::~UringEngine()
+{
+  if (sqes != NULL) {
+    munmap(sqes, sqesSize);
+  }
+  if ((cqRing != MAP_FAILED) && (cqRing != sqRing)) {
+    munmap(cqRing, cqRingSize);
+  }
+  if (sqRing != MAP_FAILED) {
+    munmap(sqRing, sqRingSize);
+  }
+  if (ringFd >= 0) {
+    close(ringFd);
+  }
+  for (size_t n = 0; n < blocks.size(); n++) {
+    free(blocks[n].data);
+  }
+}
+
+//===============================================================================
+//      Set up the submission and completion queues, check that the needed
+//      operations are supported and register the block memory.
+//
+//===============================================================================
+int UringEngine::init(int max_data_length)
+{
+  struct io_uring_params params;
+
+  maxFrameLength = FRAME_HEADER_LENGTH + max_data_length;
+
+  memset(&params, 0, sizeof(params));
+  ringFd = sys_io_uring_setup(URING_ENTRIES, &params);
+  if (ringFd < 0) {
+    return errno;
+  }
+
+  sqEntries  = params.sq_entries;
+  sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize = params.cq_off.cqes +
+               params.cq_entries * sizeof(struct io_uring_cqe);
+  sqesSize   = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  bool single_mmap = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+  single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+#endif
+  if (single_mmap) {
+    if (cqRingSize > sqRingSize) {
+      sqRingSize = cqRingSize;
+    }
+    cqRingSize = sqRingSize;
+  }
+
+  sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED) {
+    return errno;
+  }
+
+  if (single_mmap) {
+    cqRing = sqRing;
+  }
+  else {
+    cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED) {
+      return errno;
+    }
+  }
+
+  void *sqes_map = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+  if (sqes_map == MAP_FAILED) {
+    return errno;
+  }
+  sqes = (struct io_uring_sqe *)sqes_map;
+
+  sqHead  = (unsigned *)((char *)sqRing + params.sq_off.head);
+  sqTail  = (unsigned *)((char *)sqRing + params.sq_off.tail);
+  sqMask  = (unsigned *)((char *)sqRing + params.sq_off.ring_mask);
+  sqArray = (unsigned *)((char *)sqRing + params.sq_off.array);
+  cqHead  = (unsigned *)((char *)cqRing + params.cq_off.head);
+  cqTail  = (unsigned *)((char *)cqRing + params.cq_off.tail);
+  cqMask  = (unsigned *)((char *)cqRing + params.cq_off.ring_mask);
+  cqes    = (struct io_uring_cqe *)((char *)cqRing + params.cq_off.cqes);
+
+#ifdef IORING_REGISTER_PROBE
+  {
+    // Probing was added after the fixed buffer operations, i.e. if the
+    // kernel does not know about probing the operations are there.
+    size_t probe_size = sizeof(struct io_uring_probe) +
+                        256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, probe_size);
+
+    if (probe == NULL) {
+      return ENOMEM;
+    }
+    if (sys_io_uring_register(ringFd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+      if ((probe->last_op < IORING_OP_WRITE_FIXED) ||
+          !(probe->ops[IORING_OP_READ_FIXED].flags & IO_URING_OP_SUPPORTED) ||
+          !(probe->ops[IORING_OP_WRITE_FIXED].flags & IO_URING_OP_SUPPORTED)) {
+        free(probe);
+        return EOPNOTSUPP;
+      }
+    }
+    free(probe);
+  }
+#endif
+
+  // Blocks used both for receiving and writing
+  std::vector<struct iovec> iovecs(URING_BLOCKS);
+
+  blocks.resize(URING_BLOCKS);
+  for (int n = 0; n < URING_BLOCKS; n++) {
+    void *data;
+
+    if (posix_memalign(&data, 4096, URING_BLOCK_SIZE) != 0) {
+      return ENOMEM;
+    }
+    memset(&blocks[n], 0, sizeof(Block));
+    blocks[n].data  = (char *)data;
+    blocks[n].index = n;
+    iovecs[n].iov_base = data;
+    iovecs[n].iov_len  = URING_BLOCK_SIZE;
+    freeBlocks.push_back(&blocks[n]);
+  }
+
+  if (sys_io_uring_register(ringFd, IORING_REGISTER_BUFFERS,
+                            &iovecs[0], URING_BLOCKS) != 0) {
+    return errno;
+  }
+
+  writeRequests.resize(sqEntries);
+  for (size_t n = 0; n < writeRequests.size(); n++) {
+    freeRequests.push_back(&writeRequests[n]);
+  }
+
+  return 0;
+}
+
+//===============================================================================
+//      Get the next free submission queue entry, submitting what is queued
+//      if the submission queue is full.
+//
+//===============================================================================
+io_uring_sqe* UringEngine::get_sqe()
+{
+  unsigned tail = *sqTail + queued;
+
+  if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+    submit_and_wait(0);
+    tail = *sqTail + queued;
+  }
+
+  unsigned index = tail & *sqMask;
+  struct io_uring_sqe *sqe = &sqes[index];
+
+  sqArray[index] = index;
+  queued++;
+  memset(sqe, 0, sizeof(*sqe));
+
+  return sqe;
+}
+
+//===============================================================================
+//      Submit everything queued and wait for at least min_complete
+//      completions.
+//
+//===============================================================================
+void UringEngine::submit_and_wait(unsigned min_complete)
+{
+  __atomic_store_n(sqTail, *sqTail + queued, __ATOMIC_RELEASE);
+
+  do {
+    int submitted = sys_io_uring_enter(ringFd, queued, min_complete,
+                                       min_complete ? IORING_ENTER_GETEVENTS : 0);
+    enterCalls++;
+    if (submitted < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("\nERROR: io_uring submission failed.\n"
+             "Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+    queued -= submitted;
+  } while (queued > 0);
+}
+
+void UringEngine::queue_receive()
+{
+  struct io_uring_sqe *sqe = get_sqe();
+
+  sqe->opcode    = IORING_OP_READ_FIXED;
+  sqe->fd        = socketFd;
+  sqe->addr      = (uint64_t)(uintptr_t)(current->data + current->fill);
+  sqe->len       = URING_BLOCK_SIZE - current->fill;
+  sqe->buf_index = current->index;
+  sqe->user_data = RECEIVE_TAG;
+
+  receivePending = true;
+}
+
+void UringEngine::queue_write(Block *block, size_t start, size_t length,
+                              uint64_t offset)
+{
+  while (freeRequests.empty()) {
+    submit_and_wait(1);
+    reap_completions();
+  }
+
+  WriteRequest *request = freeRequests.back();
+  freeRequests.pop_back();
+
+  request->block  = block;
+  request->start  = start;
+  request->length = length;
+  request->offset = offset;
+
+  struct io_uring_sqe *sqe = get_sqe();
+
+  sqe->opcode    = IORING_OP_WRITE_FIXED;
+  sqe->fd        = fileFd;
+  sqe->addr      = (uint64_t)(uintptr_t)(block->data + start);
+  sqe->len       = length;
+  sqe->off       = offset;
+  sqe->buf_index = block->index;
+  sqe->user_data = (uint64_t)(uintptr_t)request;
+
+  block->pendingWrites++;
+  pendingWrites++;
+}
+
+//===============================================================================
+//      Queue a write of the complete frames in the block that have not
+//      been written yet.
+//
+//===============================================================================
+void UringEngine::queue_block_write(Block *block)
+{
+  if (block->parsed > block->written) {
+    size_t length = block->parsed - block->written;
+
+    queue_write(block, block->written, length, fileOffset);
+    fileOffset     += length;
+    block->written  = block->parsed;
+  }
+}
+
+//===============================================================================
+//      Handle all available completions
+//
+//===============================================================================
+void UringEngine::reap_completions()
+{
+  unsigned head = *cqHead;
+
+  while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe *cqe = &cqes[head & *cqMask];
+
+    if (cqe->user_data == RECEIVE_TAG) {
+      receivePending = false;
+      receiveResult  = cqe->res;
+    }
+    else {
+      WriteRequest *request = (WriteRequest *)(uintptr_t)cqe->user_data;
+      Block        *block   = request->block;
+
+      if (cqe->res < 0) {
+        printf("\nERROR: Write operation to log file failed.\n"
+               "Reason: %s\n\n", strerror(-cqe->res));
+        exit(1);
+      }
+
+      if ((size_t)cqe->res < request->length) {
+        // Short write, write the rest using the same request. A lasting
+        // problem (e.g. quota exceeded) is reported by the next attempt.
+        struct io_uring_sqe *sqe = get_sqe();
+
+        request->start  += cqe->res;
+        request->length -= cqe->res;
+        request->offset += cqe->res;
+
+        sqe->opcode    = IORING_OP_WRITE_FIXED;
+        sqe->fd        = fileFd;
+        sqe->addr      = (uint64_t)(uintptr_t)(block->data + request->start);
+        sqe->len       = request->length;
+        sqe->off       = request->offset;
+        sqe->buf_index = block->index;
+        sqe->user_data = (uint64_t)(uintptr_t)request;
+      }
+      else {
+        freeRequests.push_back(request);
+        block->pendingWrites--;
+        pendingWrites--;
+
+        if (block->retired && (block->pendingWrites == 0)) {
+          block->retired = false;
+          freeBlocks.push_back(block);
+        }
+      }
+    }
+    head++;
+  }
+
+  __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+}
+
+//===============================================================================
+//      Step over the complete frames received into the current block
+//
+//===============================================================================
+void UringEngine::parse_frames(CaptureState& state)
+{
+  while (current->fill - current->parsed >= (size_t)FRAME_HEADER_LENGTH) {
+    int data_length = frame_data_length(current->data + current->parsed);
+
+    if (data_length > maxFrameLength - FRAME_HEADER_LENGTH) {
+      printf("\nERROR: Reading from socket event length too long.\n"
+             "%10d bytes stated in received event, expected max %d bytes.\n",
+             data_length, maxFrameLength - FRAME_HEADER_LENGTH);
+      exit(1);
+    }
+
+    size_t frame_length = FRAME_HEADER_LENGTH + data_length;
+    if (current->fill - current->parsed < frame_length) {
+      break;
+    }
+
+    current->parsed += frame_length;
+    state.numberOfEvents++;
+    state.bytesWritten += frame_length;
+  }
+}
+
+//===============================================================================
+//      Write the complete frames of the current block and continue
+//      receiving into a new block. A partial frame at the end of the
+//      block is moved to the start of the new block. The old block is
+//      retired only after the move, as a retired block is put back on
+//      the free list as soon as its writes complete.
+//
+//===============================================================================
+void UringEngine::next_block()
+{
+  Block *old = current;
+
+  queue_block_write(old);
+
+  while (freeBlocks.empty()) {
+    submit_and_wait(1);
+    reap_completions();
+  }
+
+  current = freeBlocks.back();
+  freeBlocks.pop_back();
+
+  current->fill    = old->fill - old->parsed;
+  current->parsed  = 0;
+  current->written = 0;
+  memcpy(current->data, old->data + old->parsed, current->fill);
+
+  old->retired = true;
+  if (old->pendingWrites == 0) {
+    old->retired = false;
+    freeBlocks.push_back(old);
+  }
+}
+
+//===============================================================================
+//      Capture loop
+//
+//===============================================================================
+int UringEngine::run(int socket_fd, int file_fd, const char *partial,
+                     size_t partial_length, CaptureState& state)
+{
+  int    end = CaptureEnd::connectionClosed;
+
+  socketFd   = socket_fd;
+  fileFd     = file_fd;
+  fileOffset = state.bytesWritten;
+
+  current = freeBlocks.back();
+  freeBlocks.pop_back();
+  current->fill    = partial_length;
+  current->parsed  = 0;
+  current->written = 0;
+  memcpy(current->data, partial, partial_length);
+
+  while (true) {
+    if (state.stopReason != NULL) {
+      end = CaptureEnd::stopped;
+      break;
+    }
+
+    // Queued file writes are submitted together with the receive
+    queue_receive();
+    while (receivePending) {
+      submit_and_wait(1);
+      reap_completions();
+    }
+
+    if (receiveResult > 0) {
+      current->fill += receiveResult;
+      parse_frames(state);
+
+      if (URING_BLOCK_SIZE - current->fill < (size_t)maxFrameLength) {
+        next_block();
+      }
+    }
+    else if (receiveResult == 0) {
+      end = (state.stopReason != NULL) ?
+        CaptureEnd::stopped : CaptureEnd::connectionClosed;
+      break;
+    }
+    else if ((receiveResult != -EINTR) && (receiveResult != -EAGAIN)) {
+      printf("\nERROR: Reading from socket.\n"
+             "Reason: %s\n\n", strerror(-receiveResult));
+      exit(1);
+    }
+
+    if (state.flushDue) {
+      // Write what has been received on every housekeeping tick
+      state.flushDue = false;
+      queue_block_write(current);
+
+      if (state.bytesWritten > state.maxFileSize) {
+        end = CaptureEnd::maxFileSize;
+        break;
+      }
+    }
+  }
+
+  // Write the rest and wait until everything is on file
+  queue_block_write(current);
+  current->retired = true;
+  while (pendingWrites > 0) {
+    submit_and_wait(1);
+    reap_completions();
+  }
+
+  return end;
+}
+
+#endif // HAVE_IO_URING
@@ -0,0 +1,442 @@
+/*
+ *
+ * NAME: evhandl_watchlist.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Watchlist of subscribers, see evhandl_watchlist.h
+ */
+
+
+// Module Include Files
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "evhandl_frame.h"
+#include "evhandl_protocol.h"
+#include "evhandl_watchlist.h"
+
+using namespace std;
+
+
+// Bits per identity in the Bloom filter. With two bits set per identity
+// about 1.5% of the identities not in the watchlist pass the filter.
+const uint32_t  BLOOM_BITS_PER_IDENTITY = 16;
+
+// Collected frames of an identity are released after being handed to
+// the writer if they took more memory than this
+const size_t    MAX_KEPT_PENDING_SIZE = 64 * 1024;
+
+// Octet of the encoded IMSI holding the odd/even flag, and the one
+// holding the filler nibble of an even length IMSI
+const int       IMSI_TYPE_OCTET   = 3;
+const int       IMSI_FILLER_OCTET = 8;
+
+// Mix all key bits into the low and high bits of the hash
+static inline uint64_t hash_key(uint64_t key)
+{
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+// Key of an encoded IMSI, octets 2-9 of the IMSI element
+static inline uint64_t imsi_key(const unsigned char *imsi)
+{
+  unsigned char octets[8];
+  uint64_t      key;
+
+  memcpy(octets, imsi + 2, sizeof(octets));
+  if ((octets[IMSI_TYPE_OCTET - 2] & 0x08) == 0) {
+    octets[IMSI_FILLER_OCTET - 2] &= 0x0F;
+  }
+  memcpy(&key, octets, sizeof(key));
+  return key;
+}
+
+// Key of an encoded TLLI
+static inline uint64_t tlli_key(const unsigned char *tlli)
+{
+  uint32_t key;
+
+  memcpy(&key, tlli, sizeof(key));
+  return key;
+}
+
+
+IdentitySet::IdentitySet()
+  : mask(0),
+    count(0),
+    bloomMask(0)
+{
+}
+
+void IdentitySet::reserve(uint32_t identities)
+{
+  uint64_t slots = 16;
+
+  while (slots < 2 * (uint64_t)identities) {
+    slots *= 2;
+  }
+  keys.assign(slots, 0);
+  indexes.assign(slots, -1);
+  mask  = slots - 1;
+  count = 0;
+
+  bloom.clear();
+  bloomMask = 0;
+  if (identities > WATCHLIST_BLOOM_THRESHOLD) {
+    uint64_t bits = 64;
+
+    while (bits < (uint64_t)identities * BLOOM_BITS_PER_IDENTITY) {
+      bits *= 2;
+    }
+    bloom.assign(bits / 64, 0);
+    bloomMask = bits - 1;
+  }
+}
+
+bool IdentitySet::insert(uint64_t key, int32_t index)
+{
+  uint64_t hash = hash_key(key);
+  uint64_t slot = hash & mask;
+
+  while (indexes[slot] != -1) {
+    if (keys[slot] == key) {
+      return false;
+    }
+    slot = (slot + 1) & mask;
+  }
+  keys[slot]    = key;
+  indexes[slot] = index;
+  count++;
+
+  if (!bloom.empty()) {
+    uint64_t bit1 = hash & bloomMask;
+    uint64_t bit2 = (hash >> 32) & bloomMask;
+
+    bloom[bit1 / 64] |= 1ULL << (bit1 % 64);
+    bloom[bit2 / 64] |= 1ULL << (bit2 % 64);
+  }
+  return true;
+}
+
+int32_t IdentitySet::find(uint64_t key) const
+{
+  uint64_t hash = hash_key(key);
+
+  if (!bloom.empty()) {
+    uint64_t bit1 = hash & bloomMask;
+    uint64_t bit2 = (hash >> 32) & bloomMask;
+
+    if ((((bloom[bit1 / 64] >> (bit1 % 64)) &
+          (bloom[bit2 / 64] >> (bit2 % 64))) & 1) == 0) {
+      return -1;
+    }
+  }
+
+  // The load factor is at most 1/2, there is always a free slot
+  for (uint64_t slot = hash & mask; indexes[slot] != -1;
+       slot = (slot + 1) & mask) {
+    if (keys[slot] == key) {
+      return indexes[slot];
+    }
+  }
+  return -1;
+}
+
+
+Watchlist::Watchlist()
+{
+}
+
+//===============================================================================
+//      Load a watchlist file
+//
+//===============================================================================
+bool Watchlist::load(const string& name, string& error)
+{
+  FILE           *file = fopen(name.c_str(), "r");
+  char            line[256];
+  char            description[160];
+  int             line_number = 0;
+  vector<string>  imsi_lines;
+  vector<string>  tlli_lines;
+
+  if (file == NULL) {
+    error = strerror(errno);
+    return false;
+  }
+
+  // Check all lines before building the sets, so that they can be sized
+  // for the number of identities
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char   *start = line;
+    size_t  length;
+
+    line_number++;
+    length = strlen(line);
+    if ((length > 0) && (line[length - 1] != '\n') && !feof(file)) {
+      snprintf(description, sizeof(description), "Line %d: Line too long",
+               line_number);
+      error = description;
+      fclose(file);
+      return false;
+    }
+
+    while (isspace((unsigned char)*start)) {
+      start++;
+    }
+    length = strlen(start);
+    while ((length > 0) && isspace((unsigned char)start[length - 1])) {
+      start[--length] = '\0';
+    }
+    if ((length == 0) || (start[0] == '#')) {
+      continue;
+    }
+
+    for (size_t n = 0; n < length; n++) {
+      if (!isdigit((unsigned char)start[n])) {
+        snprintf(description, sizeof(description),
+                 "Line %d: Only digits are allowed in an IMSI or TLLI",
+                 line_number);
+        error = description;
+        fclose(file);
+        return false;
+      }
+    }
+
+    if ((length == 14) || (length == 15)) {
+      imsi_lines.push_back(start);
+    }
+    else if ((length <= 10) && (strtoull(start, NULL, 10) <= 0xFFFFFFFFULL)) {
+      tlli_lines.push_back(start);
+    }
+    else {
+      snprintf(description, sizeof(description),
+               "Line %d: %s is neither an IMSI (14 or 15 digits) nor a "
+               "TLLI (max 4294967295)", line_number, start);
+      error = description;
+      fclose(file);
+      return false;
+    }
+
+    if (imsi_lines.size() + tlli_lines.size() > MAX_WATCHLIST_SIZE) {
+      snprintf(description, sizeof(description),
+               "More than %u identities", MAX_WATCHLIST_SIZE);
+      error = description;
+      fclose(file);
+      return false;
+    }
+  }
+  bool read_error = ferror(file);
+  fclose(file);
+  if (read_error) {
+    error = "Read error";
+    return false;
+  }
+
+  identities.clear();
+  imsis.reserve(imsi_lines.size());
+  tllis.reserve(tlli_lines.size());
+
+  // Identities given twice are only kept once
+  for (size_t n = 0; n < imsi_lines.size(); n++) {
+    char imsi_buff[IMSI_LENGTH];
+
+    memset(imsi_buff, 0, sizeof(imsi_buff));
+    assemble_imsi(imsi_buff, imsi_lines[n].c_str());
+    if (imsis.insert(imsi_key((const unsigned char *)imsi_buff),
+                     identities.size())) {
+      identities.push_back(imsi_lines[n]);
+    }
+  }
+  for (size_t n = 0; n < tlli_lines.size(); n++) {
+    char tlli_buff[TLLI_LENGTH];
+    char tlli[16];
+
+    snprintf(tlli, sizeof(tlli), "%s", tlli_lines[n].c_str());
+    assemble_tlli(tlli_buff, tlli);
+    if (tllis.insert(tlli_key((const unsigned char *)tlli_buff),
+                     identities.size())) {
+      identities.push_back(tlli_lines[n]);
+    }
+  }
+
+  if (identities.empty()) {
+    error = "No IMSI or TLLI given";
+    return false;
+  }
+  return true;
+}
+
+//===============================================================================
+//      Find a watched identity in an event frame. Data word 0 is the
+//      Event ID and is never part of an identity.
+//
+//===============================================================================
+int32_t Watchlist::match(const char *frame) const
+{
+  const unsigned char *data  = (const unsigned char *)frame +
+                               FRAME_HEADER_LENGTH;
+  int                  words = frame_data_length(frame) / 2;
+  int32_t              index;
+
+  if (imsis.size() > 0) {
+    // The IMSI element is 5 data words, the first one being the length
+    for (int word = 1; word + IMSI_LENGTH / 2 <= words; word++) {
+      const unsigned char *element = data + 2 * word;
+
+      if ((element[0] == 0) && (element[1] == IMSI_LENGTH - 2) &&
+          ((element[IMSI_TYPE_OCTET] & 0x07) == 1)) {
+        index = imsis.find(imsi_key(element));
+        if (index != -1) {
+          return index;
+        }
+      }
+    }
+  }
+
+  if (tllis.size() > 0) {
+    for (int word = 1; word + TLLI_LENGTH / 2 <= words; word++) {
+      index = tllis.find(tlli_key(data + 2 * word));
+      if (index != -1) {
+        return index;
+      }
+    }
+  }
+  return -1;
+}
+
+
+WatchlistFiles::WatchlistFiles(const Watchlist& list,
+                               BlockWriter& block_writer,
+                               const string& log_file_name,
+                               uint64_t max_file_size)
+  : watchlist(list),
+    writer(block_writer),
+    logFileName(log_file_name),
+    maxFileSize(max_file_size),
+    entries(list.size()),
+    openFiles(0)
+{
+  for (size_t n = 0; n < entries.size(); n++) {
+    entries[n].file = NULL;
+  }
+}
+
+WatchlistFiles::~WatchlistFiles()
+{
+  for (size_t n = 0; n < entries.size(); n++) {
+    delete entries[n].file;
+  }
+}
+
+//===============================================================================
+//      Open the file of an identity, e.g. logfile_gmlog.<IMSI>.gml
+//
+//===============================================================================
+bool WatchlistFiles::open_file(IdentityFile& entry, int32_t index)
+{
+  const string& identity = watchlist.identity(index);
+  size_t        dot      = logFileName.rfind('.');
+  size_t        slash    = logFileName.rfind('/');
+
+  if ((dot == string::npos) || ((slash != string::npos) && (dot < slash))) {
+    entry.name = logFileName + "." + identity;
+  }
+  else {
+    entry.name = logFileName.substr(0, dot) + "." + identity +
+                 logFileName.substr(dot);
+  }
+
+  OutputFile *file = create_output_file(Writer::stream, maxFileSize);
+
+  if (file->open(entry.name) == false) {
+    int error = errno;
+
+    delete file;
+    errno = error;
+    return false;
+  }
+  entry.file = file;
+  openFiles++;
+  return true;
+}
+
+bool WatchlistFiles::append(int32_t index, const char *frame, size_t length)
+{
+  IdentityFile& entry = entries[index];
+
+  if ((entry.file == NULL) && !open_file(entry, index)) {
+    return false;
+  }
+  if (entry.pending.size() + length > WRITE_BLOCK_SIZE) {
+    submit(entry, false);
+  }
+  if (entry.pending.empty()) {
+    dirty.push_back(index);
+  }
+  entry.pending.append(frame, length);
+  return true;
+}
+
+//===============================================================================
+//      Hand the collected frames of an identity to the writer thread
+//
+//===============================================================================
+void WatchlistFiles::submit(IdentityFile& entry, bool close_after)
+{
+  WriteBlock *block = writer.acquire(entry.file, entry.name.c_str());
+
+  if (!entry.pending.empty()) {
+    block = writer.append(block, entry.pending.data(), entry.pending.size());
+  }
+  writer.submit(block, true, close_after);
+
+  if (entry.pending.capacity() > MAX_KEPT_PENDING_SIZE) {
+    string().swap(entry.pending);
+  }
+  else {
+    entry.pending.clear();
+  }
+}
+
+void WatchlistFiles::flush()
+{
+  // An identity is listed again each time it filled a block
+  for (size_t n = 0; n < dirty.size(); n++) {
+    IdentityFile& entry = entries[dirty[n]];
+
+    if (!entry.pending.empty()) {
+      submit(entry, false);
+    }
+  }
+  dirty.clear();
+}
+
+void WatchlistFiles::close()
+{
+  for (size_t n = 0; n < entries.size(); n++) {
+    if (entries[n].file != NULL) {
+      submit(entries[n], true);
+    }
+  }
+  dirty.clear();
+}
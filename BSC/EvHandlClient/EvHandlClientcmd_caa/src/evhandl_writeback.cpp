@@ -0,0 +1,229 @@
+/*
+ *
+ * NAME: evhandl_writeback.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Background durability policy of the log file, see evhandl_writeback.h
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "evhandl_writeback.h"
+
+using namespace std;
+
+
+// How often the fdatasync thread checks whether it is stopped
+const useconds_t  SYNC_POLL_INTERVAL_US = 100000;
+
+
+//===============================================================================
+//      Writeback
+//
+//===============================================================================
+Writeback::Writeback(uint64_t window_size, uint32_t sync_interval_sec)
+  : windowSize(window_size),
+    syncInterval(sync_interval_sec),
+    syncFd(-1),
+    started(false),
+    done(false)
+{
+  pthread_mutex_init(&mutex, NULL);
+}
+
+Writeback::~Writeback()
+{
+  stop();
+  pthread_mutex_destroy(&mutex);
+}
+
+void Writeback::start()
+{
+  if (syncInterval == 0) {
+    return;
+  }
+  if (pthread_create(&thread, NULL, &Writeback::sync_thread, this) != 0) {
+    printf("\nERROR: Failed to start fdatasync thread\n"
+           "Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+  started = true;
+}
+
+void Writeback::stop()
+{
+  done = true;
+  if (started) {
+    pthread_join(thread, NULL);
+    started = false;
+  }
+}
+
+void Writeback::set_sync_fd(int fd)
+{
+  pthread_mutex_lock(&mutex);
+  syncFd = fd;
+  pthread_mutex_unlock(&mutex);
+}
+
+//===============================================================================
+//      Wait until the window at offset is on disk, then drop it from the
+//      page cache. Its write back was started when it was completed.
+//
+//===============================================================================
+void Writeback::wait_for_window(int fd, uint64_t offset)
+{
+  uint64_t start = monotonic_ns();
+
+  sync_file_range(fd, offset, windowSize,
+                  SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                  SYNC_FILE_RANGE_WAIT_AFTER);
+  waitLatency.add(monotonic_ns() - start);
+
+  posix_fadvise(fd, offset, windowSize, POSIX_FADV_DONTNEED);
+}
+
+void* Writeback::sync_thread(void *pParams)
+{
+  ((Writeback *)pParams)->run();
+  return NULL;
+}
+
+//===============================================================================
+//      fdatasync thread main loop. A duplicate of the descriptor is synced,
+//      so that the writer thread may close the file meanwhile.
+//
+//===============================================================================
+void Writeback::run()
+{
+  uint64_t next_ns = monotonic_ns() + syncInterval * 1000000000ULL;
+
+  while (!done) {
+    usleep(SYNC_POLL_INTERVAL_US);
+    if (monotonic_ns() < next_ns) {
+      continue;
+    }
+
+    pthread_mutex_lock(&mutex);
+    int fd = (syncFd >= 0) ? dup(syncFd) : -1;
+    pthread_mutex_unlock(&mutex);
+
+    if (fd >= 0) {
+      uint64_t start = monotonic_ns();
+
+      if (fdatasync(fd) != 0) {
+        printf("\nERROR: Syncing the log file failed.\n"
+               "Reason: %s\n\n", strerror(errno));
+      }
+      syncLatency.add(monotonic_ns() - start);
+      ::close(fd);
+    }
+    next_ns = monotonic_ns() + syncInterval * 1000000000ULL;
+  }
+}
+
+
+//===============================================================================
+//      WritebackOutputFile
+//
+//===============================================================================
+WritebackOutputFile::WritebackOutputFile(OutputFile *file,
+                                         Writeback& writeback)
+  : file(file),
+    writeback(writeback),
+    fd(-1),
+    written(0),
+    kicked(0)
+{
+}
+
+WritebackOutputFile::~WritebackOutputFile()
+{
+  if (fd >= 0) {
+    writeback.set_sync_fd(-1);
+    ::close(fd);
+  }
+  delete file;
+}
+
+bool WritebackOutputFile::open(const string& name)
+{
+  if (!file->open(name)) {
+    return false;
+  }
+
+  // Write back, fdatasync() and dropping pages all work on a read only
+  // descriptor, so any file writer can be used
+  fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  written = 0;
+  kicked  = 0;
+  writeback.set_sync_fd(fd);
+  return true;
+}
+
+void WritebackOutputFile::set_capture_time(uint64_t first_ms,
+                                           uint64_t last_ms)
+{
+  file->set_capture_time(first_ms, last_ms);
+}
+
+//===============================================================================
+//      Start the write back of each window completed by the write, after
+//      waiting for the window before it
+//
+//===============================================================================
+bool WritebackOutputFile::write(const char *data, size_t length)
+{
+  if (!file->write(data, length)) {
+    return false;
+  }
+  written += length;
+
+  uint64_t window = writeback.window_size();
+
+  while ((window > 0) && (written >= kicked + window)) {
+    if (kicked >= window) {
+      writeback.wait_for_window(fd, kicked - window);
+    }
+    sync_file_range(fd, kicked, window, SYNC_FILE_RANGE_WRITE);
+    kicked += window;
+  }
+  return true;
+}
+
+bool WritebackOutputFile::flush()
+{
+  return file->flush();
+}
+
+bool WritebackOutputFile::close()
+{
+  bool result = file->close();
+
+  writeback.set_sync_fd(-1);
+  ::close(fd);
+  fd = -1;
+
+  return result;
+}
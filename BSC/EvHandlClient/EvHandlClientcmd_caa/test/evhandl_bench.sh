@@ -0,0 +1,150 @@
+#!/bin/bash
+# **********************************************************************
+#
+# Short description:
+# End-to-end throughput benchmark of evhandlclient against the BSC
+# simulator on loopback, run by "make bench".
+# **********************************************************************
+#
+# Ericsson AB 2012 All rights reserved.
+# The information in this document is the property of Ericsson.
+# Except as specifically authorized in writing by Ericsson, the receiver of this
+# document shall keep the information contained herein confidential and shall protect
+# the same in whole or in part from disclosure and dissemination to third parties.
+# Disclosure and disseminations to the receivers employees shall only be made
+# on a strict need to know basis.
+#
+# **********************************************************************
+#
+# Usage: evhandl_bench.sh <evhandlclient> <evhandl_bsc_simulator>
+#
+# Settings, from the environment:
+#   BENCH_EVENTS   Events sent, default 2000000, or all replayed
+#   BENCH_RATE     Events per second, default 0 (as fast as possible)
+#   BENCH_SIZES    Size mix, see evhandl_bsc_simulator, default its own
+#   BENCH_PORT     Port on 127.0.0.1, default 17011
+#   BENCH_OPTIONS  Extra evhandlclient options, e.g. --writer=mmap
+#   BENCH_REPLAY   Raw log file replayed instead of synthetic events
+#   BENCH_TIMESTAMPS  Its --timestamps side-car file, for its timing
+#   BENCH_SPEED    Speed up of the recorded timing, default 1
+#
+# Prints the sustained events/s and MB/s, from the first event sent
+# until the client has read the last one, and the CPU time used by the
+# client per MB. Exits with 1 if the capture fails or if the log file
+# is not what was sent, as written by the simulator with --output. A
+# compressed or v2 log file is decompressed or extracted first, and
+# segments are joined. With --filter or --watchlist the log file only
+# holds some of the events and is not compared.
+# **********************************************************************
+
+CLIENT=$1
+SIMULATOR=$2
+EVENTS=${BENCH_EVENTS}
+RATE=${BENCH_RATE:-0}
+PORT=${BENCH_PORT:-17011}
+OUTPUT_DIRECTORY=/data/opt/ap/internal_root/tools/evhandlclient
+LOG_NAME=bench_$$
+LOG_FILE=$LOG_NAME.rpm
+WORK_DIR=$(mktemp -d)
+
+if [ ! -x "$CLIENT" ] || [ ! -x "$SIMULATOR" ]; then
+  echo "Usage: $0 <evhandlclient> <evhandl_bsc_simulator>"
+  exit 1
+fi
+
+SIMULATOR_ARGS="--rate=$RATE"
+if [ -n "$BENCH_REPLAY" ]; then
+  SIMULATOR_ARGS="$SIMULATOR_ARGS --replay=$BENCH_REPLAY"
+  if [ -n "$BENCH_TIMESTAMPS" ]; then
+    SIMULATOR_ARGS="$SIMULATOR_ARGS --timestamps=$BENCH_TIMESTAMPS"
+    SIMULATOR_ARGS="$SIMULATOR_ARGS --speed=${BENCH_SPEED:-1}"
+  fi
+elif [ -z "$EVENTS" ]; then
+  EVENTS=2000000
+fi
+if [ -n "$EVENTS" ]; then
+  SIMULATOR_ARGS="$SIMULATOR_ARGS --events=$EVENTS"
+fi
+if [ -n "$BENCH_SIZES" ]; then
+  SIMULATOR_ARGS="$SIMULATOR_ARGS --sizes=$BENCH_SIZES"
+fi
+
+SIMULATOR_ARGS="$SIMULATOR_ARGS --output=$WORK_DIR/sent.rpm"
+
+"$SIMULATOR" $PORT $SIMULATOR_ARGS > $WORK_DIR/simulator.log 2>&1 &
+SIMULATOR_PID=$!
+sleep 0.5
+
+# The client quits on 'q' from stdin, which is kept open and silent
+TIMEFORMAT='%R %U %S'
+{ time "$CLIENT" rpmo 127.0.0.1 $PORT 1,2,3 -c 65535 -f $LOG_FILE \
+    $BENCH_OPTIONS < <(sleep 86400) > $WORK_DIR/client.log 2>&1 ; } \
+  2> $WORK_DIR/time.log
+CLIENT_RESULT=$?
+pkill -P $$ -x sleep
+
+# The simulator waits for ever for a client that failed before
+# connecting or subscribing
+if [ $CLIENT_RESULT -ne 0 ]; then
+  kill $SIMULATOR_PID 2>/dev/null
+fi
+wait $SIMULATOR_PID
+SIMULATOR_RESULT=$?
+
+if [ $CLIENT_RESULT -ne 0 ] || [ $SIMULATOR_RESULT -ne 0 ]; then
+  echo "Benchmark failed"
+  tr '\r' '\n' < $WORK_DIR/client.log | tail -5
+  cat $WORK_DIR/simulator.log
+  rm -f $OUTPUT_DIRECTORY/$LOG_NAME.*
+  rm -rf $WORK_DIR
+  exit 1
+fi
+
+# The raw log file, as written without BENCH_OPTIONS
+RAW_LOG=$OUTPUT_DIRECTORY/$LOG_FILE
+if [ -f $OUTPUT_DIRECTORY/$LOG_FILE.z ]; then
+  "$CLIENT" decompress $LOG_FILE.z > $WORK_DIR/convert.log 2>&1
+elif [ -f $OUTPUT_DIRECTORY/$LOG_FILE.v2 ]; then
+  "$CLIENT" extract $LOG_FILE.v2 $LOG_FILE > $WORK_DIR/convert.log 2>&1
+elif [ ! -f $RAW_LOG ]; then
+  RAW_LOG=$WORK_DIR/segments.rpm
+  cat $OUTPUT_DIRECTORY/$LOG_NAME.[0-9]*.rpm > $RAW_LOG 2>/dev/null
+fi
+
+case " $BENCH_OPTIONS" in
+  *" --filter="* | *" --watchlist="*)
+    echo "Note: log file not compared, only some of the events are logged"
+    LOG_RESULT=0
+    ;;
+  *)
+    cmp -s $RAW_LOG $WORK_DIR/sent.rpm
+    LOG_RESULT=$?
+    ;;
+esac
+SIZE=$(stat -c %s $RAW_LOG 2>/dev/null)
+EXPECTED_SIZE=$(stat -c %s $WORK_DIR/sent.rpm)
+rm -f $OUTPUT_DIRECTORY/$LOG_NAME.*
+
+# Sent: <events> events <octets> octets <s> s <events/s> events/s <MB/s> MB/s
+read -r _ SENT _ OCTETS _ DURATION _ EVENT_RATE _ MB_RATE _ \
+  < <(grep '^Sent:' $WORK_DIR/simulator.log)
+read -r REAL USER SYS < $WORK_DIR/time.log
+
+if [ $LOG_RESULT -ne 0 ]; then
+  echo "Benchmark failed: log file (${SIZE:-missing} octets) differs from" \
+       "what was sent ($EXPECTED_SIZE octets)"
+  cat $WORK_DIR/convert.log 2>/dev/null
+  rm -rf $WORK_DIR
+  exit 1
+fi
+rm -rf $WORK_DIR
+
+awk -v events=$SENT -v octets=$OCTETS -v seconds=$DURATION \
+    -v event_rate=$EVENT_RATE -v mb_rate=$MB_RATE \
+    -v user=$USER -v sys=$SYS 'BEGIN {
+  mb = octets / (1024 * 1024)
+  printf("Events:     %d (%.1f MB) in %.3f s\n", events, mb, seconds)
+  printf("Throughput: %.0f events/s  %.2f MB/s\n", event_rate, mb_rate)
+  printf("Client CPU: %.2f s user  %.2f s sys  %.2f ms/MB\n",
+         user, sys, (user + sys) * 1000 / mb)
+}'
@@ -0,0 +1,796 @@
+/*
+ *
+ * NAME: evhandl_bsc_simulator.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Simulates the Event Handler of a BSC towards one evhandlclient, for
+ *  testing and benchmarking without a live BSC.
+ *
+ *  The client connection is accepted and the connect request (CMN 1)
+ *  and the subscription requests (CMN 11) are answered as successful.
+ *  When no further subscription request has arrived for
+ *  SUBSCRIPTION_IDLE_MS, synthetic event frames on channel 2 are sent
+ *  for the subscribed Event IDs in turn, at the given rate and with
+ *  data lengths drawn from the given size mix. The connection is then
+ *  closed as by the BSC and the simulator waits for the client to close
+ *  its end, i.e. until the client has read all events.
+ *
+ *  With --replay the event frames of a capture are sent instead, see
+ *  load_replay(). The frames are sent as recorded, whatever Event IDs
+ *  the client subscribed to.
+ *
+ *  The events sent and the sustained rate, from the first event until
+ *  the client closed the connection, are printed on the last line:
+ *
+ *  Sent: <events> events <octets> octets <s> s <events/s> events/s <MB/s> MB/s
+ *
+ *  With --output the connect request and reply and the event frames
+ *  sent are written to a file when done, i.e. what the raw log file of
+ *  the client is to hold, for comparing it octet by octet.
+ */
+
+
+// Module Include Files
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "evhandl_frame.h"
+#include "evhandl_protocol.h"
+#include "evhandl_timestamps.h"
+
+using namespace std;
+
+
+// Sending of events starts when no subscription request has arrived
+// for this long after the last one
+const int       SUBSCRIPTION_IDLE_MS = 200;
+
+// Number of event frames prepared before sending, and sent over and
+// over again
+const int       FRAME_POOL_SIZE = 4096;
+
+// Max octets handed to the socket in one send
+const size_t    MAX_SEND_SIZE = 64 * 1024;
+
+// Largest event frame accepted by evhandlclient is 41000 octets
+const int       MAX_DATA_WORDS = 20000;
+
+// Synthetic events sent by default
+const uint64_t  DEFAULT_EVENT_COUNT = 1000000;
+
+// Rate limited sending sleeps at most this often
+const uint64_t  RATE_INTERVAL_NS = 1000000;
+
+struct SizeMix {
+  int       dataWords;   // Following the header, including the Event ID
+  uint32_t  weight;
+};
+
+// Frame of a replayed capture
+struct ReplayFrame {
+  uint64_t  offset;      // In the capture file
+  uint32_t  length;      // Including the header
+  uint64_t  timeNs;      // Relative to the first frame, 0 without timestamps
+};
+
+// Options
+uint16_t          port        = 0;
+uint64_t          eventCount  = 0;         // 0 for the default
+double            duration    = 0;         // In seconds, 0 if not limited
+double            eventRate   = 0;         // Events per second, 0 if not limited
+uint32_t          seed        = 1;
+vector<SizeMix>   sizeMix;
+string            replayName;
+string            timestampName;
+double            speed       = 1;         // 0 for as fast as possible
+string            outputName;
+
+// Connect request received and reply sent, for --output
+char              connectRequest[CONNECT_REQUEST_LENGTH];
+char              connectReply[CONNECT_REPLY_LENGTH] = {
+  0, 3, 0, 0, 0, CMN_CONNECT, 0, 0, 0, 0 };
+
+// Replayed capture
+const char           *replayData = NULL;
+vector<ReplayFrame>   replayFrames;
+
+//===============================================================================
+//      Function prototypes
+//
+//===============================================================================
+
+// Print the usage and exit
+void print_usage();
+
+// Parse <dataWords>:<weight>,... into sizeMix. Returns false if not valid.
+bool parse_size_mix(const char *value);
+
+// Value of a --name=value option, NULL if argument is not that option
+const char* long_option_value(const char *argument, const char *name);
+
+// Read exactly length octets. Returns false if the client closed the
+// connection.
+bool receive_exactly(int socket_fd, char *buffer, size_t length);
+
+// Send all octets, exits on failure
+void send_all(int socket_fd, const char *buffer, size_t length);
+
+// Answer the connect request and the subscription requests. Returns the
+// subscribed Event IDs.
+vector<int> answer_requests(int socket_fd);
+
+// Build the frames sent over and over again, with the given Event IDs
+// in turn. frame_ends holds the offset following each frame.
+void build_frame_pool(const vector<int>& event_ids, string& pool,
+                      vector<size_t>& frame_ends);
+
+// Send synthetic events from the frame pool
+void send_synthetic(int socket_fd, const string& pool,
+                    const vector<size_t>& frame_ends,
+                    uint64_t& sent, uint64_t& octets);
+
+// Map the capture to replay and find its event frames. Prints the error
+// and exits if the files can not be read.
+void load_replay();
+
+// Send the event frames of the capture
+void send_replay(int socket_fd, uint64_t& sent, uint64_t& octets);
+
+// Write the connect request and reply and the first sent event frames,
+// from the frame pool or the replayed capture, to outputName
+void write_output(const string& pool, const vector<size_t>& frame_ends,
+                  uint64_t sent);
+
+// Sleep until the given monotonic time
+void sleep_until_ns(uint64_t time_ns);
+
+uint64_t monotonic_ns();
+
+//===============================================================================
+//      Main
+//
+//===============================================================================
+int main(int argc, char *argv[])
+{
+  const char *value;
+
+  if (argc < 2) {
+    print_usage();
+  }
+  port = atoi(argv[1]);
+  if (port == 0) {
+    print_usage();
+  }
+
+  for (int n = 2; n < argc; n++) {
+    if ((value = long_option_value(argv[n], "events")) != NULL) {
+      eventCount = strtoull(value, NULL, 10);
+      if (eventCount == 0) {
+        printf("\nInvalid number of events: %s\n\n", value);
+        print_usage();
+      }
+    }
+    else if ((value = long_option_value(argv[n], "duration")) != NULL) {
+      duration = atof(value);
+    }
+    else if ((value = long_option_value(argv[n], "rate")) != NULL) {
+      eventRate = atof(value);
+    }
+    else if ((value = long_option_value(argv[n], "sizes")) != NULL) {
+      if (parse_size_mix(value) == false) {
+        printf("\nInvalid size mix: %s\n\n", value);
+        print_usage();
+      }
+    }
+    else if ((value = long_option_value(argv[n], "seed")) != NULL) {
+      seed = strtoul(value, NULL, 10);
+    }
+    else if ((value = long_option_value(argv[n], "replay")) != NULL) {
+      replayName = value;
+    }
+    else if ((value = long_option_value(argv[n], "timestamps")) != NULL) {
+      timestampName = value;
+    }
+    else if ((value = long_option_value(argv[n], "output")) != NULL) {
+      outputName = value;
+    }
+    else if ((value = long_option_value(argv[n], "speed")) != NULL) {
+      speed = (strcmp(value, "max") == 0) ? 0 : atof(value);
+      if ((speed <= 0) && (strcmp(value, "max") != 0)) {
+        printf("\nInvalid speed: %s\n\n", value);
+        print_usage();
+      }
+    }
+    else {
+      printf("\nUnknown option: %s\n\n", argv[n]);
+      print_usage();
+    }
+  }
+  if ((duration < 0) || (eventRate < 0)) {
+    print_usage();
+  }
+  if (sizeMix.empty()) {
+    parse_size_mix("10:40,50:30,200:20,1000:10");
+  }
+  if (!timestampName.empty() && replayName.empty()) {
+    printf("\nThe --timestamps option can only be used with --replay.\n\n");
+    print_usage();
+  }
+  if (!replayName.empty()) {
+    load_replay();
+  }
+  if (eventCount == 0) {
+    eventCount = replayName.empty() ? DEFAULT_EVENT_COUNT : replayFrames.size();
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int flag      = 1;
+  struct sockaddr_in address;
+
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+  memset(&address, 0, sizeof(address));
+  address.sin_family      = AF_INET;
+  address.sin_port        = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0) ||
+      (listen(listen_fd, 1) < 0)) {
+    printf("Unable to listen on port %u\n", port);
+    printf("Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+
+  int socket_fd = accept(listen_fd, NULL, NULL);
+  if (socket_fd < 0) {
+    printf("Unable to accept the client\n");
+    printf("Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+  close(listen_fd);
+
+  vector<int> event_ids = answer_requests(socket_fd);
+  if (event_ids.empty()) {
+    printf("No subscription request received\n");
+    exit(1);
+  }
+
+  string          pool;
+  vector<size_t>  frame_ends;
+
+  if (replayName.empty()) {
+    build_frame_pool(event_ids, pool, frame_ends);
+  }
+
+  uint64_t  start_ns = monotonic_ns();
+  uint64_t  sent     = 0;
+  uint64_t  octets   = 0;
+
+  if (replayName.empty()) {
+    send_synthetic(socket_fd, pool, frame_ends, sent, octets);
+  }
+  else {
+    send_replay(socket_fd, sent, octets);
+  }
+
+  // Wait for the client to read everything and close its end
+  char buffer[4096];
+
+  shutdown(socket_fd, SHUT_WR);
+  while (read(socket_fd, buffer, sizeof(buffer)) > 0) {
+  }
+  close(socket_fd);
+
+  double seconds = (monotonic_ns() - start_ns) / 1e9;
+
+  if (!outputName.empty()) {
+    write_output(pool, frame_ends, sent);
+  }
+
+  printf("Sent: %lu events %lu octets %.3f s %.0f events/s %.2f MB/s\n",
+         (unsigned long)sent, (unsigned long)octets, seconds, sent / seconds,
+         octets / seconds / (1024 * 1024));
+  return 0;
+}
+
+//===============================================================================
+//      Answer the connect request and the subscription requests
+//
+//===============================================================================
+vector<int> answer_requests(int socket_fd)
+{
+  char         request[FRAME_HEADER_LENGTH + MAX_SUBSCRIPTION_REQUEST_LENGTH];
+  vector<int>  event_ids;
+
+  if (!receive_exactly(socket_fd, connectRequest, CONNECT_REQUEST_LENGTH) ||
+      (frame_channel(connectRequest) != CONTROL_CHANNEL) ||
+      ((unsigned char)connectRequest[5] != CMN_CONNECT)) {
+    printf("No valid connect request received\n");
+    exit(1);
+  }
+
+  // Result 0 in octet 7, protocol and application version 0
+  send_all(socket_fd, connectReply, sizeof(connectReply));
+
+  for (;;) {
+    struct pollfd  readable = { socket_fd, POLLIN, 0 };
+
+    if (poll(&readable, 1, SUBSCRIPTION_IDLE_MS) == 0) {
+      break;
+    }
+    if (!receive_exactly(socket_fd, request, FRAME_HEADER_LENGTH)) {
+      printf("Connection closed by the client\n");
+      exit(1);
+    }
+
+    int length = frame_data_length(request);
+
+    if ((length < 4) ||
+        (length > MAX_SUBSCRIPTION_REQUEST_LENGTH - FRAME_HEADER_LENGTH) ||
+        !receive_exactly(socket_fd, request + FRAME_HEADER_LENGTH, length) ||
+        ((unsigned char)request[5] != CMN_SUBSCRIBE)) {
+      printf("No valid subscription request received\n");
+      exit(1);
+    }
+    event_ids.push_back(frame_event_id(request + 2));
+
+    // CMN 11 and result 0
+    char subscribed[8] = { 0, 2, 0, 0, 0, CMN_SUBSCRIBE, 0, 0 };
+
+    send_all(socket_fd, subscribed, sizeof(subscribed));
+  }
+  return event_ids;
+}
+
+//===============================================================================
+//      Send synthetic events from the frame pool, for the subscribed
+//      Event IDs in turn
+//
+//===============================================================================
+void send_synthetic(int socket_fd, const string& pool,
+                    const vector<size_t>& frame_ends,
+                    uint64_t& sent, uint64_t& octets)
+{
+  // Frames are sent in slices of the pool, a slice ends at a frame
+  // boundary so that the events sent are counted exactly
+  uint64_t  start_ns  = monotonic_ns();
+  uint64_t  end_ns    = (duration > 0) ?
+                        start_ns + (uint64_t)(duration * 1e9) : 0;
+  int       frame     = 0;
+
+  while (sent < eventCount) {
+    uint64_t now_ns = monotonic_ns();
+    uint64_t allowed = eventCount - sent;
+
+    if ((end_ns != 0) && (now_ns >= end_ns)) {
+      break;
+    }
+    if (eventRate > 0) {
+      uint64_t due = (uint64_t)((now_ns - start_ns) * eventRate / 1e9) + 1;
+
+      if (due <= sent) {
+        sleep_until_ns(now_ns + RATE_INTERVAL_NS);
+        continue;
+      }
+      if (due - sent < allowed) {
+        allowed = due - sent;
+      }
+    }
+
+    size_t   from   = (frame == 0) ? 0 : frame_ends[frame - 1];
+    int      last   = frame;
+    uint64_t frames = 1;
+
+    while ((last + 1 < FRAME_POOL_SIZE) && (frames < allowed) &&
+           (frame_ends[last + 1] - from <= MAX_SEND_SIZE)) {
+      last++;
+      frames++;
+    }
+    send_all(socket_fd, pool.data() + from, frame_ends[last] - from);
+    sent   += frames;
+    octets += frame_ends[last] - from;
+    frame   = (last + 1) % FRAME_POOL_SIZE;
+  }
+}
+
+//===============================================================================
+//      Map the capture to replay, a raw log file as written by
+//      evhandlclient, and find its event frames. The control frames, i.e.
+//      the recorded connect and subscription handshake, are skipped.
+//
+//      The frames are timed by the side-car file written with
+//      --timestamps if given. Without it they can only be sent as fast
+//      as possible or at a fixed --rate.
+//
+//===============================================================================
+void load_replay()
+{
+  int          fd = open(replayName.c_str(), O_RDONLY);
+  struct stat  st;
+
+  if ((fd < 0) || (fstat(fd, &st) < 0)) {
+    printf("Unable to open the file %s\n", replayName.c_str());
+    printf("Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+  if (st.st_size == 0) {
+    printf("The file %s is empty\n\n", replayName.c_str());
+    exit(1);
+  }
+  replayData = (const char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                                  fd, 0);
+  close(fd);
+  if (replayData == MAP_FAILED) {
+    printf("Unable to map the file %s\n", replayName.c_str());
+    printf("Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+  madvise((void *)replayData, st.st_size, MADV_SEQUENTIAL);
+
+  uint64_t offset = 0;
+
+  while (offset + FRAME_HEADER_LENGTH <= (uint64_t)st.st_size) {
+    const char  *header = replayData + offset;
+    uint32_t     length = FRAME_HEADER_LENGTH + frame_data_length(header);
+
+    if (offset + length > (uint64_t)st.st_size) {
+      break;
+    }
+    if (frame_channel(header) != CONTROL_CHANNEL) {
+      ReplayFrame frame = { offset, length, 0 };
+      replayFrames.push_back(frame);
+    }
+    offset += length;
+  }
+  if (offset != (uint64_t)st.st_size) {
+    printf("Note: the last %lu octets of %s are not a complete frame and "
+           "are not replayed\n", (unsigned long)(st.st_size - offset),
+           replayName.c_str());
+  }
+  if (replayFrames.empty()) {
+    printf("No event frames in %s\n\n", replayName.c_str());
+    exit(1);
+  }
+
+  if (timestampName.empty()) {
+    return;
+  }
+
+  FILE             *file = fopen(timestampName.c_str(), "rb");
+  char              magic[sizeof(TIMESTAMP_FILE_MAGIC)];
+  TimestampRecord   record;
+  size_t            frame = 0;
+  uint64_t          first_ns = 0;
+  bool              first = true;
+
+  if (file == NULL) {
+    printf("Unable to open the file %s\n", timestampName.c_str());
+    printf("Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+  if ((fread(magic, sizeof(magic), 1, file) != 1) ||
+      (memcmp(magic, TIMESTAMP_FILE_MAGIC, sizeof(magic)) != 0)) {
+    printf("%s is not a timestamp file\n\n", timestampName.c_str());
+    exit(1);
+  }
+
+  // Frames without a record keep the time of the frame before them
+  while ((fread(&record, sizeof(record), 1, file) == 1) &&
+         (frame < replayFrames.size())) {
+    if (first) {
+      first_ns = record.receiveTimeNs;
+      first    = false;
+    }
+    uint64_t time_ns = (record.receiveTimeNs > first_ns) ?
+                       record.receiveTimeNs - first_ns : 0;
+
+    while ((frame < replayFrames.size()) &&
+           (replayFrames[frame].offset < record.offset)) {
+      replayFrames[frame].timeNs = (frame > 0) ?
+                                   replayFrames[frame - 1].timeNs : 0;
+      frame++;
+    }
+    if ((frame < replayFrames.size()) &&
+        (replayFrames[frame].offset == record.offset)) {
+      replayFrames[frame++].timeNs = time_ns;
+    }
+  }
+  for (; frame < replayFrames.size(); frame++) {
+    replayFrames[frame].timeNs = (frame > 0) ?
+                                 replayFrames[frame - 1].timeNs : 0;
+  }
+  fclose(file);
+
+  // A time going backwards, e.g. after a clock step, is not waited for
+  for (frame = 1; frame < replayFrames.size(); frame++) {
+    if (replayFrames[frame].timeNs < replayFrames[frame - 1].timeNs) {
+      replayFrames[frame].timeNs = replayFrames[frame - 1].timeNs;
+    }
+  }
+  printf("Replaying %lu frames recorded during %.3f s\n",
+         (unsigned long)replayFrames.size(),
+         replayFrames.back().timeNs / 1e9);
+}
+
+//===============================================================================
+//      Send the event frames of the capture. Frames that are adjacent in
+//      the file and due are sent together.
+//
+//===============================================================================
+void send_replay(int socket_fd, uint64_t& sent, uint64_t& octets)
+{
+  bool      timed    = !timestampName.empty() && (speed > 0);
+  uint64_t  start_ns = monotonic_ns();
+  uint64_t  end_ns   = (duration > 0) ?
+                       start_ns + (uint64_t)(duration * 1e9) : 0;
+  uint64_t  count    = (eventCount < replayFrames.size()) ?
+                       eventCount : replayFrames.size();
+  size_t    frame    = 0;
+
+  while (frame < count) {
+    uint64_t now_ns  = monotonic_ns();
+    uint64_t allowed = count - frame;
+
+    if ((end_ns != 0) && (now_ns >= end_ns)) {
+      break;
+    }
+    if (timed) {
+      uint64_t due_ns = start_ns +
+                        (uint64_t)(replayFrames[frame].timeNs / speed);
+
+      if (due_ns > now_ns) {
+        sleep_until_ns(due_ns);
+        continue;
+      }
+    }
+    else if (eventRate > 0) {
+      uint64_t due = (uint64_t)((now_ns - start_ns) * eventRate / 1e9) + 1;
+
+      if (due <= frame) {
+        sleep_until_ns(now_ns + RATE_INTERVAL_NS);
+        continue;
+      }
+      if (due - frame < allowed) {
+        allowed = due - frame;
+      }
+    }
+
+    uint64_t from  = replayFrames[frame].offset;
+    uint64_t to    = from + replayFrames[frame].length;
+    size_t   first = frame++;
+
+    while ((frame - first < allowed) && (frame < count) &&
+           (replayFrames[frame].offset == to) &&
+           (to + replayFrames[frame].length - from <= MAX_SEND_SIZE) &&
+           (!timed ||
+            (start_ns + (uint64_t)(replayFrames[frame].timeNs / speed) <=
+             now_ns))) {
+      to += replayFrames[frame++].length;
+    }
+    send_all(socket_fd, replayData + from, to - from);
+    octets += to - from;
+  }
+  sent = frame;
+}
+
+//===============================================================================
+//      Write what the raw log file of the client is to hold. The frame
+//      pool is sent over and over again from its first frame.
+//
+//===============================================================================
+void write_output(const string& pool, const vector<size_t>& frame_ends,
+                  uint64_t sent)
+{
+  FILE *file = fopen(outputName.c_str(), "wb");
+  bool  ok   = (file != NULL);
+
+  ok = ok && (fwrite(connectRequest, sizeof(connectRequest), 1, file) == 1);
+  ok = ok && (fwrite(connectReply, sizeof(connectReply), 1, file) == 1);
+
+  for (uint64_t frame = 0; ok && (frame < sent); frame++) {
+    if (replayName.empty()) {
+      size_t n    = frame % FRAME_POOL_SIZE;
+      size_t from = (n == 0) ? 0 : frame_ends[n - 1];
+
+      ok = (fwrite(pool.data() + from, frame_ends[n] - from, 1, file) == 1);
+    }
+    else {
+      ok = (fwrite(replayData + replayFrames[frame].offset,
+                   replayFrames[frame].length, 1, file) == 1);
+    }
+  }
+
+  if ((file == NULL) || (fclose(file) != 0) || !ok) {
+    printf("Unable to write the file %s\n", outputName.c_str());
+    printf("Reason: %s\n\n", strerror(errno));
+    exit(1);
+  }
+}
+
+//===============================================================================
+//      Build the frames sent over and over again. The data following the
+//      Event ID is random.
+//
+//===============================================================================
+void build_frame_pool(const vector<int>& event_ids, string& pool,
+                      vector<size_t>& frame_ends)
+{
+  uint32_t total_weight = 0;
+
+  for (size_t n = 0; n < sizeMix.size(); n++) {
+    total_weight += sizeMix[n].weight;
+  }
+
+  srandom(seed);
+  frame_ends.resize(FRAME_POOL_SIZE);
+  for (int n = 0; n < FRAME_POOL_SIZE; n++) {
+    uint32_t pick = random() % total_weight;
+    size_t   mix  = 0;
+
+    while (pick >= sizeMix[mix].weight) {
+      pick -= sizeMix[mix].weight;
+      mix++;
+    }
+
+    int  words = sizeMix[mix].dataWords;
+    int  eid   = event_ids[n % event_ids.size()];
+    char header[FRAME_HEADER_LENGTH + 2] = {
+      (char)(words >> 8), (char)words, 0, EVENT_CHANNEL,
+      (char)(eid >> 8), (char)eid };
+
+    pool.append(header, sizeof(header));
+    for (int octet = 2; octet < 2 * words; octet++) {
+      pool.push_back((char)random());
+    }
+    frame_ends[n] = pool.size();
+  }
+}
+
+bool parse_size_mix(const char *value)
+{
+  const char *next = value;
+
+  sizeMix.clear();
+  while (*next != '\0') {
+    char    *end;
+    SizeMix  size;
+
+    size.dataWords = strtol(next, &end, 10);
+    if ((end == next) || (*end != ':') ||
+        (size.dataWords < 1) || (size.dataWords > MAX_DATA_WORDS)) {
+      return false;
+    }
+    next = end + 1;
+    size.weight = strtoul(next, &end, 10);
+    if ((end == next) || ((*end != ',') && (*end != '\0')) ||
+        (size.weight == 0)) {
+      return false;
+    }
+    next = (*end == ',') ? end + 1 : end;
+    sizeMix.push_back(size);
+  }
+  return !sizeMix.empty();
+}
+
+const char* long_option_value(const char *argument, const char *name)
+{
+  size_t length = strlen(name);
+
+  if ((strncmp(argument, "--", 2) == 0) &&
+      (strncmp(argument + 2, name, length) == 0) &&
+      (argument[2 + length] == '=')) {
+    return argument + 3 + length;
+  }
+  return NULL;
+}
+
+bool receive_exactly(int socket_fd, char *buffer, size_t length)
+{
+  while (length > 0) {
+    ssize_t n = read(socket_fd, buffer, length);
+
+    if (n <= 0) {
+      if ((n < 0) && (errno == EINTR)) {
+        continue;
+      }
+      return false;
+    }
+    buffer += n;
+    length -= n;
+  }
+  return true;
+}
+
+void send_all(int socket_fd, const char *buffer, size_t length)
+{
+  while (length > 0) {
+    ssize_t n = send(socket_fd, buffer, length, 0);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("ERROR: Writing to socket\n"
+             "Reason: %s\n\n", strerror(errno));
+      exit(1);
+    }
+    buffer += n;
+    length -= n;
+  }
+}
+
+void sleep_until_ns(uint64_t time_ns)
+{
+  struct timespec ts;
+
+  ts.tv_sec  = time_ns / 1000000000ULL;
+  ts.tv_nsec = time_ns % 1000000000ULL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+}
+
+uint64_t monotonic_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void print_usage()
+{
+  printf("evhandl_bsc_simulator <port> [--events=<events>] "
+         "[--duration=<seconds>]\n"
+         "                      [--rate=<rate>] [--sizes=<sizes>] "
+         "[--seed=<seed>]\n"
+         "                      [--replay=<capture> [--timestamps=<timestamps>]\n"
+         "                       [--speed=<speed>]] [--output=<output>]\n\n");
+  printf("<port>            Port on 127.0.0.1 to accept one client on\n");
+  printf("<events>          Number of events to send, default 1000000\n");
+  printf("<seconds>         Stop sending after this time even if not all\n"
+         "                  events are sent\n");
+  printf("<rate>            Events per second, default as fast as the client\n"
+         "                  reads\n");
+  printf("<sizes>           Data words per event and their weight, as\n"
+         "                  <words>:<weight>,... default 10:40,50:30,200:20,1000:10\n");
+  printf("<seed>            Seed of the random event data, default 1\n");
+  printf("<capture>         Replay the event frames of a raw log file instead,\n"
+         "                  use evhandlclient decompress or extract first for\n"
+         "                  compressed and v2 log files. <events> defaults to\n"
+         "                  all frames of the file.\n");
+  printf("<timestamps>      Side-car file written with evhandlclient --timestamps\n"
+         "                  during the capture, replays the frames with their\n"
+         "                  recorded timing. Without it the frames are sent as\n"
+         "                  fast as possible or at <rate>.\n");
+  printf("<speed>           Speed up of the recorded timing, e.g. 10, or max,\n"
+         "                  default 1\n");
+  printf("<output>          Write the connect request and reply and the event\n"
+         "                  frames sent to this file when done, i.e. what the\n"
+         "                  raw log file of the client is to hold\n\n");
+  exit(1);
+}
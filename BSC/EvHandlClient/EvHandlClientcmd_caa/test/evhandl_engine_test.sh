@@ -0,0 +1,100 @@
+#!/bin/bash
+# **********************************************************************
+#
+# Short description:
+# Checks that the capture engines write the same log file as the
+# default engine, run by "make engine_test".
+# **********************************************************************
+#
+# Ericsson AB 2012 All rights reserved.
+# The information in this document is the property of Ericsson.
+# Except as specifically authorized in writing by Ericsson, the receiver of this
+# document shall keep the information contained herein confidential and shall protect
+# the same in whole or in part from disclosure and dissemination to third parties.
+# Disclosure and disseminations to the receivers employees shall only be made
+# on a strict need to know basis.
+#
+# **********************************************************************
+#
+# Usage: evhandl_engine_test.sh <evhandlclient> <evhandl_bsc_simulator>
+#
+# Settings, from the environment:
+#   TEST_EVENTS    Events sent per capture, default 500000
+#   TEST_PORT      Port on 127.0.0.1, default 17012
+#
+# The same events, from the same seed, are captured with each engine and
+# the log files are compared octet by octet with the one of the default
+# engine. The events are large enough for frames to be split between
+# the receive blocks of the engines. An engine the kernel does not
+# support is skipped. Exits with 1 if a capture fails or a log differs.
+# **********************************************************************
+
+CLIENT=$1
+SIMULATOR=$2
+EVENTS=${TEST_EVENTS:-500000}
+PORT=${TEST_PORT:-17012}
+OUTPUT_DIRECTORY=/data/opt/ap/internal_root/tools/evhandlclient
+WORK_DIR=$(mktemp -d)
+RESULT=0
+
+if [ ! -x "$CLIENT" ] || [ ! -x "$SIMULATOR" ]; then
+  echo "Usage: $0 <evhandlclient> <evhandl_bsc_simulator>"
+  exit 1
+fi
+
+# Capture with the engine given as $1 into $OUTPUT_DIRECTORY/$2
+capture() {
+  local ENGINE=$1
+  local LOG_FILE=$2
+
+  "$SIMULATOR" $PORT --events=$EVENTS --seed=7 --sizes=10:40,1000:40,20000:20 \
+    > $WORK_DIR/simulator.log 2>&1 &
+  local SIMULATOR_PID=$!
+  sleep 0.5
+
+  # The client quits on 'q' from stdin, which is kept open and silent
+  "$CLIENT" rpmo 127.0.0.1 $PORT 1,2,3 -c 65535 -f $LOG_FILE \
+    --engine=$ENGINE < <(sleep 3600) > $WORK_DIR/client.log 2>&1
+  local CLIENT_RESULT=$?
+  pkill -P $$ -x sleep
+  if [ $CLIENT_RESULT -ne 0 ]; then
+    kill $SIMULATOR_PID 2>/dev/null
+  fi
+  wait $SIMULATOR_PID
+  local SIMULATOR_RESULT=$?
+
+  if [ $CLIENT_RESULT -ne 0 ] || [ $SIMULATOR_RESULT -ne 0 ]; then
+    echo "Capture with the $ENGINE engine failed"
+    tr '\r' '\n' < $WORK_DIR/client.log | tail -5
+    cat $WORK_DIR/simulator.log
+    return 1
+  fi
+  return 0
+}
+
+REFERENCE=engine_test_$$_default.rpm
+if ! capture default $REFERENCE; then
+  rm -f $OUTPUT_DIRECTORY/$REFERENCE
+  rm -rf $WORK_DIR
+  exit 1
+fi
+
+for ENGINE in uring splice; do
+  LOG_FILE=engine_test_$$_$ENGINE.rpm
+
+  if ! capture $ENGINE $LOG_FILE; then
+    RESULT=1
+  elif grep -q "engine can not be used" $WORK_DIR/client.log; then
+    echo "Engine $ENGINE: not supported, skipped"
+  elif cmp $OUTPUT_DIRECTORY/$REFERENCE $OUTPUT_DIRECTORY/$LOG_FILE; then
+    echo "Engine $ENGINE: same log file as the default engine"
+  else
+    echo "Engine $ENGINE: log file differs from the default engine"
+    RESULT=1
+  fi
+  rm -f $OUTPUT_DIRECTORY/$LOG_FILE
+done
+
+rm -f $OUTPUT_DIRECTORY/$REFERENCE
+rm -rf $WORK_DIR
+exit $RESULT
@@ -0,0 +1,122 @@
+/*
+ *
+ * NAME: evhandl_filter_test.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Checks of the --filter expressions of evhandl_frame_filter.cpp, run
+ *  by "make filter_test".
+ *
+ *  Each check compiles an expression and evaluates it on an event frame
+ *  with the given Event ID, data words and length. Exits with 1 if a
+ *  check fails.
+ */
+
+
+// Module Include Files
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#include "evhandl_frame.h"
+#include "evhandl_frame_filter.h"
+
+using namespace std;
+
+
+struct FilterCheck {
+  const char  *expression;
+  int          eid;
+  int          word1;     // Data word 1, following the Event ID
+  int          words;     // Number of data words
+  bool         accepted;
+};
+
+const FilterCheck CHECKS[] = {
+  { "eid == 100",                  100,  0,  2, true  },
+  { "eid == 100",                  101,  0,  2, false },
+  // A leading zero is decimal, only 0x gives another base
+  { "eid == 0100",                 100,  0,  2, true  },
+  { "eid == 0100",                  64,  0,  2, false },
+  { "eid in 010-012",               11,  0,  2, true  },
+  { "eid in 010-012",                9,  0,  2, false },
+  { "word[01] == 0777",              1,777,  2, true  },
+  { "eid == 0x40",                  64,  0,  2, true  },
+  { "eid == 0X40",                  64,  0,  2, true  },
+  { "eid == 0",                      0,  0,  2, true  },
+  { "eid in 1,2,7 and len >= 64",    7,  0, 30, true  },
+  { "eid in 1,2,7 and len >= 64",    7,  0, 10, false },
+  { "not eid == 5 or word[1] > 9",   5, 10,  2, true  },
+  { "word[5] == 0",                  1,  0,  2, false },
+};
+
+// Expressions that must be rejected
+const char *const INVALID[] = {
+  "eid ==",
+  "eid == 300000",
+  "eid in 5-3",
+  "word[0100000] == 1",
+  "(eid == 1",
+};
+
+//===============================================================================
+//      Main
+//
+//===============================================================================
+int main()
+{
+  int failed = 0;
+
+  for (size_t n = 0; n < sizeof(CHECKS) / sizeof(CHECKS[0]); n++) {
+    const FilterCheck& check = CHECKS[n];
+    FrameFilter        filter;
+    string             error;
+    char               frame[FRAME_HEADER_LENGTH + 2 * 64] = { 0 };
+
+    frame[0] = (char)(check.words >> 8);
+    frame[1] = (char)check.words;
+    frame[3] = EVENT_CHANNEL;
+    frame[4] = (char)(check.eid >> 8);
+    frame[5] = (char)check.eid;
+    frame[6] = (char)(check.word1 >> 8);
+    frame[7] = (char)check.word1;
+
+    if (!filter.compile(check.expression, error)) {
+      printf("FAILED: \"%s\" not compiled: %s\n", check.expression,
+             error.c_str());
+      failed++;
+    }
+    else if (filter.accept(frame) != check.accepted) {
+      printf("FAILED: \"%s\" %s Event ID %d\n", check.expression,
+             check.accepted ? "does not accept" : "accepts", check.eid);
+      failed++;
+    }
+  }
+
+  for (size_t n = 0; n < sizeof(INVALID) / sizeof(INVALID[0]); n++) {
+    FrameFilter filter;
+    string      error;
+
+    if (filter.compile(INVALID[n], error)) {
+      printf("FAILED: \"%s\" compiled\n", INVALID[n]);
+      failed++;
+    }
+  }
+
+  if (failed > 0) {
+    printf("%d filter check(s) failed\n", failed);
+    return 1;
+  }
+  printf("All filter checks passed\n");
+  return 0;
+}
@@ -0,0 +1,350 @@
+/*
+ *
+ * NAME: evhandl_protocol_bench.cpp
+ *
+ * COPYRIGHT Ericsson Utvecklings AB, Sweden 2012.
+ * All rights reserved.
+ *
+ *  The Copyright to the computer program(s) herein
+ *  is the property of Ericsson Telecom AB, Sweden.
+ *  The program(s) may be used and/or copied only with
+ *  the written permission from Ericsson Telecom AB or in
+ *  accordance with the terms and conditions stipulated in the
+ *  agreement/contract under which the program(s) have been
+ *  supplied.
+ *
+ * .DESCRIPTION
+ *  Microbenchmarks of the frame parsing and of the encoding and decoding
+ *  in evhandl_protocol.cpp, run by "make microbench".
+ *
+ *  Each benchmark is run with a growing number of iterations until it
+ *  takes at least the minimum time, and the time per iteration of that
+ *  last run is printed, in the manner of Google Benchmark. The list
+ *  decoders modify their input, so their time includes copying the
+ *  list, which is also given on its own as a baseline.
+ */
+
+
+// Module Include Files
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "evhandl_frame.h"
+#include "evhandl_protocol.h"
+
+using namespace std;
+
+
+// Default minimum time of the measured run of a benchmark
+const double    DEFAULT_MIN_TIME = 0.5;
+
+// Size of the frame stream parsed by the parser benchmark
+const size_t    FRAME_STREAM_SIZE = 1024 * 1024;
+
+// Largest cell list accepted by decode_cell_list(), the list also holds
+// the terminating -1
+const int       MAX_DECODED_CELLS = MAX_CELLS - 1;
+
+struct Benchmark {
+  const char  *name;
+  // Run the benchmark the given number of times. Returns the number of
+  // octets processed, 0 if not a throughput benchmark.
+  uint64_t   (*run)(uint64_t iterations);
+};
+
+// Input of the benchmarks, set up once
+string          frameStream;
+string          eventListText;
+string          cellListText;
+vector<int>     cellList;
+char            imsiBuff[IMSI_LENGTH];
+
+//===============================================================================
+//      Function prototypes
+//
+//===============================================================================
+
+// Keep the compiler from optimizing away a result
+inline void do_not_optimize(const void *value)
+{
+  asm volatile("" : : "g"(value) : "memory");
+}
+
+uint64_t monotonic_ns();
+
+// Build the input of the benchmarks
+void set_up();
+
+// Print the usage and exit
+void print_usage();
+
+//===============================================================================
+//      Benchmarks
+//
+//===============================================================================
+
+// Walk a stream of event frames by their headers, as the receive loop
+uint64_t parse_frame_headers(uint64_t iterations)
+{
+  const char *data = frameStream.data();
+  size_t      size = frameStream.size();
+  uint64_t    events = 0;
+
+  for (uint64_t n = 0; n < iterations; n++) {
+    size_t offset = 0;
+
+    while (offset + FRAME_HEADER_LENGTH <= size) {
+      const char *frame = data + offset;
+
+      if (frame_channel(frame) == EVENT_CHANNEL) {
+        events += frame_event_id(frame);
+      }
+      offset += FRAME_HEADER_LENGTH + frame_data_length(frame);
+    }
+    do_not_optimize(&events);
+  }
+  return iterations * size;
+}
+
+uint64_t assemble_imsi_15(uint64_t iterations)
+{
+  for (uint64_t n = 0; n < iterations; n++) {
+    memset(imsiBuff, 0, sizeof(imsiBuff));
+    assemble_imsi(imsiBuff, "240991234567890");
+    do_not_optimize(imsiBuff);
+  }
+  return 0;
+}
+
+uint64_t assemble_tlli_max(uint64_t iterations)
+{
+  char tlli[] = "4294967295";
+  char tlli_buff[TLLI_LENGTH];
+
+  for (uint64_t n = 0; n < iterations; n++) {
+    do_not_optimize(tlli);
+    assemble_tlli(tlli_buff, tlli);
+    do_not_optimize(tlli_buff);
+  }
+  return 0;
+}
+
+uint64_t copy_cell_list(uint64_t iterations)
+{
+  vector<char> text(cellListText.size() + 1);
+
+  for (uint64_t n = 0; n < iterations; n++) {
+    memcpy(&text[0], cellListText.c_str(), text.size());
+    do_not_optimize(&text[0]);
+  }
+  return 0;
+}
+
+uint64_t decode_event_list_max(uint64_t iterations)
+{
+  vector<char> text(eventListText.size() + 1);
+  int          event_list[MAX_EVENT_IDS];
+
+  for (uint64_t n = 0; n < iterations; n++) {
+    memcpy(&text[0], eventListText.c_str(), text.size());
+    if (decode_event_list(&text[0], event_list) != 0) {
+      exit(1);
+    }
+    do_not_optimize(event_list);
+  }
+  return 0;
+}
+
+uint64_t decode_cell_list_max(uint64_t iterations)
+{
+  vector<char> text(cellListText.size() + 1);
+  int          cell_list[MAX_CELLS];
+
+  for (uint64_t n = 0; n < iterations; n++) {
+    memcpy(&text[0], cellListText.c_str(), text.size());
+    if (decode_cell_list(&text[0], cell_list) != 0) {
+      exit(1);
+    }
+    do_not_optimize(cell_list);
+  }
+  return 0;
+}
+
+uint64_t build_subscription_all_cells(uint64_t iterations)
+{
+  char buffer[MAX_SUBSCRIPTION_REQUEST_LENGTH];
+  int  all_cells[2] = { 0xFFFF, -1 };
+
+  for (uint64_t n = 0; n < iterations; n++) {
+    build_subscription_request(buffer, 1, all_cells, NULL, MsId::none,
+                               InvokedAs::RPMO);
+    do_not_optimize(buffer);
+  }
+  return 0;
+}
+
+uint64_t build_subscription_max_cells(uint64_t iterations)
+{
+  char buffer[MAX_SUBSCRIPTION_REQUEST_LENGTH];
+
+  for (uint64_t n = 0; n < iterations; n++) {
+    build_subscription_request(buffer, 1, &cellList[0], NULL, MsId::none,
+                               InvokedAs::RPMO);
+    do_not_optimize(buffer);
+  }
+  return 0;
+}
+
+uint64_t build_subscription_imsi(uint64_t iterations)
+{
+  char buffer[MAX_SUBSCRIPTION_REQUEST_LENGTH];
+  int  no_cells[1] = { -1 };
+
+  for (uint64_t n = 0; n < iterations; n++) {
+    build_subscription_request(buffer, 1, no_cells, imsiBuff, MsId::IMSI,
+                               InvokedAs::GMLog);
+    do_not_optimize(buffer);
+  }
+  return 0;
+}
+
+const Benchmark BENCHMARKS[] = {
+  { "parse_frame_headers/1MB",           parse_frame_headers },
+  { "assemble_imsi/15_digits",           assemble_imsi_15 },
+  { "assemble_tlli/10_digits",           assemble_tlli_max },
+  { "copy_cell_list/2047_cells",         copy_cell_list },
+  { "decode_event_list/63_events",       decode_event_list_max },
+  { "decode_cell_list/2047_cells",       decode_cell_list_max },
+  { "build_subscription/all_cells",      build_subscription_all_cells },
+  { "build_subscription/2047_cells",     build_subscription_max_cells },
+  { "build_subscription/imsi",           build_subscription_imsi },
+};
+
+//===============================================================================
+//      Main
+//
+//===============================================================================
+int main(int argc, char *argv[])
+{
+  double       min_time = DEFAULT_MIN_TIME;
+  const char  *filter   = "";
+
+  for (int n = 1; n < argc; n++) {
+    if (strncmp(argv[n], "--min-time=", 11) == 0) {
+      min_time = atof(argv[n] + 11);
+      if (min_time <= 0) {
+        print_usage();
+      }
+    }
+    else if (strncmp(argv[n], "--filter=", 9) == 0) {
+      filter = argv[n] + 9;
+    }
+    else {
+      print_usage();
+    }
+  }
+
+  set_up();
+
+  printf("%-34s %12s %12s %12s\n", "Benchmark", "Time", "Iterations",
+         "Throughput");
+  printf("%s\n", string(73, '-').c_str());
+
+  for (size_t b = 0; b < sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]); b++) {
+    const Benchmark& benchmark = BENCHMARKS[b];
+
+    if (strstr(benchmark.name, filter) == NULL) {
+      continue;
+    }
+
+    // Grow the iterations until the run takes the minimum time
+    uint64_t iterations = 1;
+    uint64_t octets;
+    double   seconds;
+
+    for (;;) {
+      uint64_t start_ns = monotonic_ns();
+
+      octets  = benchmark.run(iterations);
+      seconds = (monotonic_ns() - start_ns) / 1e9;
+      if ((seconds >= min_time) || (iterations >= (1ULL << 40))) {
+        break;
+      }
+      double factor = (seconds > 0) ? 1.4 * min_time / seconds : 100;
+
+      iterations = (uint64_t)(iterations * ((factor > 100) ? 100 :
+                                            (factor < 2) ? 2 : factor));
+    }
+
+    double ns = seconds * 1e9 / iterations;
+
+    printf("%-34s %9.1f ns %12lu", benchmark.name, ns,
+           (unsigned long)iterations);
+    if (octets > 0) {
+      printf(" %7.1f MB/s", octets / seconds / (1024 * 1024));
+    }
+    printf("\n");
+  }
+  return 0;
+}
+
+//===============================================================================
+//      Build the input of the benchmarks
+//
+//===============================================================================
+void set_up()
+{
+  // Event frames with a mix of lengths as in a busy R-PMO capture
+  const int  data_words[] = { 10, 50, 200, 1000 };
+  int        frames = 0;
+
+  srandom(1);
+  while (frameStream.size() < FRAME_STREAM_SIZE) {
+    int  words = data_words[frames++ % 4];
+    int  eid   = 1 + random() % 64;
+    char header[FRAME_HEADER_LENGTH + 2] = {
+      (char)(words >> 8), (char)words, 0, EVENT_CHANNEL,
+      (char)(eid >> 8), (char)eid };
+
+    frameStream.append(header, sizeof(header));
+    frameStream.append(2 * words - 2, (char)random());
+  }
+
+  char number[16];
+
+  for (int n = 1; n < MAX_EVENT_IDS; n++) {
+    snprintf(number, sizeof(number), "%s%d", (n > 1) ? "," : "", n);
+    eventListText += number;
+  }
+  for (int n = 0; n < MAX_DECODED_CELLS; n++) {
+    snprintf(number, sizeof(number), "%s%d", (n > 0) ? "," : "", n * 7);
+    cellListText += number;
+    cellList.push_back(n * 7);
+  }
+  cellList.push_back(-1);
+
+  memset(imsiBuff, 0, sizeof(imsiBuff));
+  assemble_imsi(imsiBuff, "240991234567890");
+}
+
+uint64_t monotonic_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void print_usage()
+{
+  printf("evhandl_protocol_bench [--min-time=<seconds>] [--filter=<name>]\n\n");
+  printf("<seconds>         Minimum time of the measured run of each\n"
+         "                  benchmark, default %.1f\n", DEFAULT_MIN_TIME);
+  printf("<name>            Only run the benchmarks whose name contains\n"
+         "                  <name>\n\n");
+  exit(1);
+}